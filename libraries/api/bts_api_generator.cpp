@@ -30,10 +30,12 @@ private:
   std::string _to_variant_function;
   std::string _from_variant_function;
   bool _obscure_in_log_files;
+  bool _pack_via_variant;
 public:
   type_mapping(const std::string& type_name) :
     _type_name(type_name),
-    _obscure_in_log_files(false)
+    _obscure_in_log_files(false),
+    _pack_via_variant(false)
   {}
   std::string get_type_name() { return _type_name; }
   virtual std::string get_cpp_parameter_type() = 0;
@@ -42,9 +44,15 @@ public:
   virtual void set_from_variant_function(const std::string& from_variant_function) { _from_variant_function = from_variant_function; }
   virtual void set_obscure_in_log_files() { _obscure_in_log_files = true; }
   virtual bool get_obscure_in_log_files() const { return _obscure_in_log_files; }
+  virtual void set_pack_via_variant() { _pack_via_variant = true; }
+  // types without fc::raw support, or with their own variant conversions, are sent over the binary protocol as variants
+  virtual bool get_pack_via_variant() const { return _pack_via_variant || !_to_variant_function.empty() || !_from_variant_function.empty(); }
   virtual std::string convert_object_of_type_to_variant(const std::string& object_name);
   virtual std::string convert_variant_to_object_of_type(const std::string& variant_name);
   virtual std::string create_value_of_type_from_variant(const fc::variant& value);
+  std::string get_binary_type();
+  std::string convert_object_of_type_to_binary_type(const std::string& object_name);
+  std::string convert_binary_type_to_object_of_type(const std::string& binary_object_name);
 };
 typedef std::shared_ptr<type_mapping> type_mapping_ptr;
 
@@ -71,6 +79,27 @@ std::string type_mapping::create_value_of_type_from_variant(const fc::variant& v
   return convert_variant_to_object_of_type(default_value_as_variant.str());
 }
 
+std::string type_mapping::get_binary_type()
+{
+  if (get_pack_via_variant())
+    return "fc::variant";
+  return get_cpp_return_type();
+}
+
+std::string type_mapping::convert_object_of_type_to_binary_type(const std::string& object_name)
+{
+  if (get_pack_via_variant())
+    return convert_object_of_type_to_variant(object_name);
+  return object_name;
+}
+
+std::string type_mapping::convert_binary_type_to_object_of_type(const std::string& binary_object_name)
+{
+  if (get_pack_via_variant())
+    return convert_variant_to_object_of_type(binary_object_name);
+  return binary_object_name;
+}
+
 
 class void_type_mapping : public type_mapping
 {
@@ -114,6 +143,7 @@ public:
   {}
   virtual std::string get_cpp_parameter_type() override { return "const std::vector<" + _contained_type->get_cpp_return_type() + ">&"; }
   virtual std::string get_cpp_return_type() override { return "std::vector<" + _contained_type->get_cpp_return_type() + ">"; }
+  virtual bool get_pack_via_variant() const override { return type_mapping::get_pack_via_variant() || _contained_type->get_pack_via_variant(); }
 };
 typedef std::shared_ptr<sequence_type_mapping> sequence_type_mapping_ptr;
 
@@ -130,6 +160,10 @@ public:
   {}
   virtual std::string get_cpp_parameter_type() override { return "const std::map<" + _key_type->get_cpp_return_type() + ", " + _value_type->get_cpp_return_type() + ">&"; }
   virtual std::string get_cpp_return_type() override { return "std::map<" + _key_type->get_cpp_return_type() + ", " + _value_type->get_cpp_return_type() + ">"; }
+  virtual bool get_pack_via_variant() const override
+  {
+    return type_mapping::get_pack_via_variant() || _key_type->get_pack_via_variant() || _value_type->get_pack_via_variant();
+  }
 };
 typedef std::shared_ptr<dictionary_type_mapping> dictionary_type_mapping_ptr;
 
@@ -156,6 +190,7 @@ struct method_description
   bool is_const;
   bts::api::method_prerequisites prerequisites; // actually, a bitmask of method_prerequisites
   std::vector<std::string> aliases;
+  uint32_t binary_method_id; // identifies the method in the binary rpc protocol
 };
 typedef std::list<method_description> method_description_list;
 
@@ -169,6 +204,7 @@ private:
 
   method_description_list _methods;
   std::set<std::string> _registered_method_names; // used for duplicate checking
+  std::map<uint32_t, std::string> _binary_method_ids; // used for collision checking
   std::set<std::string> _include_files;
 public:
   api_generator(const std::string& classname); 
@@ -178,12 +214,15 @@ public:
   void generate_rpc_client_files(const fc::path& rpc_client_output_dir, const std::string& generated_filename_suffix);
   void generate_rpc_server_files(const fc::path& rpc_server_output_dir, const std::string& generated_filename_suffix);
   void generate_client_files(const fc::path& client_output_dir, const std::string& generated_filename_suffix);
+  void generate_binary_rpc_client_files(const fc::path& rpc_client_output_dir, const std::string& generated_filename_suffix);
 private:
   void write_includes_to_stream(std::ostream& stream);
-  void generate_prerequisite_checks_to_stream(const method_description& method, std::ostream& stream);
+  void generate_prerequisite_checks_to_stream(const method_description& method, const std::string& authentication_check, std::ostream& stream);
   void generate_positional_server_implementation_to_stream(const method_description& method, const std::string& server_classname, std::ostream& stream);
   void generate_named_server_implementation_to_stream(const method_description& method, const std::string& server_classname, std::ostream& stream);
+  void generate_binary_server_implementation_to_stream(const method_description& method, const std::string& server_classname, std::ostream& stream);
   void generate_server_call_to_client_to_stream(const method_description& method, std::ostream& stream);
+  static uint32_t compute_binary_method_id(const std::string& method_name);
   std::string generate_detailed_description_for_method(const method_description& method);
   void write_generated_file_header(std::ostream& stream);
   std::string create_logging_statement_for_method(const method_description& method);
@@ -330,6 +369,9 @@ void api_generator::load_type_map(const fc::variants& json_type_map)
     if (json_type.contains("obscure_in_log_files") &&
         json_type["obscure_in_log_files"].as_bool())
       mapping->set_obscure_in_log_files();
+    if (json_type.contains("pack_via_variant") &&
+        json_type["pack_via_variant"].as_bool())
+      mapping->set_pack_via_variant();
 
     FC_ASSERT(_type_map.find(json_type_name) == _type_map.end(), 
               "Error, type ${type_name} is already registered", ("type_name", json_type_name));
@@ -421,12 +463,31 @@ void api_generator::load_method_descriptions(const fc::variants& method_descript
       if (json_method_description.contains("detailed_description"))
         method.detailed_description = json_method_description["detailed_description"].as_string();
 
+      method.binary_method_id = compute_binary_method_id(method_name);
+      auto id_iter = _binary_method_ids.find(method.binary_method_id);
+      FC_ASSERT(id_iter == _binary_method_ids.end(), 
+                "Error: binary method id of ${name} collides with ${other}, rename one of them", 
+                ("name", method_name)("other", id_iter->second));
+      _binary_method_ids[method.binary_method_id] = method_name;
+
       _methods.push_back(method);
     }
     FC_RETHROW_EXCEPTIONS(warn, "error encountered parsing method description for method \"${method_name}\"", ("method_name", method_name));
   }
 }
 
+// FNV-1a hash of the method name, so ids stay the same as methods are added and removed.  0 is reserved for login
+uint32_t api_generator::compute_binary_method_id(const std::string& method_name)
+{
+  uint32_t id = 2166136261u;
+  for (char c : method_name)
+  {
+    id ^= (uint8_t)c;
+    id *= 16777619u;
+  }
+  return id == 0 ? 1 : id;
+}
+
 void api_generator::load_api_description(const fc::path& api_description_filename, bool load_types)
 {
   try 
@@ -625,7 +686,7 @@ void api_generator::generate_rpc_client_files(const fc::path& rpc_client_output_
   cpp_file << "} } // end namespace bts::rpc_stubs\n";
 }
 
-void api_generator::generate_prerequisite_checks_to_stream(const method_description& method, std::ostream& stream)
+void api_generator::generate_prerequisite_checks_to_stream(const method_description& method, const std::string& authentication_check, std::ostream& stream)
 {
   if (method.prerequisites == bts::api::no_prerequisites)
     stream << "  // this method has no prerequisites\n\n";
@@ -634,18 +695,18 @@ void api_generator::generate_prerequisite_checks_to_stream(const method_descript
 
   if (method.prerequisites & bts::api::wallet_unlocked)
   {
-    stream << "  verify_json_connection_is_authenticated(json_connection);\n";
+    stream << "  " << authentication_check << "\n";
     stream << "  verify_wallet_is_open();\n";
     stream << "  verify_wallet_is_unlocked();\n";
   }
   else if (method.prerequisites & bts::api::wallet_open)
   {
-    stream << "  verify_json_connection_is_authenticated(json_connection);\n";
+    stream << "  " << authentication_check << "\n";
     stream << "  verify_wallet_is_open();\n";
   }
   else if (method.prerequisites & bts::api::json_authenticated)
   {
-    stream << "  verify_json_connection_is_authenticated(json_connection);\n";
+    stream << "  " << authentication_check << "\n";
   }
 
   if (method.prerequisites & bts::api::connected_to_network)
@@ -684,7 +745,7 @@ void api_generator::generate_positional_server_implementation_to_stream(const me
   stream << "fc::variant " << server_classname << "::" << method.name << "_positional(fc::rpc::json_connection* json_connection, const fc::variants& parameters)\n";
   stream << "{\n";
 
-  generate_prerequisite_checks_to_stream(method, stream);
+  generate_prerequisite_checks_to_stream(method, "verify_json_connection_is_authenticated(json_connection);", stream);
 
   unsigned parameter_index = 0;
   for (const parameter_description& parameter : method.parameters)
@@ -719,7 +780,7 @@ void api_generator::generate_named_server_implementation_to_stream(const method_
   stream << "fc::variant " << server_classname << "::" << method.name << "_named(fc::rpc::json_connection* json_connection, const fc::variant_object& parameters)\n";
   stream << "{\n";
 
-  generate_prerequisite_checks_to_stream(method, stream);
+  generate_prerequisite_checks_to_stream(method, "verify_json_connection_is_authenticated(json_connection);", stream);
 
   for (const parameter_description& parameter : method.parameters)
   {
@@ -747,6 +808,47 @@ void api_generator::generate_named_server_implementation_to_stream(const method_
   stream << "}\n\n";
 }
 
+void api_generator::generate_binary_server_implementation_to_stream(const method_description& method, const std::string& server_classname, std::ostream& stream)
+{
+  stream << "std::vector<char> " << server_classname << "::" << method.name << "_binary(bool connection_is_authenticated, const std::vector<char>& parameters)\n";
+  stream << "{\n";
+
+  generate_prerequisite_checks_to_stream(method, "verify_binary_connection_is_authenticated(connection_is_authenticated);", stream);
+
+  // every parameter is sent, the client fills in the default values
+  stream << "  fc::datastream<const char*> parameter_stream(parameters.data(), parameters.size());\n";
+  for (const parameter_description& parameter : method.parameters)
+  {
+    if (parameter.type->get_pack_via_variant())
+    {
+      stream << "  fc::variant " << parameter.name << "_variant;\n";
+      stream << "  fc::raw::unpack(parameter_stream, " << parameter.name << "_variant);\n";
+      stream << "  " << parameter.type->get_cpp_return_type() << " " << parameter.name << 
+                " = " << parameter.type->convert_binary_type_to_object_of_type(parameter.name + "_variant") << ";\n";
+    }
+    else
+    {
+      stream << "  " << parameter.type->get_cpp_return_type() << " " << parameter.name << ";\n";
+      stream << "  fc::raw::unpack(parameter_stream, " << parameter.name << ");\n";
+    }
+  }
+
+  stream << "\n";
+  stream << "  ";
+  if (!std::dynamic_pointer_cast<void_type_mapping>(method.return_type))
+    stream << method.return_type->get_cpp_return_type() << " result = ";
+  std::list<std::string> args;
+  for (const parameter_description& parameter : method.parameters)
+    args.push_back(parameter.name);
+  stream << "get_client()->" << method.name << "(" << boost::join(args, ", ") << ");\n";
+
+  if (std::dynamic_pointer_cast<void_type_mapping>(method.return_type))
+    stream << "  return std::vector<char>();\n";
+  else
+    stream << "  return fc::raw::pack(" << method.return_type->convert_object_of_type_to_binary_type("result") << ");\n";
+  stream << "}\n\n";
+}
+
 std::string api_generator::generate_detailed_description_for_method(const method_description& method)
 {
   std::ostringstream description;
@@ -800,15 +902,19 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
   header_file << "    virtual void verify_json_connection_is_authenticated(fc::rpc::json_connection* json_connection) const = 0;\n";
   header_file << "    virtual void verify_wallet_is_open() const = 0;\n";
   header_file << "    virtual void verify_wallet_is_unlocked() const = 0;\n";
-  header_file << "    virtual void verify_connected_to_network() const = 0;\n\n";
+  header_file << "    virtual void verify_connected_to_network() const = 0;\n";
+  header_file << "    virtual void verify_binary_connection_is_authenticated(bool connection_is_authenticated) const = 0;\n\n";
   header_file << "    virtual void store_method_metadata(const bts::api::method_data& method_metadata) = 0;\n";
   header_file << "    fc::variant direct_invoke_positional_method(const std::string& method_name, const fc::variants& parameters);\n";
   header_file << "    void register_" << _api_classname << "_methods(const fc::rpc::json_connection_ptr& json_connection);\n\n";
   header_file << "    void register_" << _api_classname << "_method_metadata();\n\n";
+  header_file << "    /** invokes a method of the binary rpc protocol, taking and returning fc::raw packed values */\n";
+  header_file << "    std::vector<char> invoke_binary_method(bool connection_is_authenticated, uint32_t method_id, const std::vector<char>& parameters);\n\n";
   for (const method_description& method : _methods)
   {
     header_file << "    fc::variant " << method.name << "_positional(fc::rpc::json_connection* json_connection, const fc::variants& parameters);\n";
     header_file << "    fc::variant " << method.name << "_named(fc::rpc::json_connection* json_connection, const fc::variant_object& parameters);\n";
+    header_file << "    std::vector<char> " << method.name << "_binary(bool connection_is_authenticated, const std::vector<char>& parameters);\n";
   }
 
   header_file << "  };\n\n";
@@ -820,6 +926,8 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
   server_cpp_file << "#include <bts/api/api_metadata.hpp>\n";
   server_cpp_file << "#include <bts/api/conversion_functions.hpp>\n";
   server_cpp_file << "#include <boost/bind.hpp>\n";
+  server_cpp_file << "#include <fc/io/raw.hpp>\n";
+  server_cpp_file << "#include <fc/io/raw_variant.hpp>\n";
   write_includes_to_stream(server_cpp_file);
   server_cpp_file << "\n";
   server_cpp_file << "namespace bts { namespace rpc_stubs {\n\n";
@@ -829,6 +937,7 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
   {
     generate_positional_server_implementation_to_stream(method, server_classname, server_cpp_file);
     generate_named_server_implementation_to_stream(method, server_classname, server_cpp_file);
+    generate_binary_server_implementation_to_stream(method, server_classname, server_cpp_file);
   }
 
   // Generate a function that registers all of the methods with the JSON-RPC dispatcher
@@ -908,6 +1017,20 @@ void api_generator::generate_rpc_server_files(const fc::path& rpc_server_output_
     server_cpp_file << "    return " << method.name << "_positional(nullptr, parameters);\n";
   }
   server_cpp_file << "  FC_ASSERT(false, \"shouldn't happen\");\n";
+  server_cpp_file << "}\n\n";
+
+  server_cpp_file << "std::vector<char> " << server_classname << "::invoke_binary_method(bool connection_is_authenticated, uint32_t method_id, const std::vector<char>& parameters)\n";
+  server_cpp_file << "{\n";
+  server_cpp_file << "  switch (method_id)\n";
+  server_cpp_file << "  {\n";
+  for (const method_description& method : _methods)
+  {
+    server_cpp_file << "  case " << method.binary_method_id << "u:\n";
+    server_cpp_file << "    return " << method.name << "_binary(connection_is_authenticated, parameters);\n";
+  }
+  server_cpp_file << "  default:\n";
+  server_cpp_file << "    FC_THROW_EXCEPTION(fc::invalid_arg_exception, \"unknown binary rpc method ${id}\", (\"id\", method_id));\n";
+  server_cpp_file << "  }\n";
   server_cpp_file << "}\n";
 
   server_cpp_file << "\n";
@@ -974,6 +1097,86 @@ void api_generator::generate_client_files(const fc::path& client_output_dir, con
   interceptor_cpp_file << "} } // end namespace bts::rpc_stubs\n";
 }
 
+void api_generator::generate_binary_rpc_client_files(const fc::path& rpc_client_output_dir, const std::string& generated_filename_suffix)
+{
+  std::string client_classname = _api_classname + "_binary_rpc_client";
+
+  fc::path client_header_path = rpc_client_output_dir / "include" / "bts" / "rpc_stubs";
+  fc::create_directories(client_header_path); // creates dirs for both header and cpp
+  fc::path client_header_filename = client_header_path / (client_classname + ".hpp");
+  fc::path client_cpp_filename = rpc_client_output_dir / (client_classname + ".cpp");
+  std::ofstream header_file(client_header_filename.string() + generated_filename_suffix);
+  std::ofstream cpp_file(client_cpp_filename.string() + generated_filename_suffix);
+
+  write_generated_file_header(header_file);
+  header_file << "#pragma once\n\n";
+  header_file << "#include <bts/api/" << _api_classname << ".hpp>\n\n";
+  header_file << "namespace bts { namespace rpc_stubs {\n\n";
+  header_file << "  class " << client_classname << " : public bts::api::" << _api_classname << "\n";
+  header_file << "  {\n";
+  header_file << "  public:\n";
+  header_file << "    /** sends one call of the binary rpc protocol and returns its fc::raw packed result, throwing if the call failed */\n";
+  header_file << "    virtual std::vector<char> invoke_binary_method(uint32_t method_id, const std::vector<char>& parameters) = 0;\n\n";
+  for (const method_description& method : _methods)
+    header_file << "    " << generate_signature_for_method(method, "", true) << " override;\n";
+  header_file << "  };\n\n";
+  header_file << "} } // end namespace bts::rpc_stubs\n";
+
+  write_generated_file_header(cpp_file);
+  cpp_file << "#define DEFAULT_LOGGER \"rpc\"\n";
+  cpp_file << "#include <bts/rpc_stubs/" << client_classname << ".hpp>\n";
+  cpp_file << "#include <bts/api/conversion_functions.hpp>\n";
+  cpp_file << "#include <fc/io/raw.hpp>\n";
+  cpp_file << "#include <fc/io/raw_variant.hpp>\n";
+  write_includes_to_stream(cpp_file);
+  cpp_file << "\n";
+  cpp_file << "namespace bts { namespace rpc_stubs {\n\n";
+
+  for (const method_description& method : _methods)
+  {
+    cpp_file << generate_signature_for_method(method, client_classname, false) << "\n";
+    cpp_file << "{\n";
+
+    std::list<std::string> packed_parameters;
+    for (const parameter_description& parameter : method.parameters)
+    {
+      if (parameter.type->get_pack_via_variant())
+      {
+        cpp_file << "  const fc::variant " << parameter.name << "_variant = " << parameter.type->convert_object_of_type_to_binary_type(parameter.name) << ";\n";
+        packed_parameters.push_back(parameter.name + "_variant");
+      }
+      else
+        packed_parameters.push_back(parameter.name);
+    }
+
+    cpp_file << "  std::vector<char> parameters;\n";
+    if (!packed_parameters.empty())
+    {
+      cpp_file << "  fc::datastream<size_t> size_stream;\n";
+      for (const std::string& packed_parameter : packed_parameters)
+        cpp_file << "  fc::raw::pack(size_stream, " << packed_parameter << ");\n";
+      cpp_file << "  parameters.resize(size_stream.tellp());\n";
+      cpp_file << "  fc::datastream<char*> parameter_stream(parameters.data(), parameters.size());\n";
+      for (const std::string& packed_parameter : packed_parameters)
+        cpp_file << "  fc::raw::pack(parameter_stream, " << packed_parameter << ");\n";
+    }
+
+    cpp_file << "  ";
+    if (!std::dynamic_pointer_cast<void_type_mapping>(method.return_type))
+      cpp_file << "std::vector<char> result = ";
+    cpp_file << "invoke_binary_method(" << method.binary_method_id << "u, parameters); // " << method.name << "\n";
+
+    if (!std::dynamic_pointer_cast<void_type_mapping>(method.return_type))
+    {
+      std::string binary_result = "fc::raw::unpack<" + method.return_type->get_binary_type() + ">(result)";
+      cpp_file << "  return " << method.return_type->convert_binary_type_to_object_of_type(binary_result) << ";\n";
+    }
+    cpp_file << "}\n";
+  }
+  cpp_file << "\n";
+  cpp_file << "} } // end namespace bts::rpc_stubs\n";
+}
+
 std::string api_generator::create_logging_statement_for_method(const method_description& method)
 {
   std::ostringstream result;
@@ -1090,6 +1293,7 @@ int main(int argc, char*argv[])
       generator.generate_rpc_client_files(option_variables["rpc-stub-output-dir"].as<std::string>(), option_variables["generated-file-suffix"].as<std::string>());
       generator.generate_rpc_server_files(option_variables["rpc-stub-output-dir"].as<std::string>(), option_variables["generated-file-suffix"].as<std::string>());
       generator.generate_client_files(option_variables["rpc-stub-output-dir"].as<std::string>(), option_variables["generated-file-suffix"].as<std::string>());
+      generator.generate_binary_rpc_client_files(option_variables["rpc-stub-output-dir"].as<std::string>(), option_variables["generated-file-suffix"].as<std::string>());
     }
   }
   catch (const fc::exception& e)
@@ -7,11 +7,13 @@
 #include <bts/blockchain/genesis_json.hpp>
 #include <bts/blockchain/market_records.hpp>
 #include <bts/blockchain/operation_factory.hpp>
+#include <bts/blockchain/signature_cache.hpp>
 #include <bts/blockchain/time.hpp>
 
 #include <bts/db/cached_level_map.hpp>
 #include <bts/db/level_map.hpp>
 
+#include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
 #include <fc/io/raw_variant.hpp>
@@ -24,6 +26,8 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <set>
 
 // the definition of detail::chain_database_impl is moved to a separate file so it can be shared by the market_engine(s)
 #include <bts/blockchain/chain_database_impl.hpp>
@@ -77,28 +81,73 @@ namespace bts { namespace blockchain {
                  ("num_pending_transaction_considered", num_pending_transaction_considered));
       }
 
+/* The tables stored under index/, each with its directory name, which is also its key prefix in unified storage */
+#define CHAIN_DB_INDEX_TABLES ((_property_db)("property_db"))((_market_transactions_db)("market_transactions_db")) \
+                              ((_fork_number_db)("fork_number_db"))((_fork_db)("fork_db"))((_slate_db)("slate_db")) \
+                              ((_undo_state_db)("undo_ring_db"))((_block_id_to_block_record_db)("block_id_to_block_record_db")) \
+                              ((_id_to_transaction_record_db)("id_to_transaction_record_db")) \
+                              ((_pending_transaction_db)("pending_transaction_db"))((_asset_db)("asset_db")) \
+                              ((_balance_db)("balance_db"))((_burn_db)("burn_db"))((_account_db)("account_db")) \
+                              ((_address_to_account_db)("address_to_account_db"))((_account_index_db)("account_index_db")) \
+                              ((_symbol_index_db)("symbol_index_db"))((_delegate_vote_index_db)("delegate_vote_index_db")) \
+                              ((_slot_record_db)("slot_record_db"))((_delegate_slot_record_db)("delegate_slot_record_db")) \
+                              ((_ask_db)("ask_db"))((_bid_db)("bid_db"))((_short_db)("short_db"))((_collateral_db)("collateral_db")) \
+                              ((_feed_db)("feed_db"))((_market_status_db)("market_status_db"))((_market_history_db)("market_history_db"))
+
       void chain_database_impl::open_database( const fc::path& data_dir )
       { try {
           bool rebuild_index = false;
 
           if( !fc::exists(data_dir / "index" ) )
           {
+              assert_can_rebuild_index( data_dir );
               ilog("Rebuilding database index...");
               fc::create_directories( data_dir / "index" );
               rebuild_index = true;
           }
 
-          _property_db.open( data_dir / "index/property_db" );
+          const bool unified_index_exists = fc::exists( data_dir / "index/unified_db" );
+          if( !rebuild_index && unified_index_exists != _unified_index_storage )
+          {
+              assert_can_rebuild_index( data_dir );
+              wlog( "index storage layout changed, rebuilding index" );
+              fc::remove_all( data_dir / "index" );
+              fc::create_directories( data_dir / "index" );
+              rebuild_index = true;
+          }
+          if( _unified_index_storage )
+          {
+              try
+              {
+                  open_unified_index( data_dir );
+              }
+              catch( const fc::exception& e )
+              {
+                  // e.g. written with an older ordering of keys, which LevelDB refuses to open
+                  wlog( "unable to open unified index, rebuilding index: ${e}", ("e",e.to_detail_string()) );
+                  assert_can_rebuild_index( data_dir );
+                  fc::remove_all( data_dir / "index" );
+                  fc::create_directories( data_dir / "index" );
+                  open_unified_index( data_dir );
+                  rebuild_index = true;
+              }
+          }
+
+          open_index_table( _property_db, data_dir, "property_db" );
           auto database_version = _property_db.fetch_optional( chain_property_enum::database_version );
           if( !database_version || database_version->as_int64() < BTS_BLOCKCHAIN_DATABASE_VERSION )
           {
               if ( !rebuild_index )
               {
+                assert_can_rebuild_index( data_dir );
                 wlog( "old database version, upgrade and re-sync" );
                 _property_db.close();
+                _index_db.close();
                 fc::remove_all( data_dir / "index" );
                 fc::create_directories( data_dir / "index" );
-                _property_db.open( data_dir / "index/property_db" );
+                if( _unified_index_storage )
+                    open_unified_index( data_dir );
+                open_index_table( _property_db, data_dir, "property_db" );
                 rebuild_index = true;
               }
               self->set_property( chain_property_enum::database_version, BTS_BLOCKCHAIN_DATABASE_VERSION );
@@ -107,51 +156,108 @@ namespace bts { namespace blockchain {
           {
              FC_CAPTURE_AND_THROW( new_database_version, (database_version)(BTS_BLOCKCHAIN_DATABASE_VERSION) );
           }
-          _market_transactions_db.open( data_dir / "index/market_transactions_db" );
-          _fork_number_db.open( data_dir / "index/fork_number_db" );
-          _fork_db.open( data_dir / "index/fork_db" );
-          _slate_db.open( data_dir / "index/slate_db" );
+          open_index_table( _market_transactions_db, data_dir, "market_transactions_db" );
+          open_index_table( _fork_number_db, data_dir, "fork_number_db" );
+          open_index_table( _fork_db, data_dir, "fork_db" );
+          open_index_table( _slate_db, data_dir, "slate_db" );
 #if 0
-          _proposal_db.open( data_dir / "index/proposal_db" );
-          _proposal_vote_db.open( data_dir / "index/proposal_vote_db" );
+          open_index_table( _proposal_db, data_dir, "proposal_db" );
+          open_index_table( _proposal_vote_db, data_dir, "proposal_vote_db" );
 #endif
 
-          _undo_state_db.open( data_dir / "index/undo_state_db" );
+          open_index_table( _undo_state_db, data_dir, "undo_ring_db" );
+
+          open_index_table( _block_id_to_block_record_db, data_dir, "block_id_to_block_record_db" );
+          _block_num_to_id_db.open( data_dir / "raw_chain/block_num_to_id_db", table_options( "block_num_to_id_db" ) );
+          _block_id_to_block_data_db.open( data_dir / "raw_chain/block_id_to_block_data_db", table_options( "block_id_to_block_data_db" ) );
+          open_index_table( _id_to_transaction_record_db, data_dir, "id_to_transaction_record_db" );
 
-          _block_id_to_block_record_db.open( data_dir / "index/block_id_to_block_record_db" );
-          _block_num_to_id_db.open( data_dir / "raw_chain/block_num_to_id_db" );
-          _block_id_to_block_data_db.open( data_dir / "raw_chain/block_id_to_block_data_db" );
-          _id_to_transaction_record_db.open( data_dir / "index/id_to_transaction_record_db" );
+          if( fc::exists( data_dir / "index/undo_state_db" ) )
+             migrate_undo_state_db( data_dir / "index/undo_state_db" );
 
           for( auto itr = _id_to_transaction_record_db.begin(); itr.valid(); ++itr )
              _known_transactions.insert( itr.key() );
 
-          _pending_transaction_db.open( data_dir / "index/pending_transaction_db" );
+          open_index_table( _pending_transaction_db, data_dir, "pending_transaction_db" );
 
-          _asset_db.open( data_dir / "index/asset_db" );
-          _balance_db.open( data_dir / "index/balance_db" );
-          _burn_db.open( data_dir / "index/burn_db" );
-          _account_db.open( data_dir / "index/account_db" );
-          _address_to_account_db.open( data_dir / "index/address_to_account_db" );
+          open_index_table( _asset_db, data_dir, "asset_db" );
+          open_index_table( _balance_db, data_dir, "balance_db" );
+          open_index_table( _burn_db, data_dir, "burn_db" );
+          open_index_table( _account_db, data_dir, "account_db" );
+          open_index_table( _address_to_account_db, data_dir, "address_to_account_db" );
 
-          _account_index_db.open( data_dir / "index/account_index_db" );
-          _symbol_index_db.open( data_dir / "index/symbol_index_db" );
-          _delegate_vote_index_db.open( data_dir / "index/delegate_vote_index_db" );
+          open_index_table( _account_index_db, data_dir, "account_index_db" );
+          open_index_table( _symbol_index_db, data_dir, "symbol_index_db" );
+          open_index_table( _delegate_vote_index_db, data_dir, "delegate_vote_index_db" );
 
-          _slot_record_db.open( data_dir / "index/slot_record_db" );
+          open_index_table( _slot_record_db, data_dir, "slot_record_db" );
+          open_index_table( _delegate_slot_record_db, data_dir, "delegate_slot_record_db" );
+          if( !_delegate_slot_record_db.begin().valid() && _slot_record_db.begin().valid() )
+             index_slot_records();
 
-          _ask_db.open( data_dir / "index/ask_db" );
-          _bid_db.open( data_dir / "index/bid_db" );
-          _short_db.open( data_dir / "index/short_db" );
-          _collateral_db.open( data_dir / "index/collateral_db" );
-          _feed_db.open( data_dir / "index/feed_db" );
+          open_index_table( _ask_db, data_dir, "ask_db" );
+          open_index_table( _bid_db, data_dir, "bid_db" );
+          open_index_table( _short_db, data_dir, "short_db" );
+          open_index_table( _collateral_db, data_dir, "collateral_db" );
+          open_index_table( _feed_db, data_dir, "feed_db" );
 
-          _market_status_db.open( data_dir / "index/market_status_db" );
-          _market_history_db.open( data_dir / "index/market_history_db" );
+          open_index_table( _market_status_db, data_dir, "market_status_db" );
+          open_index_table( _market_history_db, data_dir, "market_history_db" );
 
           _pending_trx_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
       } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+      /**
+       *  Every table under index/ is stored in one LevelDB instance, which needs to know all of the
+       *  tables it will contain before it is opened.
+       */
+      void chain_database_impl::assert_can_rebuild_index( const fc::path& data_dir )const
+      {
+          const auto snapshot_base = chain_database::get_snapshot_base( data_dir );
+          if( snapshot_base.valid() )
+             FC_THROW_EXCEPTION( snapshot_index_rebuild,
+                                 "This chain was bootstrapped from a snapshot at block ${num}, so its index cannot be rebuilt "
+                                 "from genesis; import the snapshot again into an empty data directory or resync the blockchain",
+                                 ("num",snapshot_base->block_num)("data_dir",data_dir) );
+      }
+
+      void chain_database_impl::open_unified_index( const fc::path& data_dir )
+      { try {
+#define REGISTER_INDEX_TABLE(r, data, elem) \
+          _index_db.register_table( BOOST_PP_SEQ_ELEM(1, elem), BOOST_PP_SEQ_ELEM(0, elem).key_comparator() );
+          BOOST_PP_SEQ_FOR_EACH(REGISTER_INDEX_TABLE, _, CHAIN_DB_INDEX_TABLES)
+#undef REGISTER_INDEX_TABLE
+          auto options = table_options( "unified_db" );
+          if( _index_cache_size )
+             options.cache_size = _index_cache_size;
+          _index_db.open( data_dir / "index/unified_db", options );
+      } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
+      /**
+       *  Tables that are mostly read by point lookups, many of them for keys that are absent, get a
+       *  bloom filter unless they have been configured explicitly.
+       */
+      bts::db::level_options chain_database_impl::table_options( const std::string& name )const
+      {
+          static const std::set<std::string> point_lookup_tables = { "balance_db",
+                                                                     "id_to_transaction_record_db",
+                                                                     "block_id_to_block_record_db",
+                                                                     "block_id_to_block_data_db",
+                                                                     "unified_db" };
+
+          auto itr = _database_options.find( name );
+          if( itr != _database_options.end() )
+             return itr->second;
+
+          bts::db::level_options options;
+          itr = _database_options.find( "default" );
+          if( itr != _database_options.end() )
+             options = itr->second;
+          if( options.bloom_filter_bits == 0 && point_lookup_tables.count( name ) )
+             options.bloom_filter_bits = BTS_BLOCKCHAIN_DEFAULT_BLOOM_FILTER_BITS;
+          return options;
+      }
+
       digest_type chain_database_impl::initialize_genesis( const optional<path>& genesis_file, bool chain_id_only )
       { try {
          digest_type chain_id = self->chain_id();
@@ -171,22 +277,40 @@ namespace bts { namespace blockchain {
            std::cout << "Initializing genesis state from "<< genesis_file->generic_string() << "\n";
            FC_ASSERT( fc::exists( *genesis_file ), "Genesis file '${file}' was not found.", ("file", *genesis_file) );
 
+           optional<digest_type> image_hash;
            if( genesis_file->extension() == ".json" )
            {
               config = fc::json::from_file(*genesis_file).as<genesis_block_config>();
            }
            else if( genesis_file->extension() == ".dat" )
            {
-              fc::ifstream in( *genesis_file );
-              fc::raw::unpack( in, config );
+              // a binary image as written by bts_genesis_to_bin --binary-out, which hashes to the chain id as it is
+              const uint64_t file_size = fc::file_size( *genesis_file );
+              FC_ASSERT( file_size > 0 && file_size <= std::numeric_limits<size_t>::max() );
+              fc::file_mapping fm( genesis_file->generic_string().c_str(), fc::read_only );
+              fc::mapped_region mr( fm, fc::read_only, 0, size_t( file_size ) );
+              const char* data = (const char*)mr.get_address();
+              fc::datastream<const char*> ds( data, mr.get_size() );
+              fc::raw::unpack( ds, config );
+              // the whole image is hashed, so trailing bytes would change the chain id without changing the state
+              FC_ASSERT( ds.remaining() == 0, "Genesis image has trailing data",
+                         ("file_size",file_size)("unpacked_size",file_size - ds.remaining()) );
+              image_hash = fc::sha256::hash( data, mr.get_size() );
            }
            else
            {
               FC_ASSERT( !"Invalid genesis format", " '${format}'", ("format",genesis_file->extension() ) );
            }
-           fc::sha256::encoder enc;
-           fc::raw::pack( enc, config );
-           chain_id = enc.result();
+           if( image_hash.valid() )
+           {
+              chain_id = *image_hash;
+           }
+           else
+           {
+              fc::sha256::encoder enc;
+              fc::raw::pack( enc, config );
+              chain_id = enc.result();
+           }
          }
          else
          {
@@ -227,6 +351,42 @@ namespace bts { namespace blockchain {
                     "genesis.json does not contain enough initial delegates",
                     ("required",BTS_BLOCKCHAIN_NUM_DELEGATES)("provided",delegate_config.size()) );
 
+         // hold the account tables' writes in memory so each is flushed as one sorted batch at the end,
+         // and make sure they go back to flushing on every store even if initializing genesis fails
+         struct account_tables_flush_guard
+         {
+            chain_database_impl& _db;
+            bool                 _restored = false;
+
+            account_tables_flush_guard( chain_database_impl& db ) : _db( db ) { set_flush_on_store( false ); }
+            ~account_tables_flush_guard()
+            {
+               if( _restored ) return;
+               try
+               {
+                  set_flush_on_store( true );
+               }
+               catch( const fc::exception& e )
+               {
+                  elog( "Error restoring account table flushing: ${e}", ("e",e.to_detail_string()) );
+               }
+            }
+
+            void restore()
+            {
+               set_flush_on_store( true );
+               _restored = true;
+            }
+
+            void set_flush_on_store( bool should_flush )
+            {
+               _db._account_db.set_flush_on_store( should_flush );
+               _db._address_to_account_db.set_flush_on_store( should_flush );
+               _db._account_index_db.set_flush_on_store( should_flush );
+               _db._delegate_vote_index_db.set_flush_on_store( should_flush );
+            }
+         } account_tables_flush( *this );
+
          account_record god; god.id = 0; god.name = "god";
          self->store_account_record( god );
 
@@ -252,11 +412,11 @@ namespace bts { namespace blockchain {
             ++account_id;
          }
 
-         int64_t n = 0;
+         // merged here rather than read back from the database, and written in key order once they are all known
+         std::map<balance_id_type, balance_record> genesis_balances;
+
          for( const auto& item : config.balances )
          {
-            ++n;
-
             fc::uint128 initial( int64_t(item.second/1000) );
             initial *= fc::uint128(int64_t(BTS_BLOCKCHAIN_INITIAL_SHARES));
             initial /= total_unscaled;
@@ -268,12 +428,12 @@ namespace bts { namespace blockchain {
                                           );
 
             /* In case of redundant balances */
-            auto cur = self->get_balance_record( initial_balance.id() );
-            if( cur.valid() ) initial_balance.balance += cur->balance;
+            const auto cur = genesis_balances.find( initial_balance.id() );
+            if( cur != genesis_balances.end() ) initial_balance.balance += cur->second.balance;
             const asset bal( initial_balance.balance, initial_balance.condition.asset_id );
             initial_balance.snapshot_info = snapshot_record( string( addr ), bal.amount );
             initial_balance.last_update = config.timestamp;
-            self->store_balance_record( initial_balance );
+            genesis_balances[ initial_balance.id() ] = initial_balance;
          }
 
          for( const auto& item : config.bts_sharedrop )
@@ -303,23 +463,36 @@ namespace bts { namespace blockchain {
             balance_rec.balance = data.original_balance;
 
             /* In case of redundant balances */
-            auto cur = self->get_balance_record( balance_rec.id() );
-            if( cur.valid() ) balance_rec.balance += cur->balance;
+            const auto cur = genesis_balances.find( balance_rec.id() );
+            if( cur != genesis_balances.end() ) balance_rec.balance += cur->second.balance;
             balance_rec.last_update = config.timestamp;
             const asset bal( balance_rec.balance, balance_rec.condition.asset_id );
             balance_rec.snapshot_info = snapshot_record( item.raw_address, bal.amount );
-            self->store_balance_record( balance_rec );
+            genesis_balances[ balance_rec.id() ] = balance_rec;
          }
 
          asset total;
-         auto itr = _balance_db.begin();
-         while( itr.valid() )
          {
-            const asset ind( itr.value().balance, itr.value().condition.asset_id );
-            FC_ASSERT( ind.amount >= 0, "", ("record",itr.value()) );
-            total += ind;
-            ++itr;
+            const uint32_t records_per_batch = 10000;
+            uint32_t records_in_batch = 0;
+            auto batch = _balance_db.create_batch();
+            for( const auto& item : genesis_balances )
+            {
+               const asset ind( item.second.balance, item.second.condition.asset_id );
+               FC_ASSERT( ind.amount >= 0, "", ("record",item.second) );
+               total += ind;
+
+               batch.store( item.first, item.second );
+               if( ++records_in_batch >= records_per_batch )
+               {
+                  batch.commit();
+                  records_in_batch = 0;
+               }
+            }
+            batch.commit();
          }
+         _balance_record_cache.clear();
+         genesis_balances.clear();
 
          int32_t asset_id = 0;
          asset_record base_asset;
@@ -356,6 +529,8 @@ namespace bts { namespace blockchain {
             self->store_asset_record( rec );
          }
 
+         account_tables_flush.restore();
+
          block_fork_data gen_fork;
          gen_fork.is_valid = true;
          gen_fork.is_included = true;
@@ -483,6 +658,140 @@ namespace bts { namespace blockchain {
        *  in the fork which contains the new block, in all of the above cases where the new block is linked;
        *  otherwise, returns the block id and fork data of the new block
        */
+      /**
+       *  Tables imported from a snapshot or state dump don't include fork tracking data, so make the
+       *  head block look like any other block we've linked and applied; otherwise the next block
+       *  we receive would be treated as belonging to an unlinked fork.
+       */
+      void chain_database_impl::index_imported_head_block( uint32_t block_num, const block_id_type& block_id )
+      { try {
+          // the imported tables were written behind the record caches' back
+          clear_record_caches();
+          _fork_number_db.store( block_num, vector<block_id_type>{ block_id } );
+          block_fork_data head_fork_data;
+          head_fork_data.is_linked = true;
+          head_fork_data.is_included = true;
+          head_fork_data.is_known = true;
+          head_fork_data.is_valid = true;
+          _fork_db.store( block_id, head_fork_data );
+          if( _index_db.is_open() )
+             self->set_property( chain_property_enum::head_block_id, fc::variant( block_id ) );
+      } FC_CAPTURE_AND_RETHROW( (block_num)(block_id) ) }
+
+      /**
+       *  With unified index storage the head block is written in the same batch as the block's changes,
+       *  but block_num_to_id_db lives in raw_chain and is written after that batch, so a crash in between
+       *  leaves it one block ahead of or behind the index.  Bring it back in line with the index.
+       *
+       *  @return false if the index cannot be trusted and must be rebuilt
+       */
+      bool chain_database_impl::repair_block_num_index()
+      { try {
+          const auto head = _property_db.fetch_optional( chain_property_enum::head_block_id );
+          if( !head.valid() )
+             return true;
+
+          const block_id_type head_id = head->as<block_id_type>();
+          uint32_t last_block_num = 0;
+          block_id_type last_block_id;
+
+          /* a zero head is either the genesis state or a crash in the middle of applying a fork block */
+          if( head_id == block_id_type() )
+             return !_block_num_to_id_db.last( last_block_num, last_block_id );
+
+          const auto head_record = _block_id_to_block_record_db.fetch_optional( head_id );
+          if( !head_record.valid() )
+             return false;
+          const uint32_t head_num = head_record->block_num;
+
+          while( _block_num_to_id_db.last( last_block_num, last_block_id ) && last_block_num > head_num )
+          {
+             wlog( "removing block ${n} from block_num_to_id_db, which the index never committed", ("n",last_block_num) );
+             _block_num_to_id_db.remove( last_block_num );
+          }
+
+          const auto stored_id = _block_num_to_id_db.fetch_optional( head_num );
+          if( !stored_id.valid() || *stored_id != head_id )
+          {
+             wlog( "restoring block ${n} in block_num_to_id_db from the index", ("n",head_num) );
+             _block_num_to_id_db.store( head_num, head_id );
+          }
+          return true;
+      } FC_CAPTURE_AND_RETHROW() }
+
+      void chain_database_impl::update_block_template( const time_point_sec& timestamp, const fc::microseconds& time_limit )
+      { try {
+         auto start_time = time_point::now();
+
+         if( !_block_template.valid() || _block_template->head_block_id != _head_block_id
+             || _block_template->block.timestamp != timestamp )
+         {
+            block_template next;
+            next.head_block_id = _head_block_id;
+            next.state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+            if( next.state->get_head_block_num() >= BTS_V0_4_9_FORK_BLOCK_NUM )
+               execute_markets( timestamp, next.state );
+
+            next.block.previous  = _head_block_header.block_num ? _head_block_id : block_id_type();
+            next.block.block_num = _head_block_header.block_num + 1;
+            next.block.timestamp = timestamp;
+            _block_template = std::move( next );
+         }
+
+         block_template& tmpl = *_block_template;
+         if( !tmpl.full )
+         {
+            // TODO: Sort pending transactions by highest fee
+            for( const auto& item : self->get_pending_transactions() )
+            {
+               if( !tmpl.considered_transactions.insert( item->trx.id() ).second )
+                  continue;
+
+               auto trx_size = item->trx.data_size();
+               if( tmpl.block_size + trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+               {
+                  tmpl.full = true;
+                  break;
+               }
+
+               /* Make modifications to temporary state */
+               auto pending_trx_state = std::make_shared<pending_chain_state>( tmpl.state );
+               auto trx_eval_state = std::make_shared<transaction_evaluation_state>( pending_trx_state.get(), _chain_id );
+               trx_eval_state->_cache_recovered_keys = true;
+
+               try
+               {
+                  trx_eval_state->evaluate( item->trx );
+                  /* Apply temporary state to block state */
+                  pending_trx_state->apply_changes();
+                  tmpl.block.user_transactions.push_back( item->trx );
+                  tmpl.block_size += trx_size;
+               }
+               catch ( const fc::canceled_exception& )
+               {
+                  throw;
+               }
+               catch( const fc::exception& e )
+               {
+                  wlog( "Pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
+                        ("trx",fc::json::to_pretty_string(item->trx))("e",e.to_detail_string()) );
+               }
+
+               /* Limit the time we spend evaluating transactions */
+               if( time_point::now() - start_time > time_limit )
+                  break;
+            }
+         }
+
+         tmpl.block.transaction_digest = digest_block( tmpl.block ).calculate_transaction_digest();
+      } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
+
+      void chain_database_impl::clear_record_caches()
+      {
+          _asset_record_cache.clear();
+          _balance_record_cache.clear();
+      }
+
       std::pair<block_id_type, block_fork_data> chain_database_impl::store_and_index( const block_id_type& block_id,
                                                                                       const full_block& block_data )
       { try {
@@ -663,31 +972,97 @@ namespace bts { namespace blockchain {
             pending_state->store_asset_record( *base_asset_record );
       } FC_CAPTURE_AND_RETHROW( (block_id)(block_signee) ) }
 
-      void chain_database_impl::save_undo_state( const block_id_type& block_id,
-                                                 const pending_chain_state_ptr& pending_state )
+      pending_chain_state_ptr chain_database_impl::build_undo_state( const pending_chain_state_ptr& pending_state )
       { try {
            uint32_t last_checkpoint_block_num = 0;
            if( !CHECKPOINT_BLOCKS.empty() )
                   last_checkpoint_block_num = (--(CHECKPOINT_BLOCKS.end()))->first;
            if( _head_block_header.block_num < last_checkpoint_block_num )
-                 return;  // don't bother saving it...
+                 return nullptr;  // don't bother saving it...
 
            pending_chain_state_ptr undo_state = std::make_shared<pending_chain_state>( nullptr );
            pending_state->get_undo_state( undo_state );
-           _undo_state_db.store( block_id, *undo_state );
-           auto block_num = self->get_head_block_num();
-           if( int32_t(block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY) > 0 )
+           return undo_state;
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::store_undo_state( uint32_t block_num, const block_id_type& block_id,
+                                                  const pending_chain_state& undo_state )
+      {
+           undo_state_record record;
+           record.block_id = block_id;
+           record.packed_state = fc::raw::pack( undo_state );
+           record.uncompressed_size = record.packed_state.size();
+           if( bts::utilities::compression_available() )
            {
-              auto old_id = self->get_block_id( block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY );
-              try {
-                 _undo_state_db.remove( old_id );
+              auto compressed_state = bts::utilities::zlib_compress( record.packed_state.data(), record.packed_state.size() );
+              if( compressed_state.size() < record.packed_state.size() )
+              {
+                 record.packed_state = std::move( compressed_state );
+                 record.compressed = true;
               }
-              catch( const fc::key_not_found_exception& )
+           }
+
+           // overwrites the undo state of block_num - BTS_BLOCKCHAIN_MAX_UNDO_HISTORY, which can no longer be popped
+           _undo_state_db.store( block_num % BTS_BLOCKCHAIN_MAX_UNDO_HISTORY, record );
+      }
+
+      pending_chain_state chain_database_impl::load_undo_state( uint32_t block_num, const block_id_type& block_id )
+      { try {
+           const undo_state_record record = _undo_state_db.fetch( block_num % BTS_BLOCKCHAIN_MAX_UNDO_HISTORY );
+           FC_ASSERT( record.block_id == block_id, "No undo state is available for this block",
+                      ("stored_block_id",record.block_id) );
+
+           pending_chain_state undo_state( nullptr );
+           if( record.compressed )
+           {
+              const auto packed_state = bts::utilities::zlib_decompress( record.packed_state.data(), record.packed_state.size(),
+                                                                         record.uncompressed_size );
+              fc::raw::unpack( packed_state, undo_state );
+           }
+           else
+           {
+              fc::raw::unpack( record.packed_state, undo_state );
+           }
+           return undo_state;
+      } FC_CAPTURE_AND_RETHROW( (block_num)(block_id) ) }
+
+      /**
+       *  Undo states used to be keyed by block id and were never compacted beyond the removal of
+       *  expired entries.  Only the states of blocks still on the main chain can ever be popped, so
+       *  copy those into the ring and drop the old database.
+       */
+      void chain_database_impl::migrate_undo_state_db( const fc::path& old_undo_state_dir )
+      { try {
+           ilog( "Migrating undo state to ring storage" );
+           {
+              bts::db::level_map<block_id_type,pending_chain_state> old_undo_state_db;
+              old_undo_state_db.open( old_undo_state_dir );
+
+              uint32_t migrated = 0;
+              for( auto itr = old_undo_state_db.begin(); itr.valid(); ++itr )
               {
-                 // ignore this...
+                 const block_id_type block_id = itr.key();
+                 const auto block_record = _block_id_to_block_record_db.fetch_optional( block_id );
+                 if( !block_record.valid() ) continue;
+
+                 const auto main_chain_id = _block_num_to_id_db.fetch_optional( block_record->block_num );
+                 if( !main_chain_id.valid() || *main_chain_id != block_id ) continue;
+
+                 auto current = _undo_state_db.fetch_optional( block_record->block_num % BTS_BLOCKCHAIN_MAX_UNDO_HISTORY );
+                 if( current.valid() )
+                 {
+                    const auto current_record = _block_id_to_block_record_db.fetch_optional( current->block_id );
+                    if( current_record.valid() && current_record->block_num > block_record->block_num ) continue;
+                 }
+
+                 store_undo_state( block_record->block_num, block_id, itr.value() );
+                 ++migrated;
               }
+              ilog( "Migrated undo state for ${n} blocks", ("n",migrated) );
+              old_undo_state_db.close();
            }
-      } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
+           fc::remove_all( old_undo_state_dir );
+      } FC_CAPTURE_AND_RETHROW( (old_undo_state_dir) ) }
 
 
       void chain_database_impl::verify_header( const full_block& block_data, const public_key_type& block_signee )
@@ -860,12 +1235,19 @@ namespace bts { namespace blockchain {
        */
       void chain_database_impl::extend_chain( const full_block& block_data )
       { try {
+         bts::db::scoped_latency_timer extend_chain_timer( phase_latency( "total" ) );
+         clear_record_caches();
          auto block_id = block_data.id();
          block_summary summary;
          try
          {
+            const auto cached_itr = _applied_block_cache.find( block_id );
+            const bool replay_cached = cached_itr != _applied_block_cache.end();
+
             public_key_type block_signee;
-            if( CHECKPOINT_BLOCKS.size() > 0 && (--CHECKPOINT_BLOCKS.end())->first > block_data.block_num )
+            if( replay_cached )
+               block_signee = cached_itr->second.block_signee;
+            else if( CHECKPOINT_BLOCKS.size() > 0 && (--CHECKPOINT_BLOCKS.end())->first > block_data.block_num )
                //Skip signature validation
                block_signee = self->get_slot_signee( block_data.timestamp, self->get_active_delegates() ).active_key();
             else
@@ -877,44 +1259,105 @@ namespace bts { namespace blockchain {
               FC_CAPTURE_AND_THROW( failed_checkpoint_verification, (block_id)(checkpoint_itr->second) );
 
             /* Note: Secret is validated later in update_delegate_production_info() */
-            verify_header( block_data, block_signee );
+            {
+               bts::db::scoped_latency_timer timer( phase_latency( "verify_header" ) );
+               verify_header( block_data, block_signee );
+            }
 
             summary.block_data = block_data;
 
-            /* Create a pending state to track changes that would apply as we evaluate the block */
-            pending_chain_state_ptr pending_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
-            summary.applied_changes = pending_state;
+            pending_chain_state_ptr pending_state;
+            if( replay_cached )
+            {
+               /* The block id commits to the entire history before it, so the state it was evaluated
+                * against is the one we are about to apply it to; replay the changes it made last time */
+               ilog( "Replaying cached state changes of block: ${n}", ("n",block_data.block_num) );
+               pending_state = std::make_shared<pending_chain_state>( *cached_itr->second.applied_changes );
+               pending_state->set_prev_state( self->shared_from_this() );
+               summary.applied_changes = pending_state;
+            }
+            else
+            {
+               /* Create a pending state to track changes that would apply as we evaluate the block */
+               pending_state = std::make_shared<pending_chain_state>( self->shared_from_this() );
+               summary.applied_changes = pending_state;
 
-            /** Increment the blocks produced or missed for all delegates. This must be done
-             *  before applying transactions because it depends upon the current active delegate order.
-             **/
-            update_delegate_production_info( block_data, pending_state, block_signee );
+               /** Increment the blocks produced or missed for all delegates. This must be done
+                *  before applying transactions because it depends upon the current active delegate order.
+                **/
+               {
+                  bts::db::scoped_latency_timer timer( phase_latency( "update_delegate_production_info" ) );
+                  update_delegate_production_info( block_data, pending_state, block_signee );
+               }
 
-            // apply any deterministic operations such as market operations before we perturb indexes
-            //apply_deterministic_updates(pending_state);
+               // apply any deterministic operations such as market operations before we perturb indexes
+               //apply_deterministic_updates(pending_state);
 
-            pay_delegate( block_id, pending_state, block_signee );
+               {
+                  bts::db::scoped_latency_timer timer( phase_latency( "pay_delegate" ) );
+                  pay_delegate( block_id, pending_state, block_signee );
+               }
 
-            if( block_data.block_num < BTS_V0_4_9_FORK_BLOCK_NUM )
-                apply_transactions( block_data, pending_state );
+               if( block_data.block_num < BTS_V0_4_9_FORK_BLOCK_NUM )
+               {
+                   bts::db::scoped_latency_timer timer( phase_latency( "apply_transactions" ) );
+                   apply_transactions( block_data, pending_state );
+               }
 
-            execute_markets( block_data.timestamp, pending_state );
+               {
+                  bts::db::scoped_latency_timer timer( phase_latency( "execute_markets" ) );
+                  execute_markets( block_data.timestamp, pending_state );
+               }
 
-            if( block_data.block_num >= BTS_V0_4_9_FORK_BLOCK_NUM )
-                apply_transactions( block_data, pending_state );
+               if( block_data.block_num >= BTS_V0_4_9_FORK_BLOCK_NUM )
+               {
+                   bts::db::scoped_latency_timer timer( phase_latency( "apply_transactions" ) );
+                   apply_transactions( block_data, pending_state );
+               }
 
-            update_active_delegate_list( block_data, pending_state );
+               update_active_delegate_list( block_data, pending_state );
 
-            update_random_seed( block_data.previous_secret, pending_state );
+               update_random_seed( block_data.previous_secret, pending_state );
+            }
 
-            save_undo_state( block_id, pending_state );
+            /*
+             * With unified index storage, the block's changes, its undo state and the new head reach the disk
+             * together.  raw_chain is a separate database, so block_num_to_id_db is written afterwards and
+             * repaired from head_block_id by open() if a crash comes in between.
+             */
+            const bool is_fork_block = block_data.block_num == BTS_V0_4_16_FORK_BLOCK_NUM
+                                       || block_data.block_num == BTS_V0_4_17_FORK_BLOCK_NUM
+                                       || block_data.block_num == BTS_V0_4_21_FORK_BLOCK_NUM
+                                       || block_data.block_num == BTS_V0_4_24_FORK_BLOCK_NUM;
+            bts::db::shared_level_database::scoped_batch batch( _index_db.is_open() ? &_index_db : nullptr );
+
+            // the undo state reads the records as they were before this block, so it is built first...
+            pending_chain_state_ptr undo_state;
+            {
+               bts::db::scoped_latency_timer timer( phase_latency( "build_undo_state" ) );
+               undo_state = build_undo_state( pending_state );
+            }
 
             // TODO: verify that apply changes can be called any number of
             // times without changing the database other than the first
             // attempt.
-            pending_state->apply_changes();
+            {
+               bts::db::scoped_latency_timer timer( phase_latency( "apply_changes" ) );
+               pending_state->apply_changes();
+            }
+
+            // ...but only written once the block applied, since it overwrites the ring slot of an older block
+            if( undo_state )
+            {
+               bts::db::scoped_latency_timer timer( phase_latency( "store_undo_state" ) );
+               store_undo_state( block_data.block_num, block_id, *undo_state );
+            }
 
             mark_included( block_id, true );
+            /* the fork upgrades below read the committed state, so until they are written too the head is unknown */
+            if( _index_db.is_open() )
+               self->set_property( chain_property_enum::head_block_id, fc::variant( is_fork_block ? block_id_type() : block_id ) );
+            batch.commit();
 
             update_head_block( block_data );
 
@@ -922,8 +1365,13 @@ namespace bts { namespace blockchain {
 
             _block_num_to_id_db.store( block_data.block_num, block_id );
 
+            if( !replay_cached )
+               cache_applied_block( block_data, block_signee, pending_state );
+
             // self->sanity_check();
 
+            bts::db::shared_level_database::scoped_batch fork_batch( is_fork_block && _index_db.is_open() ? &_index_db : nullptr );
+
             if( block_data.block_num == BTS_V0_4_16_FORK_BLOCK_NUM )
             {
                 auto base_asset_record = self->get_asset_record( asset_id_type( 0 ) );
@@ -981,10 +1429,18 @@ namespace bts { namespace blockchain {
                     self->store_account_record( record );
                 }
             }
+
+            if( is_fork_block && _index_db.is_open() )
+            {
+                self->set_property( chain_property_enum::head_block_id, fc::variant( block_id ) );
+                fork_batch.commit();
+            }
          }
          catch ( const fc::exception& e )
          {
             wlog( "error applying block: ${e}", ("e",e.to_detail_string() ));
+            // an aborted batch reloaded the cached tables, so decoded records may be newer than the tables now
+            clear_record_caches();
             mark_invalid( block_id, e );
             throw;
          }
@@ -996,6 +1452,47 @@ namespace bts { namespace blockchain {
               fc::async([o,summary]{o->block_applied( summary );}, "call_block_applied_observer");
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block",block_data) ) }
 
+      bts::db::latency_histogram* chain_database_impl::phase_latency( const char* phase )
+      {
+         if( !bts::db::table_stats_enabled() ) return nullptr;
+         return &_extend_chain_phase_latency[ phase ];
+      }
+
+      /**
+       *  Only blocks recent enough to be involved in a fork switch are cached, which keeps the copy
+       *  of their state changes off the path of a full sync.  The blocks at which a hardfork writes
+       *  directly to the database are never cached because those writes are not in their pending state.
+       */
+      void chain_database_impl::cache_applied_block( const full_block& block_data,
+                                                     const public_key_type& block_signee,
+                                                     const pending_chain_state_ptr& applied_changes )
+      {
+         if( (now() - block_data.timestamp).to_seconds() >= BTS_BLOCKCHAIN_MAX_UNDO_HISTORY * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC )
+            return;
+
+         if( block_data.block_num == BTS_V0_4_16_FORK_BLOCK_NUM
+             || block_data.block_num == BTS_V0_4_17_FORK_BLOCK_NUM
+             || block_data.block_num == BTS_V0_4_21_FORK_BLOCK_NUM
+             || block_data.block_num == BTS_V0_4_24_FORK_BLOCK_NUM )
+            return;
+
+         applied_block_cache_entry entry;
+         entry.block_signee = block_signee;
+         /* Don't hold on to the chain database from inside itself */
+         entry.applied_changes = std::make_shared<pending_chain_state>( *applied_changes );
+         entry.applied_changes->set_prev_state( chain_interface_ptr() );
+
+         const auto block_id = block_data.id();
+         if( _applied_block_cache.emplace( block_id, std::move( entry ) ).second )
+            _applied_block_cache_order.push_back( block_id );
+
+         while( _applied_block_cache_order.size() > BTS_BLOCKCHAIN_APPLIED_BLOCK_CACHE_SIZE )
+         {
+            _applied_block_cache.erase( _applied_block_cache_order.front() );
+            _applied_block_cache_order.pop_front();
+         }
+      }
+
       /**
        * Traverse the previous links of all blocks in fork until we find one that is_included
        *
@@ -1034,6 +1531,51 @@ namespace bts { namespace blockchain {
          return history;
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",id) ) }
 
+      /** Builds the per-delegate slot index for databases created before it existed */
+      void chain_database_impl::index_slot_records()
+      { try {
+         ilog( "Indexing slot records by delegate" );
+         for( auto itr = _slot_record_db.begin(); itr.valid(); ++itr )
+         {
+            const slot_record record = itr.value();
+            _delegate_slot_record_db.store( delegate_slot_index( record.block_producer_id, record.start_time ), record );
+         }
+      } FC_CAPTURE_AND_RETHROW() }
+
+      /**
+       *  Recomputed at most once per head block by seeking to the start of the window in the slot
+       *  record database, so that polling the participation of every delegate is cheap.
+       */
+      const participation_window& chain_database_impl::get_participation_window()
+      { try {
+         if( _participation_window.head_block_id == _head_block_id )
+            return _participation_window;
+
+         participation_window window;
+         window.head_block_id = _head_block_id;
+
+         const uint32_t head_num = _head_block_header.block_num;
+         if( head_num >= BTS_BLOCKCHAIN_NUM_DELEGATES )
+            window.round_start_time = self->get_block_header( head_num - BTS_BLOCKCHAIN_NUM_DELEGATES ).timestamp;
+
+         const uint32_t window_sec = (BTS_BLOCKCHAIN_PARTICIPATION_WINDOW_SLOTS - 1) * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+         time_point_sec window_start;
+         if( _head_block_header.timestamp.sec_since_epoch() > window_sec )
+            window_start = _head_block_header.timestamp - window_sec;
+         for( auto itr = _slot_record_db.lower_bound( window_start ); itr.valid(); ++itr )
+         {
+            const slot_record record = itr.value();
+            if( record.start_time > _head_block_header.timestamp ) break;
+
+            auto& participation = window.delegates[ record.block_producer_id ];
+            if( record.block_id.valid() ) ++participation.blocks_produced;
+            else ++participation.blocks_missed;
+         }
+
+         _participation_window = std::move( window );
+         return _participation_window;
+      } FC_CAPTURE_AND_RETHROW() }
+
       void chain_database_impl::pop_block()
       { try {
          if( _head_block_header.block_num == 0 )
@@ -1042,17 +1584,23 @@ namespace bts { namespace blockchain {
             return;
          }
 
+         bts::db::shared_level_database::scoped_batch batch( _index_db.is_open() ? &_index_db : nullptr );
+         clear_record_caches();
+
            // update the is_included flag on the fork data
          mark_included( _head_block_id, false );
 
-         // update the block_num_to_block_id index
-         _block_num_to_id_db.remove( _head_block_header.block_num );
-
          auto previous_block_id = _head_block_header.previous;
 
-         bts::blockchain::pending_chain_state_ptr undo_state = std::make_shared<bts::blockchain::pending_chain_state>(_undo_state_db.fetch( _head_block_id ));
+         bts::blockchain::pending_chain_state_ptr undo_state = std::make_shared<bts::blockchain::pending_chain_state>( load_undo_state( _head_block_header.block_num, _head_block_id ) );
          undo_state->set_prev_state( self->shared_from_this() );
          undo_state->apply_changes();
+         if( _index_db.is_open() )
+            self->set_property( chain_property_enum::head_block_id, fc::variant( previous_block_id ) );
+         batch.commit();
+
+         // update the block_num_to_block_id index
+         _block_num_to_id_db.remove( _head_block_header.block_num );
 
          _head_block_id = previous_block_id;
          _head_block_header = self->get_block_header( _head_block_id );
@@ -1144,8 +1692,11 @@ namespace bts { namespace blockchain {
 
           my->open_database( data_dir );
 
-          // TODO: check to see if we crashed during the last write
-          //   if so, then apply the last undo operation stored.
+          if( !must_rebuild_index && !my->repair_block_num_index() )
+          {
+             wlog( "index does not match raw_chain, rebuilding index" );
+             must_rebuild_index = true;
+          }
 
           uint32_t       last_block_num = -1;
           block_id_type  last_block_id;
@@ -1163,6 +1714,7 @@ namespace bts { namespace blockchain {
 
           if( must_rebuild_index || last_block_num == uint32_t(-1) )
           {
+             my->assert_can_rebuild_index( data_dir );
              close();
              fc::remove_all( data_dir / "index" );
              fc::create_directories( data_dir / "index");
@@ -1296,6 +1848,11 @@ namespace bts { namespace blockchain {
 
    void chain_database::close()
    { try {
+      my->_applied_block_cache.clear();
+      my->_applied_block_cache_order.clear();
+      my->clear_record_caches();
+      my->_block_template.reset();
+
       my->_market_transactions_db.close();
       my->_fork_number_db.close();
       my->_fork_db.close();
@@ -1326,6 +1883,8 @@ namespace bts { namespace blockchain {
       my->_delegate_vote_index_db.close();
 
       my->_slot_record_db.close();
+      my->_delegate_slot_record_db.close();
+      my->_participation_window = detail::participation_window();
 
       my->_ask_db.close();
       my->_bid_db.close();
@@ -1335,8 +1894,23 @@ namespace bts { namespace blockchain {
 
       my->_market_history_db.close();
       my->_market_status_db.close();
+
+      my->_index_db.close();
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   void chain_database::set_unified_index_storage( bool enabled, size_t cache_size )
+   {
+      FC_ASSERT( !my->_index_db.is_open(), "Index storage can only be changed while the database is closed" );
+      my->_unified_index_storage = enabled;
+      my->_index_cache_size = cache_size;
+   }
+
+   void chain_database::set_database_options( const std::map<std::string, bts::db::level_options>& options )
+   {
+      FC_ASSERT( !my->_block_num_to_id_db.is_open(), "Database options can only be changed while the database is closed" );
+      my->_database_options = options;
+   }
+
    account_record chain_database::get_delegate_record_for_signee( const public_key_type& block_signee )const
    {
       auto delegate_record = get_account_record( address( block_signee ) );
@@ -1397,6 +1971,7 @@ namespace bts { namespace blockchain {
 
       pending_chain_state_ptr          pend_state = std::make_shared<pending_chain_state>(my->_pending_trx_state);
       transaction_evaluation_state_ptr trx_eval_state = std::make_shared<transaction_evaluation_state>(pend_state.get(), my->_chain_id);
+      trx_eval_state->_cache_recovered_keys = true;
 
       trx_eval_state->evaluate( trx );
       auto fees = trx_eval_state->get_fees() + trx_eval_state->alt_fees_paid.amount;
@@ -1593,12 +2168,17 @@ namespace bts { namespace blockchain {
 
    oasset_record chain_database::get_asset_record( const asset_id_type& id )const
    {
+      if( const oasset_record* cached = my->_asset_record_cache.find( id ) )
+         return *cached;
+
+      oasset_record record;
       auto itr = my->_asset_db.find( id );
       if( itr.valid() )
       {
-         return itr.value();
+         record = itr.value();
       }
-      return oasset_record();
+      my->_asset_record_cache.insert( id, record );
+      return record;
    }
 
    oaccount_record chain_database::get_account_record( const address& account_owner )const
@@ -1611,7 +2191,12 @@ namespace bts { namespace blockchain {
 
    obalance_record chain_database::get_balance_record( const balance_id_type& balance_id )const
    {
-      return my->_balance_db.fetch_optional( balance_id );
+      if( const obalance_record* cached = my->_balance_record_cache.find( balance_id ) )
+         return *cached;
+
+      const obalance_record record = my->_balance_db.fetch_optional( balance_id );
+      my->_balance_record_cache.insert( balance_id, record );
+      return record;
    }
 
    oaccount_record chain_database::get_account_record( const account_id_type& account_id )const
@@ -1649,6 +2234,7 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_asset_record( const asset_record& asset_to_store )
    { try {
+       my->_asset_record_cache.invalidate( asset_to_store.id );
        if( asset_to_store.is_null() )
        {
           my->_asset_db.remove( asset_to_store.id );
@@ -1663,6 +2249,7 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_balance_record( const balance_record& r )
    { try {
+       my->_balance_record_cache.invalidate( r.id() );
 #if 0
        ilog( "balance record: ${r}", ("r",r) );
        if( r.is_null() )
@@ -1867,62 +2454,15 @@ namespace bts { namespace blockchain {
 
    full_block chain_database::generate_block( const time_point_sec& timestamp )
    { try {
-      auto start_time = time_point::now();
-
-      pending_chain_state_ptr pending_state = std::make_shared<pending_chain_state>( shared_from_this() );
-      if( pending_state->get_head_block_num() >= BTS_V0_4_9_FORK_BLOCK_NUM )
-         my->execute_markets( timestamp, pending_state );
-      auto pending_trx = get_pending_transactions();
-
-      full_block next_block;
-      size_t block_size = 0;
-      share_type total_fees = 0;
-
-      // TODO: Sort pending transactions by highest fee
-      for( const auto& item : pending_trx )
-      {
-         auto trx_size = item->trx.data_size();
-         if( block_size + trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE ) break;
-         block_size += trx_size;
-
-         /* Make modifications to temporary state */
-         auto pending_trx_state = std::make_shared<pending_chain_state>( pending_state );
-         auto trx_eval_state = std::make_shared<transaction_evaluation_state>( pending_trx_state.get(), my->_chain_id );
-
-         try
-         {
-            trx_eval_state->evaluate( item->trx );
-            // TODO: what about fees in other currencies?
-            total_fees += trx_eval_state->get_fees( 0 );
-            /* Apply temporary state to block state */
-            pending_trx_state->apply_changes();
-            next_block.user_transactions.push_back( item->trx );
-         }
-         catch ( const fc::canceled_exception& )
-         {
-            throw;
-         }
-         catch( const fc::exception& e )
-         {
-            wlog( "Pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
-                  ("trx",fc::json::to_pretty_string(item->trx))("e",e.to_detail_string()) );
-         }
-
-         /* Limit the time we spend evaluating transactions */
-         if( time_point::now() - start_time > fc::seconds(5) )
-            break;
-      }
-
-      auto head_block = get_head_block();
-
-      next_block.previous           = head_block.block_num ? head_block.id() : block_id_type();
-      next_block.block_num          = head_block.block_num + 1;
-      next_block.timestamp          = timestamp;
-      next_block.transaction_digest = digest_block( next_block ).calculate_transaction_digest();
-
-      return next_block;
+      my->update_block_template( timestamp, fc::seconds( 5 ) );
+      return my->_block_template->block;
    } FC_CAPTURE_AND_RETHROW( (timestamp) ) }
 
+   void chain_database::update_block_template( const time_point_sec& timestamp, const fc::microseconds& time_limit )
+   { try {
+      my->update_block_template( timestamp, time_limit );
+   } FC_CAPTURE_AND_RETHROW( (timestamp)(time_limit) ) }
+
    void chain_database::add_observer( chain_observer* observer )
    {
       my->_observers.insert(observer);
@@ -2155,13 +2695,10 @@ namespace bts { namespace blockchain {
         vector<slot_record> slot_records;
         slot_records.reserve( count );
 
-        for( auto iter = my->_slot_record_db.begin(); iter.valid(); ++iter )
+        for( auto iter = my->_delegate_slot_record_db.lower_bound( delegate_slot_index( delegate_id, min_timestamp ) );
+             iter.valid() && iter.key().delegate_id == delegate_id; ++iter )
         {
-            const auto slot_record = iter.value();
-            if( slot_record.start_time < min_timestamp || slot_record.block_producer_id != delegate_id )
-                continue;
-
-            slot_records.push_back( slot_record );
+            slot_records.push_back( iter.value() );
             if( slot_records.size() >= count )
                 break;
         }
@@ -2442,12 +2979,20 @@ namespace bts { namespace blockchain {
       {
          // if 10*N blocks ago is longer than 10*N*INTERVAL_SEC ago then we missed blocks, calculate
          // in terms of percentage time rather than percentage blocks.
-         const auto starting_time = get_block_header( head_num - BTS_BLOCKCHAIN_NUM_DELEGATES ).timestamp;
+         const auto starting_time = my->get_participation_window().round_start_time;
          const auto expected_production = (now - starting_time).to_seconds() / BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
          return 100*double( BTS_BLOCKCHAIN_NUM_DELEGATES ) / expected_production;
       }
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   delegate_participation_record chain_database::get_delegate_participation( const account_id_type& delegate_id )const
+   { try {
+      const auto& delegates = my->get_participation_window().delegates;
+      const auto itr = delegates.find( delegate_id );
+      if( itr != delegates.end() ) return itr->second;
+      return delegate_participation_record();
+   } FC_CAPTURE_AND_RETHROW( (delegate_id) ) }
+
    optional<market_order> chain_database::get_market_bid( const market_index_key& key )const
    { try {
        auto market_itr  = my->_bid_db.find(key);
@@ -2749,10 +3294,19 @@ namespace bts { namespace blockchain {
 
    void chain_database::store_slot_record( const slot_record& r )
    {
+       const auto prev_record = my->_slot_record_db.fetch_optional( r.start_time );
+       if( prev_record.valid() )
+           my->_delegate_slot_record_db.remove( delegate_slot_index( prev_record->block_producer_id, prev_record->start_time ) );
+
        if( r.is_null() )
+       {
            my->_slot_record_db.remove( r.start_time );
+       }
        else
+       {
            my->_slot_record_db.store( r.start_time, r );
+           my->_delegate_slot_record_db.store( delegate_slot_index( r.block_producer_id, r.start_time ), r );
+       }
    }
 
    oslot_record chain_database::get_slot_record( const time_point_sec& start_time )const
@@ -3186,107 +3740,244 @@ namespace bts { namespace blockchain {
       return results;
    } FC_CAPTURE_AND_RETHROW( (account_name) ) }
 
-   void chain_database::dump_state( const fc::path& path )const
+/* Tables written by dump_state(), in the order they are written */
+#define CHAIN_DB_DUMP_DATABASES (_market_transactions_db)(_slate_db)(_property_db)(_block_num_to_id_db) \
+                                (_block_id_to_block_record_db)(_block_id_to_block_data_db)(_id_to_transaction_record_db) \
+                                (_asset_db)(_balance_db)(_burn_db)(_account_db)(_address_to_account_db)(_account_index_db) \
+                                (_symbol_index_db)(_delegate_vote_index_db)(_slot_record_db)(_ask_db)(_bid_db)(_short_db) \
+                                (_collateral_db)(_feed_db)(_market_status_db)(_market_history_db)
+
+   void chain_database::dump_state( const fc::path& path, const string& format )const
    { try {
        const auto dir = fc::absolute( path );
        FC_ASSERT( !fc::exists( dir ) );
+       FC_ASSERT( format == "binary" || format == "jsonl", "Unknown dump format ${format}", ("format",format) );
        fc::create_directories( dir );
 
        fc::path next_path;
        ulog( "This will take a while..." );
 
-       next_path = dir / "_market_transactions_db.json";
-       my->_market_transactions_db.export_to_json( next_path );
+#define DUMP_DATABASE(r, data, elem) \
+       if( format == "binary" ) \
+       { \
+          next_path = dir / BOOST_PP_STRINGIZE(elem.bin); \
+          my->elem.export_to_binary( next_path ); \
+       } \
+       else \
+       { \
+          next_path = dir / BOOST_PP_STRINGIZE(elem.jsonl); \
+          my->elem.export_to_json_lines( next_path ); \
+       } \
        ulog( "Dumped ${p}", ("p",next_path) );
+       BOOST_PP_SEQ_FOR_EACH(DUMP_DATABASE, _, CHAIN_DB_DUMP_DATABASES)
+#undef DUMP_DATABASE
+   } FC_CAPTURE_AND_RETHROW( (path)(format) ) }
 
-       next_path = dir / "_slate_db.json";
-       my->_slate_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   void chain_database::import_state( const fc::path& data_dir, const fc::path& path )
+   { try {
+       const auto dir = fc::absolute( path );
+       FC_ASSERT( fc::is_directory( dir ), "State dump '${dir}' was not found.", ("dir",dir) );
+       FC_ASSERT( !fc::exists( data_dir / "index" ) && !fc::exists( data_dir / "raw_chain" ),
+                  "State can only be imported into an empty data directory" );
 
-       next_path = dir / "_property_db.json";
-       my->_property_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       std::exception_ptr error_importing_state;
+       try
+       {
+          fc::create_directories( data_dir );
+          my->open_database( data_dir );
 
-       next_path = dir / "_block_num_to_id_db.json";
-       my->_block_num_to_id_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          fc::path next_path;
+#define IMPORT_DATABASE(r, data, elem) \
+          next_path = dir / BOOST_PP_STRINGIZE(elem.bin); \
+          if( fc::exists( next_path ) ) \
+          { \
+             ulog( "Imported ${count} records from ${p}", ("count",my->elem.import_from_binary( next_path ))("p",next_path) ); \
+          } \
+          else \
+          { \
+             next_path = dir / BOOST_PP_STRINGIZE(elem.jsonl); \
+             FC_ASSERT( fc::exists( next_path ), "State dump is missing " BOOST_PP_STRINGIZE(elem) ); \
+             ulog( "Imported ${count} records from ${p}", ("count",my->elem.import_from_json_lines( next_path ))("p",next_path) ); \
+          }
+          BOOST_PP_SEQ_FOR_EACH(IMPORT_DATABASE, _, CHAIN_DB_DUMP_DATABASES)
+#undef IMPORT_DATABASE
 
-       next_path = dir / "_block_id_to_block_record_db.json";
-       my->_block_id_to_block_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          uint32_t       last_block_num = -1;
+          block_id_type  last_block_id;
+          FC_ASSERT( my->_block_num_to_id_db.last( last_block_num, last_block_id ), "State dump contains no blocks" );
+          my->index_imported_head_block( last_block_num, last_block_id );
+       }
+       catch (...)
+       {
+          error_importing_state = std::current_exception();
+       }
 
-       next_path = dir / "_block_id_to_block_data_db.json";
-       my->_block_id_to_block_data_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       close();
+       if( error_importing_state )
+       {
+          fc::remove_all( data_dir / "index" );
+          fc::remove_all( data_dir / "raw_chain" );
+          std::rethrow_exception( error_importing_state );
+       }
+   } FC_CAPTURE_AND_RETHROW( (data_dir)(path) ) }
 
-       next_path = dir / "_id_to_transaction_record_db.json";
-       my->_id_to_transaction_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+/* Tables that make up the consensus state, in the order they appear in a snapshot.  Block records,
+ * fork data, undo state and pending transactions are handled separately or deliberately left out */
+#define CHAIN_DB_SNAPSHOT_DATABASES (_property_db)(_slate_db)(_market_transactions_db)(_block_num_to_id_db) \
+                                    (_id_to_transaction_record_db)(_asset_db)(_balance_db)(_burn_db)(_account_db) \
+                                    (_address_to_account_db)(_account_index_db)(_symbol_index_db)(_delegate_vote_index_db) \
+                                    (_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db) \
+                                    (_market_status_db)(_market_history_db)
 
-       next_path = dir / "_asset_db.json";
-       my->_asset_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   fc::sha256 chain_database::export_snapshot( const fc::path& snapshot_file )
+   { try {
+       FC_ASSERT( !fc::exists( snapshot_file ) );
+       // no blocks may be applied while we're streaming the tables out
+       fc::unique_lock<fc::mutex> lock( my->_push_block_mutex );
+
+       std::ofstream out( snapshot_file.string(), std::ios::out | std::ios::binary );
+       FC_ASSERT( out.good(), "Unable to open ${file} for writing", ("file",snapshot_file) );
+
+       fc::sha256::encoder digest;
+       bts::db::detail::hashing_ostream stream{ out, digest };
+
+       snapshot_header header;
+       header.chain_id = my->_chain_id;
+       header.block_num = my->_head_block_header.block_num;
+       header.block_id = my->_head_block_id;
+       header.timestamp = my->_head_block_header.timestamp;
+       fc::raw::pack( stream, header );
+
+#define EXPORT_SNAPSHOT_TABLE(r, data, elem) \
+       fc::raw::pack( stream, std::string( BOOST_PP_STRINGIZE(elem) ) ); \
+       ilog( "Exported ${count} records from " BOOST_PP_STRINGIZE(elem), ("count", my->elem.export_raw( out, digest )) );
+       BOOST_PP_SEQ_FOR_EACH(EXPORT_SNAPSHOT_TABLE, _, CHAIN_DB_SNAPSHOT_DATABASES)
+#undef EXPORT_SNAPSHOT_TABLE
+
+       // block records of the active chain, without the fields that depend on when this node saw the block
+       fc::raw::pack( stream, std::string( "_block_id_to_block_record_db" ) );
+       for( auto itr = my->_block_num_to_id_db.begin(); itr.valid(); ++itr )
+       {
+          block_record record = my->_block_id_to_block_record_db.fetch( itr.value() );
+          record.latency = fc::microseconds();
+          record.processing_time = fc::microseconds();
+          stream.put( 1 );
+          fc::raw::pack( stream, itr.value() );
+          fc::raw::pack( stream, record );
+       }
+       stream.put( 0 );
 
-       next_path = dir / "_balance_db.json";
-       my->_balance_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       // the head block itself, so the node can link the next block it receives
+       fc::raw::pack( stream, my->_block_id_to_block_data_db.fetch( my->_head_block_id ) );
 
-       next_path = dir / "_burn_db.json";
-       my->_burn_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       const fc::sha256 snapshot_digest = digest.result();
+       fc::raw::pack( out, snapshot_digest );
+       out.flush();
+       FC_ASSERT( out.good(), "Error writing ${file}", ("file",snapshot_file) );
 
-       next_path = dir / "_account_db.json";
-       my->_account_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       ulog( "Exported snapshot at block ${num} with digest ${digest}", ("num",header.block_num)("digest",snapshot_digest) );
+       return snapshot_digest;
+   } FC_CAPTURE_AND_RETHROW( (snapshot_file) ) }
 
-       next_path = dir / "_address_to_account_db.json";
-       my->_address_to_account_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+   snapshot_header chain_database::import_snapshot( const fc::path& data_dir, const fc::path& snapshot_file, bool trust_snapshot )
+   { try {
+       FC_ASSERT( fc::exists( snapshot_file ), "Snapshot file '${file}' was not found.", ("file",snapshot_file) );
+       FC_ASSERT( !fc::exists( data_dir / "index" ) && !fc::exists( data_dir / "raw_chain" ),
+                  "Snapshots can only be imported into an empty data directory" );
 
-       next_path = dir / "_account_index_db.json";
-       my->_account_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+       std::exception_ptr error_importing_snapshot;
+       snapshot_header header;
+       try
+       {
+          std::ifstream in( snapshot_file.string(), std::ios::in | std::ios::binary );
+          fc::sha256::encoder digest;
+          bts::db::detail::hashing_istream stream{ in, digest };
 
-       next_path = dir / "_symbol_index_db.json";
-       my->_symbol_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          fc::raw::unpack( stream, header );
+          FC_ASSERT( header.format_version == BTS_BLOCKCHAIN_SNAPSHOT_FORMAT_VERSION,
+                     "Unsupported snapshot format", ("format_version",header.format_version) );
+          FC_ASSERT( header.database_version == BTS_BLOCKCHAIN_DATABASE_VERSION,
+                     "Snapshot was taken from an incompatible database version", ("database_version",header.database_version) );
 
-       next_path = dir / "_delegate_vote_index_db.json";
-       my->_delegate_vote_index_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          const auto checkpoint_itr = CHECKPOINT_BLOCKS.find( header.block_num );
+          FC_ASSERT( checkpoint_itr == CHECKPOINT_BLOCKS.end() || checkpoint_itr->second == header.block_id,
+                     "Snapshot head block does not match checkpoint", ("header",header) );
 
-       next_path = dir / "_slot_record_db.json";
-       my->_slot_record_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          fc::create_directories( data_dir );
+          my->open_database( data_dir );
 
-       next_path = dir / "_ask_db.json";
-       my->_ask_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+#define IMPORT_SNAPSHOT_TABLE(r, data, elem) \
+          { \
+             std::string table_name; \
+             fc::raw::unpack( stream, table_name ); \
+             FC_ASSERT( table_name == BOOST_PP_STRINGIZE(elem), "Unexpected table in snapshot", ("table",table_name) ); \
+             ilog( "Imported ${count} records into " BOOST_PP_STRINGIZE(elem), ("count", my->elem.import_raw( in, digest )) ); \
+          }
+          BOOST_PP_SEQ_FOR_EACH(IMPORT_SNAPSHOT_TABLE, _, CHAIN_DB_SNAPSHOT_DATABASES)
+#undef IMPORT_SNAPSHOT_TABLE
+
+          std::string table_name;
+          fc::raw::unpack( stream, table_name );
+          FC_ASSERT( table_name == "_block_id_to_block_record_db", "Unexpected table in snapshot", ("table",table_name) );
+          char more_records = 0;
+          stream.get( more_records );
+          while( more_records )
+          {
+             block_id_type id;
+             block_record record;
+             fc::raw::unpack( stream, id );
+             fc::raw::unpack( stream, record );
+             my->_block_id_to_block_record_db.store( id, record );
+             stream.get( more_records );
+          }
 
-       next_path = dir / "_bid_db.json";
-       my->_bid_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          full_block head_block;
+          fc::raw::unpack( stream, head_block );
+          FC_ASSERT( head_block.id() == header.block_id, "Snapshot head block does not match header" );
 
-       next_path = dir / "_short_db.json";
-       my->_short_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          const fc::sha256 computed_digest = digest.result();
+          fc::sha256 stored_digest;
+          fc::raw::unpack( in, stored_digest );
+          FC_ASSERT( computed_digest == stored_digest, "Snapshot is corrupt",
+                     ("computed_digest",computed_digest)("stored_digest",stored_digest) );
 
-       next_path = dir / "_collateral_db.json";
-       my->_collateral_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          const auto snapshot_checkpoint_itr = CHECKPOINT_SNAPSHOTS.find( header.block_num );
+          if( snapshot_checkpoint_itr != CHECKPOINT_SNAPSHOTS.end() )
+             FC_ASSERT( snapshot_checkpoint_itr->second == computed_digest, "Snapshot digest does not match checkpoint",
+                        ("computed_digest",computed_digest)("checkpoint_digest",snapshot_checkpoint_itr->second) );
+          else
+             FC_ASSERT( trust_snapshot, "There is no checkpoint for a snapshot at block ${num}", ("num",header.block_num) );
 
-       next_path = dir / "_feed_db.json";
-       my->_feed_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          my->_block_id_to_block_data_db.store( header.block_id, head_block );
+          my->index_imported_head_block( header.block_num, header.block_id );
 
-       next_path = dir / "_market_status_db.json";
-       my->_market_status_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
+          // kept with the raw chain rather than the index, which is exactly what a reindex throws away
+          fc::json::save_to_file( header, data_dir / "raw_chain/snapshot_base.json" );
 
-       next_path = dir / "_market_history_db.json";
-       my->_market_history_db.export_to_json( next_path );
-       ulog( "Dumped ${p}", ("p",next_path) );
-   } FC_CAPTURE_AND_RETHROW( (path) ) }
+          ulog( "Imported snapshot at block ${num} with digest ${digest}", ("num",header.block_num)("digest",computed_digest) );
+       }
+       catch (...)
+       {
+          error_importing_snapshot = std::current_exception();
+       }
+
+       close();
+       if( error_importing_snapshot )
+       {
+          fc::remove_all( data_dir / "index" );
+          fc::remove_all( data_dir / "raw_chain" );
+          std::rethrow_exception( error_importing_snapshot );
+       }
+       return header;
+   } FC_CAPTURE_AND_RETHROW( (data_dir)(snapshot_file)(trust_snapshot) ) }
+
+   optional<snapshot_header> chain_database::get_snapshot_base( const fc::path& data_dir )
+   { try {
+       const fc::path base_file = data_dir / "raw_chain/snapshot_base.json";
+       if( !fc::exists( base_file ) )
+          return optional<snapshot_header>();
+       return fc::json::from_file( base_file ).as<snapshot_header>();
+   } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
    fc::variant_object chain_database::get_stats() const
    {
@@ -3295,12 +3986,62 @@ namespace bts { namespace blockchain {
                            (_block_num_to_id_db)(_block_id_to_block_record_db)(_block_id_to_block_data_db)(_known_transactions) \
                            (_id_to_transaction_record_db)(_pending_transaction_db)(_pending_fee_index)(_asset_db)(_balance_db) \
                            (_burn_db)(_account_db)(_address_to_account_db)(_account_index_db)(_symbol_index_db)(_delegate_vote_index_db) \
-                           (_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db)(_market_status_db)(_market_history_db) \
-                           (_recent_operations)
+                           (_slot_record_db)(_delegate_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db) \
+                           (_market_status_db)(_market_history_db)(_recent_operations)
 #define GET_DATABASE_SIZE(r, data, elem) stats[BOOST_PP_STRINGIZE(elem)] = my->elem.size();
      BOOST_PP_SEQ_FOR_EACH(GET_DATABASE_SIZE, _, CHAIN_DB_DATABASES)
      return stats;
    }
 
+/* Every level_map and cached_level_map, which are the tables that collect bts::db::table_stats */
+#define CHAIN_DB_TABLES (_market_transactions_db)(_slate_db)(_fork_number_db)(_fork_db)(_property_db)(_undo_state_db) \
+                        (_block_num_to_id_db)(_block_id_to_block_record_db)(_block_id_to_block_data_db) \
+                        (_id_to_transaction_record_db)(_pending_transaction_db)(_asset_db)(_balance_db)(_burn_db)(_account_db) \
+                        (_address_to_account_db)(_account_index_db)(_symbol_index_db)(_delegate_vote_index_db)(_slot_record_db) \
+                        (_delegate_slot_record_db)(_ask_db)(_bid_db)(_short_db)(_collateral_db)(_feed_db)(_market_status_db) \
+                        (_market_history_db)
+
+   void chain_database::enable_metrics( bool enabled )
+   {
+     bts::db::enable_table_stats( enabled );
+   }
+
+   bool chain_database::metrics_enabled()const
+   {
+     return bts::db::table_stats_enabled();
+   }
+
+   fc::variant_object chain_database::get_metrics()const
+   {
+     fc::mutable_variant_object tables;
+#define GET_TABLE_STATS(r, data, elem) tables[BOOST_PP_STRINGIZE(elem)] = my->elem.get_stats();
+     BOOST_PP_SEQ_FOR_EACH(GET_TABLE_STATS, _, CHAIN_DB_TABLES)
+#undef GET_TABLE_STATS
+
+     fc::mutable_variant_object metrics;
+     metrics["enabled"] = metrics_enabled();
+     metrics["tables"] = tables;
+     metrics["extend_chain_phases"] = my->_extend_chain_phase_latency;
+     metrics["operations"] = operation_factory::instance().get_evaluation_latency();
+     metrics["record_caches"] = fc::mutable_variant_object( "asset", my->_asset_record_cache.get_stats() )
+                                                          ( "balance", my->_balance_record_cache.get_stats() );
+     metrics["signature_cache"] = signature_cache::get_stats();
+     return metrics;
+   }
+
+   void chain_database::reset_metrics()
+   {
+#define RESET_TABLE_STATS(r, data, elem) my->elem.reset_stats();
+     BOOST_PP_SEQ_FOR_EACH(RESET_TABLE_STATS, _, CHAIN_DB_TABLES)
+#undef RESET_TABLE_STATS
+     // an extend_chain in progress holds pointers into this map, so only the values may be reset
+     for( auto& phase : my->_extend_chain_phase_latency )
+        phase.second.reset();
+     operation_factory::instance().reset_evaluation_latency();
+     my->_asset_record_cache.reset_stats();
+     my->_balance_record_cache.reset_stats();
+     signature_cache::reset_stats();
+   }
+
 
 } } // bts::blockchain
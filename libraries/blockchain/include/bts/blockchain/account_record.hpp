@@ -2,6 +2,7 @@
 
 #include <bts/blockchain/types.hpp>
 #include <bts/blockchain/asset.hpp>
+#include <bts/db/key_encoding.hpp>
 
 #include <fc/time.hpp>
 #include <fc/io/enum_type.hpp>
@@ -158,3 +159,5 @@ FC_REFLECT( bts::blockchain::burn_record_value, (amount)(message)(signer) )
 FC_REFLECT_DERIVED( bts::blockchain::burn_record, (bts::blockchain::burn_record_key)(bts::blockchain::burn_record_value), BOOST_PP_SEQ_NIL )
 FC_REFLECT_ENUM( bts::blockchain::account_type, (titan_account)(public_account)(multisig_account) )
 FC_REFLECT( bts::blockchain::multisig_meta_info, (required)(owners) )
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::burn_record_key, (account_id)(transaction_id) )
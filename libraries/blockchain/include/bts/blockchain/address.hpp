@@ -1,6 +1,7 @@
 #pragma once
 
 #include <bts/blockchain/pts_address.hpp>
+#include <bts/db/key_encoding.hpp>
 
 #include <fc/array.hpp>
 #include <fc/crypto/ripemd160.hpp>
@@ -70,3 +71,5 @@ namespace std
 
 #include <fc/reflect/reflect.hpp>
 FC_REFLECT( bts::blockchain::address, (addr) )
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::address, (addr) )
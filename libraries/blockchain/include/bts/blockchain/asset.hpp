@@ -1,6 +1,7 @@
 #pragma once
 
 #include <bts/blockchain/types.hpp>
+#include <bts/db/key_encoding.hpp>
 
 namespace bts { namespace blockchain {
 
@@ -131,3 +132,5 @@ namespace fc
 #include <fc/reflect/reflect.hpp>
 FC_REFLECT( bts::blockchain::price, (ratio)(quote_asset_id)(base_asset_id) );
 FC_REFLECT( bts::blockchain::asset, (amount)(asset_id) );
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::price, (quote_asset_id)(base_asset_id)(ratio) )
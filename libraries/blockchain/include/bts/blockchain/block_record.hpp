@@ -44,6 +44,13 @@ namespace bts { namespace blockchain {
    };
    typedef fc::optional<slot_record> oslot_record;
 
+   /** How many of a delegate's recent block production slots were filled or missed */
+   struct delegate_participation_record
+   {
+      uint32_t blocks_produced = 0;
+      uint32_t blocks_missed = 0;
+   };
+
 } } // bts::blockchain
 
 FC_REFLECT_DERIVED( bts::blockchain::block_record,
@@ -61,3 +68,7 @@ FC_REFLECT( bts::blockchain::slot_record,
             (start_time)
             (block_producer_id)
             (block_id) )
+
+FC_REFLECT( bts::blockchain::delegate_participation_record,
+            (blocks_produced)
+            (blocks_missed) )
@@ -2,6 +2,7 @@
 
 #include <bts/blockchain/chain_interface.hpp>
 #include <bts/blockchain/pending_chain_state.hpp>
+#include <bts/db/level_options.hpp>
 
 namespace bts { namespace blockchain {
 
@@ -47,6 +48,20 @@ namespace bts { namespace blockchain {
       bool                         is_known; ///< do we know the content of this block
    };
 
+   /**
+    * Written at the start of a state snapshot.  The header is covered by the snapshot digest along
+    * with the table contents that follow it.
+    */
+   struct snapshot_header
+   {
+      uint32_t           format_version = BTS_BLOCKCHAIN_SNAPSHOT_FORMAT_VERSION;
+      int64_t            database_version = BTS_BLOCKCHAIN_DATABASE_VERSION;
+      digest_type        chain_id;
+      uint32_t           block_num = 0;
+      block_id_type      block_id;
+      fc::time_point_sec timestamp;
+   };
+
    struct fork_record
    {
        fork_record()
@@ -91,6 +106,20 @@ namespace bts { namespace blockchain {
          chain_database();
          virtual ~chain_database()override;
 
+         /**
+          *  Stores every table under index/ in a single LevelDB instance with a shared block cache of
+          *  cache_size bytes, instead of one instance per table, and commits each block's changes to
+          *  it atomically.  Must be called before open(); switching layouts rebuilds the index.
+          */
+         void set_unified_index_storage( bool enabled, size_t cache_size = 0 );
+
+         /**
+          *  Sets the LevelDB options of each database by its directory name, such as "balance_db" or
+          *  "unified_db".  Those under "default" apply to every database not listed.  Must be called
+          *  before open().
+          */
+         void set_database_options( const std::map<std::string, bts::db::level_options>& options );
+
          /**
           * @brief open Open the databases, reindexing as necessary
           * @param reindex_status_callback Called for each reindexed block, with the count of blocks reindexed so far
@@ -111,6 +140,9 @@ namespace bts { namespace blockchain {
 
          double get_average_delegate_participation()const;
 
+         /** @return the slots the delegate filled and missed among the last BTS_BLOCKCHAIN_PARTICIPATION_WINDOW_SLOTS */
+         delegate_participation_record get_delegate_participation( const account_id_type& delegate_id )const;
+
          /**
           *  When evaluating blocks, you only need to validate the delegate signature assuming you
           *  trust the other delegates to check up on eachother (which everyone should).  This
@@ -139,6 +171,15 @@ namespace bts { namespace blockchain {
           */
          full_block                  generate_block( const time_point_sec& timestamp );
 
+         /**
+          *  Speculatively assembles the block generate_block() would return for timestamp, adding pending
+          *  transactions that arrived since the last call for up to time_limit.  Starts over whenever the
+          *  head block or the timestamp changes.  Delegates call this between slots so that producing
+          *  their block takes no time.
+          */
+         void                        update_block_template( const time_point_sec& timestamp,
+                                                            const fc::microseconds& time_limit = fc::milliseconds( 500 ) );
+
          /**
           *  The chain ID is the hash of the initial_config loaded when the
           *  database was first created.
@@ -341,9 +382,52 @@ namespace bts { namespace blockchain {
          asset                              calculate_debt( const asset_id_type& asset_id, bool include_interest = false )const;
          asset                              unclaimed_genesis();
 
-         void                               dump_state( const fc::path& path )const;
+         /**
+          *  Writes each table to its own file in the directory path, either as checksummed binary chunks
+          *  ("binary") or as one JSON record per line ("jsonl").  Either can be loaded with import_state().
+          */
+         void                               dump_state( const fc::path& path, const string& format = "binary" )const;
+
+         /**
+          *  Populates an empty data directory from a directory written by dump_state().  Must be
+          *  called before open().
+          */
+         void                               import_state( const fc::path& data_dir, const fc::path& path );
+
+         /**
+          *  Writes the state of the chain as of the current head block to a single file, and returns
+          *  the digest that commits to its contents.  Pending transactions and fork tracking data are
+          *  node-local and are not included.
+          */
+         fc::sha256                         export_snapshot( const fc::path& snapshot_file );
+
+         /**
+          *  Populates an empty data directory from a snapshot written by export_snapshot(), after which
+          *  open() will resume syncing from the snapshot's head block instead of from genesis.
+          *  The snapshot's digest must match an entry in CHECKPOINT_SNAPSHOTS unless trust_snapshot
+          *  is set.  Must be called before open().
+          */
+         snapshot_header                    import_snapshot( const fc::path& data_dir, const fc::path& snapshot_file,
+                                                             bool trust_snapshot = false );
+         /**
+          *  raw_chain of a chain imported from a snapshot starts at the snapshot's head block, so its index
+          *  can't be rebuilt by replaying from genesis; open() refuses to, and the snapshot must be imported
+          *  again into an empty data directory instead.
+          *
+          *  @return the header of the snapshot the chain in data_dir was imported from, if any
+          */
+         static optional<snapshot_header>   get_snapshot_base( const fc::path& data_dir );
          fc::variant_object                 get_stats() const;
 
+         /**
+          *  Metrics are per-table operation counts and latencies along with the time spent in each
+          *  phase of applying a block.  They are off by default, and cost next to nothing while off.
+          */
+         void                               enable_metrics( bool enabled );
+         bool                               metrics_enabled()const;
+         fc::variant_object                 get_metrics()const;
+         void                               reset_metrics();
+
          // TODO: Only call on pending chain state
          virtual void                       set_market_dirty( const asset_id_type& quote_id, const asset_id_type& base_id )override
          {
@@ -358,5 +442,6 @@ namespace bts { namespace blockchain {
 
 } } // bts::blockchain
 
+FC_REFLECT( bts::blockchain::snapshot_header, (format_version)(database_version)(chain_id)(block_num)(block_id)(timestamp) )
 FC_REFLECT( bts::blockchain::block_fork_data, (next_blocks)(is_linked)(is_valid)(invalid_reason)(is_included)(is_known) )
 FC_REFLECT( bts::blockchain::fork_record, (block_id)(signing_delegate)(transaction_count)(latency)(size)(timestamp)(is_valid)(invalid_reason)(is_current_fork) )
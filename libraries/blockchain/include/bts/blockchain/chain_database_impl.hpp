@@ -8,10 +8,13 @@
 #include <bts/blockchain/genesis_json.hpp>
 #include <bts/blockchain/market_records.hpp>
 #include <bts/blockchain/operation_factory.hpp>
+#include <bts/blockchain/record_cache.hpp>
 #include <bts/blockchain/time.hpp>
 
 #include <bts/db/cached_level_map.hpp>
 #include <bts/db/level_map.hpp>
+#include <bts/db/shared_level_database.hpp>
+#include <bts/db/table_stats.hpp>
 
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
@@ -25,6 +28,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <unordered_set>
 
 namespace bts { namespace blockchain {
 
@@ -62,16 +66,125 @@ namespace bts { namespace blockchain {
       }
    };
 
+   /** Orders slot records by producing delegate and then by time */
+   struct delegate_slot_index
+   {
+      delegate_slot_index( account_id_type id = 0, time_point_sec t = time_point_sec() )
+      :delegate_id(id),start_time(t){}
+      account_id_type delegate_id;
+      time_point_sec  start_time;
+      friend bool operator == ( const delegate_slot_index& a, const delegate_slot_index& b )
+      {
+         return a.delegate_id == b.delegate_id && a.start_time == b.start_time;
+      }
+      friend bool operator < ( const delegate_slot_index& a, const delegate_slot_index& b )
+      {
+         if( a.delegate_id != b.delegate_id ) return a.delegate_id < b.delegate_id;
+         return a.start_time < b.start_time;
+      }
+   };
+
+   /**
+    *  The undo state of one block as stored in the undo ring.  The slot a record lives in only
+    *  identifies the block number modulo BTS_BLOCKCHAIN_MAX_UNDO_HISTORY, so the block id is kept
+    *  alongside the packed state to detect a slot that has since been reused by another block.
+    */
+   struct undo_state_record
+   {
+      block_id_type     block_id;
+      bool              compressed = false;
+      uint32_t          uncompressed_size = 0;
+      std::vector<char> packed_state;
+   };
+
+} } // end namespace bts::blockchain
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::delegate_slot_index, (delegate_id)(start_time) )
+
+namespace bts { namespace db {
+   /** votes are encoded inverted so that keys sort by descending votes, like operator< */
+   template<>
+   struct memcmp_key<bts::blockchain::vote_del>
+   {
+      static const bool enabled = true;
+
+      template<typename Stream>
+      static void encode( Stream& s, const bts::blockchain::vote_del& v )
+      {
+         memcmp_key<int64_t>::encode( s, ~v.votes );
+         memcmp_key<bts::blockchain::account_id_type>::encode( s, v.delegate_id );
+      }
+      static void decode( fc::datastream<const char*>& s, bts::blockchain::vote_del& v )
+      {
+         memcmp_key<int64_t>::decode( s, v.votes );
+         v.votes = ~v.votes;
+         memcmp_key<bts::blockchain::account_id_type>::decode( s, v.delegate_id );
+      }
+   };
+} } // bts::db
+
+namespace bts { namespace blockchain {
+
    namespace detail
    {
+      /** The result of evaluating a block on top of its parent, which only depends on the block id */
+      struct applied_block_cache_entry
+      {
+         public_key_type         block_signee;
+         pending_chain_state_ptr applied_changes;
+      };
+
+      /**
+       *  The block a delegate would produce next, kept up to date as transactions arrive so that
+       *  producing it at the slot time does not have to execute markets and evaluate the mempool.
+       *  It is only valid while head_block_id is the head block.
+       */
+      struct block_template
+      {
+         block_id_type                              head_block_id;
+         full_block                                 block;
+         /** the state after executing markets and every transaction in block */
+         pending_chain_state_ptr                    state;
+         size_t                                     block_size = 0;
+         /** pending transactions that were either included or found to be invalid */
+         std::unordered_set<transaction_id_type>    considered_transactions;
+         bool                                       full = false;
+      };
+
+      /** Participation statistics that only change when the head block does */
+      struct participation_window
+      {
+         block_id_type                                                    head_block_id;
+         time_point_sec                                                   round_start_time;
+         std::unordered_map<account_id_type,delegate_participation_record> delegates;
+      };
+
       class chain_database_impl
       {
          public:
             void                                        open_database(const fc::path& data_dir );
+            void                                        open_unified_index( const fc::path& data_dir );
+            void                                        assert_can_rebuild_index( const fc::path& data_dir )const;
+
+            bts::db::level_options                      table_options( const std::string& name )const;
+
+            template<typename Table>
+            void                                        open_index_table( Table& table, const fc::path& data_dir, const std::string& name )
+            {
+               if( _index_db.is_open() )
+                  table.open( _index_db, name );
+               else
+                  table.open( data_dir / "index" / name, table_options( name ) );
+            }
             digest_type                                 initialize_genesis( const optional<path>& genesis_file, bool chain_id_only = false );
 
             std::pair<block_id_type, block_fork_data>   store_and_index( const block_id_type& id, const full_block& blk );
             void                                        clear_pending(  const full_block& blk );
+            void                                        index_imported_head_block( uint32_t block_num, const block_id_type& block_id );
+            bool                                        repair_block_num_index();
+            void                                        update_block_template( const time_point_sec& timestamp,
+                                                                                   const fc::microseconds& time_limit );
+            void                                        clear_record_caches();
             void                                        switch_to_fork( const block_id_type& block_id );
             void                                        extend_chain( const full_block& blk );
             vector<block_id_type>                       get_fork_history( const block_id_type& id );
@@ -87,9 +200,16 @@ namespace bts { namespace blockchain {
             void                                        pay_delegate_v1( const block_id_type& block_id,
                                                                          const pending_chain_state_ptr&,
                                                                          const public_key_type& block_signee );
-            void                                        save_undo_state( const block_id_type& id,
-                                                                         const pending_chain_state_ptr& );
+            /** @return the state that undoes pending_state, or nullptr if blocks this old are never popped */
+            pending_chain_state_ptr                     build_undo_state( const pending_chain_state_ptr& pending_state );
+            void                                        store_undo_state( uint32_t block_num, const block_id_type& id,
+                                                                          const pending_chain_state& undo_state );
+            pending_chain_state                         load_undo_state( uint32_t block_num, const block_id_type& id );
+            void                                        migrate_undo_state_db( const fc::path& old_undo_state_dir );
             void                                        update_head_block( const full_block& blk );
+            void                                        cache_applied_block( const full_block& block_data,
+                                                                             const public_key_type& block_signee,
+                                                                             const pending_chain_state_ptr& applied_changes );
             std::vector<block_id_type>                  fetch_blocks_at_number( uint32_t block_num );
             std::pair<block_id_type, block_fork_data>   recursive_mark_as_linked( const std::unordered_set<block_id_type>& ids );
             void                                        recursive_mark_as_invalid( const std::unordered_set<block_id_type>& ids, const fc::exception& reason );
@@ -107,6 +227,12 @@ namespace bts { namespace blockchain {
 
             void                                        revalidate_pending();
 
+            /** @return where to record how long a phase of extend_chain took, or nullptr if metrics are disabled */
+            bts::db::latency_histogram*                 phase_latency( const char* phase );
+
+            void                                        index_slot_records();
+            const participation_window&                 get_participation_window();
+
             fc::future<void> _revalidate_pending;
             fc::mutex        _push_block_mutex;
 
@@ -135,8 +261,19 @@ namespace bts { namespace blockchain {
             bts::db::level_map<proposal_vote_id_type, proposal_vote>                    _proposal_vote_db;
 #endif
 
-            /** the data required to 'undo' the changes a block made to the database */
-            bts::db::level_map<block_id_type,pending_chain_state>                       _undo_state_db;
+            /**
+             *  The data required to 'undo' the changes a block made to the database, stored as a ring
+             *  of BTS_BLOCKCHAIN_MAX_UNDO_HISTORY slots indexed by block_num % BTS_BLOCKCHAIN_MAX_UNDO_HISTORY
+             *  so that each new block overwrites the oldest entry instead of adding one and deleting another.
+             */
+            bts::db::level_map<uint32_t,undo_state_record>                              _undo_state_db;
+
+            /**
+             *  The state changes of recently applied blocks, so that switching back and forth between
+             *  forks (for instance during a short network partition) does not re-evaluate every block.
+             */
+            std::unordered_map<block_id_type,applied_block_cache_entry>                 _applied_block_cache;
+            std::deque<block_id_type>                                                   _applied_block_cache_order;
 
             // blocks in the current 'official' chain.
             bts::db::level_map<uint32_t,block_id_type>                                  _block_num_to_id_db;
@@ -156,6 +293,9 @@ namespace bts { namespace blockchain {
 
             bts::db::level_map<asset_id_type, asset_record>                             _asset_db;
             bts::db::level_map<balance_id_type, balance_record>                         _balance_db;
+            /** Decoded lookups of _asset_db and _balance_db, shared by every evaluation of the current block */
+            record_cache<asset_id_type, asset_record>                                   _asset_record_cache{ BTS_BLOCKCHAIN_RECORD_CACHE_SIZE };
+            record_cache<balance_id_type, balance_record>                               _balance_record_cache{ BTS_BLOCKCHAIN_RECORD_CACHE_SIZE };
 
             bts::db::level_map<burn_record_key, burn_record_value>                      _burn_db;
 
@@ -167,6 +307,12 @@ namespace bts { namespace blockchain {
             bts::db::cached_level_map<vote_del, int>                                    _delegate_vote_index_db;
 
             bts::db::level_map<time_point_sec, slot_record>                             _slot_record_db;
+            bts::db::level_map<delegate_slot_index, slot_record>                        _delegate_slot_record_db;
+            participation_window                                                        _participation_window;
+
+            optional<block_template>                                                    _block_template;
+
+            std::map<std::string, bts::db::latency_histogram>                           _extend_chain_phase_latency;
 
             bts::db::cached_level_map<market_index_key, order_record>                   _ask_db;
             bts::db::cached_level_map<market_index_key, order_record>                   _bid_db;
@@ -178,6 +324,17 @@ namespace bts { namespace blockchain {
             bts::db::level_map<market_history_key, market_history_record>               _market_history_db;
 
             std::map<operation_type_enum, std::deque<operation>>                        _recent_operations;
+
+            /** LevelDB tuning by database directory name, with "default" applying to every other database */
+            std::map<std::string, bts::db::level_options>                               _database_options;
+
+            /**
+             *  When enabled, the tables under index/ share this one LevelDB instance instead of opening one
+             *  each.  Declared last so that it is destroyed before the tables whose comparators it uses.
+             */
+            bool                                                                        _unified_index_storage = false;
+            size_t                                                                      _index_cache_size = 0;
+            bts::db::shared_level_database                                              _index_db;
       };
   } // end namespace bts::blockchain::detail
 } } // end namespace bts::blockchain
@@ -185,3 +342,5 @@ namespace bts { namespace blockchain {
 FC_REFLECT_TYPENAME( std::vector<bts::blockchain::block_id_type> )
 FC_REFLECT( bts::blockchain::vote_del, (votes)(delegate_id) )
 FC_REFLECT( bts::blockchain::fee_index, (_fees)(_trx) )
+FC_REFLECT( bts::blockchain::delegate_slot_index, (delegate_id)(start_time) )
+FC_REFLECT( bts::blockchain::undo_state_record, (block_id)(compressed)(uncompressed_size)(packed_state) )
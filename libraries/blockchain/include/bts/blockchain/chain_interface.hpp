@@ -35,7 +35,8 @@ namespace bts { namespace blockchain {
       confirmation_requirement = 6,
       database_version         = 7, // database version, to know when we need to upgrade
       dirty_markets            = 8,
-      last_feed_id             = 9 // used for allocating new data feeds
+      last_feed_id             = 9, // used for allocating new data feeds
+      head_block_id            = 10 // written with the index changes of each block, to repair raw_chain after a crash
    };
    typedef uint32_t chain_property_type;
 
@@ -198,4 +199,5 @@ FC_REFLECT_ENUM( bts::blockchain::chain_property_enum,
                  (database_version)
                  (dirty_markets)
                  (last_feed_id)
+                 (head_block_id)
                  )
@@ -16,3 +16,12 @@ const static std::map<uint32_t, bts::blockchain::block_id_type> CHECKPOINT_BLOCK
     { 900000, bts::blockchain::block_id_type( "a78e09bf1fd13bcd7b0959bc0764fe45db0a652d" ) },
     { 975000, bts::blockchain::block_id_type( "8494035ea5007de523c96cd0075b234130b83f9b" ) }
 };
+
+/**
+ * Digests of state snapshots (see chain_database::export_snapshot) taken at the
+ * given block numbers.  A node will only bootstrap from a snapshot whose digest
+ * is listed here, unless the operator explicitly trusts the snapshot.
+ */
+const static std::map<uint32_t, fc::sha256> CHECKPOINT_SNAPSHOTS
+{
+};
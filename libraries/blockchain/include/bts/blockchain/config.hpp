@@ -11,7 +11,8 @@
  *  @brief Defines global constants that determine blockchain behavior
  */
 #define BTS_BLOCKCHAIN_VERSION                              109
-#define BTS_BLOCKCHAIN_DATABASE_VERSION                     160
+#define BTS_BLOCKCHAIN_DATABASE_VERSION                     161
+#define BTS_BLOCKCHAIN_SNAPSHOT_FORMAT_VERSION              2 // 2: keys in their memcmp encoding
 
 /**
  *  The address prepended to string representation of
@@ -40,6 +41,32 @@
 #define BTS_BLOCKCHAIN_MIN_FEEDS                            ((BTS_BLOCKCHAIN_NUM_DELEGATES/2) + 1)
 #define BTS_BLOCKCHAIN_MAX_UNDO_HISTORY                     (BTS_BLOCKCHAIN_NUM_DELEGATES*4)
 
+/**
+ * The number of most recent block production slots over which per-delegate participation is counted
+ */
+#define BTS_BLOCKCHAIN_PARTICIPATION_WINDOW_SLOTS           (BTS_BLOCKCHAIN_NUM_DELEGATES*10)
+
+/**
+ * Bits per key of the bloom filter given to databases that are mostly read by point lookups
+ */
+#define BTS_BLOCKCHAIN_DEFAULT_BLOOM_FILTER_BITS            10
+
+/**
+ * The number of recently applied blocks whose evaluated state changes and signee are kept in
+ * memory so that switching back to their fork replays them instead of re-evaluating them
+ */
+#define BTS_BLOCKCHAIN_APPLIED_BLOCK_CACHE_SIZE             (BTS_BLOCKCHAIN_NUM_DELEGATES*2)
+
+/**
+ * The number of decoded asset or balance records kept in memory while the head block stays the same
+ */
+#define BTS_BLOCKCHAIN_RECORD_CACHE_SIZE                    10000
+
+/**
+ * The number of public keys recovered from transaction signatures that are remembered, see signature_cache
+ */
+#define BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE                 100000
+
 #define BTS_BLOCKCHAIN_ENABLE_NEGATIVE_VOTES                false
 
 #define BTS_MAX_DELEGATE_PAY_PER_BLOCK                      int64_t( 50 * BTS_BLOCKCHAIN_PRECISION ) // 50 XTS
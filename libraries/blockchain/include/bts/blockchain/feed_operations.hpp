@@ -2,6 +2,7 @@
 
 #include <bts/blockchain/operations.hpp>
 #include <bts/blockchain/types.hpp>
+#include <bts/db/key_encoding.hpp>
 
 namespace bts { namespace blockchain {
 
@@ -60,6 +61,8 @@ namespace bts { namespace blockchain {
 } } // bts::blockchain
 
 FC_REFLECT( bts::blockchain::feed_index, (feed_id)(delegate_id) )
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::feed_index, (feed_id)(delegate_id) )
 FC_REFLECT( bts::blockchain::feed_record, (feed)(value)(last_update) )
 FC_REFLECT( bts::blockchain::feed_entry, (delegate_name)(price)(last_update)(asset_symbol)(median_price) );
 FC_REFLECT( bts::blockchain::update_feed_operation, (feed)(value) )
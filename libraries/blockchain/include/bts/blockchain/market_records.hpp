@@ -3,6 +3,7 @@
 #include <bts/blockchain/asset.hpp>
 #include <bts/blockchain/config.hpp>
 #include <bts/blockchain/types.hpp>
+#include <bts/db/key_encoding.hpp>
 
 #include <fc/exception/exception.hpp>
 #include <fc/io/enum_type.hpp>
@@ -294,3 +295,6 @@ FC_REFLECT( bts::blockchain::market_transaction,
             (fees_collected)
           )
 FC_REFLECT_DERIVED( bts::blockchain::order_history_record, (bts::blockchain::market_transaction), (timestamp) )
+
+BTS_DB_MEMCMP_KEY( bts::blockchain::market_index_key, (order_price)(owner) )
+BTS_DB_MEMCMP_KEY( bts::blockchain::market_history_key, (base_id)(quote_id)(granularity)(timestamp) )
@@ -2,6 +2,9 @@
 
 #include <bts/blockchain/exceptions.hpp>
 #include <bts/blockchain/operations.hpp>
+#include <bts/db/table_stats.hpp>
+
+#include <map>
 
 namespace bts { namespace blockchain {
 
@@ -65,9 +68,18 @@ namespace bts { namespace blockchain {
              auto itr = _converters.find( uint8_t(op.type) );
              if( itr == _converters.end() )
                 FC_THROW_EXCEPTION( bts::blockchain::unsupported_chain_operation, "", ("op",op) );
+             bts::db::scoped_latency_timer timer( bts::db::table_stats_enabled() ? &_evaluation_latency[ op.type.value ] : nullptr );
              itr->second->evaluate( eval_state, op );
           }
 
+          /** @return how long evaluating each type of operation took while database metrics were enabled */
+          std::map<std::string, bts::db::latency_histogram> get_evaluation_latency()const;
+          void                                              reset_evaluation_latency()
+          {
+             for( auto& item : _evaluation_latency )
+                item.second.reset();
+          }
+
           /// defined in operations.cpp
           void to_variant( const bts::blockchain::operation& in, fc::variant& output );
           /// defined in operations.cpp
@@ -75,6 +87,7 @@ namespace bts { namespace blockchain {
 
        private:
           std::unordered_map<int, std::shared_ptr<operation_converter_base> > _converters;
+          std::map<uint8_t, bts::db::latency_histogram>                       _evaluation_latency;
    };
 
 } } // bts::blockchain 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <map>
+
+namespace bts { namespace blockchain {
+
+   struct record_cache_stats
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t invalidations = 0;
+      /** times the cache was emptied because it reached its capacity */
+      uint64_t overflows = 0;
+      uint32_t size = 0;
+      uint32_t capacity = 0;
+   };
+
+   /**
+    *  Decoded records read from the chain database, including those found to be absent, so that
+    *  repeated lookups of the same record while evaluating a block do not go back to LevelDB.  The
+    *  owner must invalidate a key whenever its record is stored, and clears the cache when the head
+    *  block changes so that it never holds more than one block's working set.
+    */
+   template<typename Key, typename Record>
+   class record_cache
+   {
+      public:
+         record_cache( uint32_t capacity ):_capacity( capacity ){}
+
+         /** @return the cached lookup of key, or nullptr if it has to be read from the database */
+         const fc::optional<Record>* find( const Key& key )
+         {
+            const auto itr = _records.find( key );
+            if( itr == _records.end() )
+            {
+               ++_stats.misses;
+               return nullptr;
+            }
+            ++_stats.hits;
+            return &itr->second;
+         }
+
+         void insert( const Key& key, const fc::optional<Record>& record )
+         {
+            if( _records.size() >= _capacity )
+            {
+               ++_stats.overflows;
+               _records.clear();
+            }
+            _records[ key ] = record;
+         }
+
+         void invalidate( const Key& key )
+         {
+            if( _records.erase( key ) )
+               ++_stats.invalidations;
+         }
+
+         void clear() { _records.clear(); }
+
+         record_cache_stats get_stats()const
+         {
+            record_cache_stats stats = _stats;
+            stats.size = _records.size();
+            stats.capacity = _capacity;
+            return stats;
+         }
+         void reset_stats() { _stats = record_cache_stats(); }
+
+      private:
+         uint32_t                                     _capacity;
+         std::map<Key, fc::optional<Record>>          _records;
+         record_cache_stats                           _stats;
+   };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::record_cache_stats, (hits)(misses)(invalidations)(overflows)(size)(capacity) )
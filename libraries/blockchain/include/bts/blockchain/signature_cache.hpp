@@ -0,0 +1,47 @@
+#pragma once
+
+#include <bts/blockchain/types.hpp>
+
+#include <fc/reflect/reflect.hpp>
+
+namespace bts { namespace blockchain {
+
+   struct signature_cache_stats
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint32_t size = 0;
+      uint32_t capacity = 0;
+   };
+
+   /**
+    *  Public keys recovered from transaction signatures.  Recovering a key is by far the most expensive
+    *  part of evaluating a transaction, and the same transaction is evaluated when it reaches the
+    *  mempool, every time pending transactions are revalidated, when a delegate generates a block
+    *  with it and when that block is applied, so each signature is only recovered the first time.
+    *
+    *  Only the pending transaction paths add keys; applying a block only looks them up, so that
+    *  syncing or replaying a chain does not push the mempool's keys out of the cache.
+    *
+    *  The cache is shared by every chain in the process and may be used from any thread.  The oldest
+    *  keys are dropped once it holds BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE of them.
+    */
+   namespace signature_cache
+   {
+      enum class cache_mode
+      {
+         lookup_only,   ///< use a cached key if there is one, but do not cache a newly recovered key
+         insert_on_miss ///< cache any key that has to be recovered
+      };
+
+      /** @return the key that produced sig for digest, throwing like fc::ecc::public_key if there is none */
+      fc::ecc::public_key_data recover_key( const signature_type& sig, const digest_type& digest, cache_mode mode );
+
+      signature_cache_stats    get_stats();
+      void                     reset_stats();
+      void                     clear();
+   }
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::signature_cache_stats, (hits)(misses)(size)(capacity) )
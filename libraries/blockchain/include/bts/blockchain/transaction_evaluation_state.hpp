@@ -130,6 +130,8 @@ namespace bts { namespace blockchain {
          chain_interface*                           _current_state;
          digest_type                                _chain_id;
          bool                                       _skip_signature_check = false;
+         /** set for pending transactions, whose recovered keys are worth keeping in the signature_cache */
+         bool                                       _cache_recovered_keys = false;
 
          uint32_t                                   _current_op_index = 0;
    };
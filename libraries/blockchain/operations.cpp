@@ -93,6 +93,14 @@ namespace bts { namespace blockchain {
       converter_itr->second->to_variant( in, output );
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   std::map<std::string, bts::db::latency_histogram> operation_factory::get_evaluation_latency()const
+   {
+      std::map<std::string, bts::db::latency_histogram> latency;
+      for( const auto& item : _evaluation_latency )
+         latency[ fc::reflector<operation_type_enum>::to_string( operation_type_enum( item.first ) ) ] = item.second;
+      return latency;
+   }
+
    void operation_factory::from_variant( const fc::variant& in, bts::blockchain::operation& output )
    { try {
       auto obj = in.get_object();
@@ -0,0 +1,110 @@
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/signature_cache.hpp>
+
+#include <fc/crypto/sha256.hpp>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace bts { namespace blockchain { namespace signature_cache {
+
+   namespace
+   {
+      struct cache_state
+      {
+         std::mutex                                       mutex;
+         /** keyed by a hash of the digest and the signature, so that entries are small and fixed size */
+         std::map<fc::sha256, fc::ecc::public_key_data>   keys;
+         std::deque<fc::sha256>                           insertion_order;
+         /** lets lookups skip hashing and locking while nothing has been cached, e.g. during a reindex */
+         std::atomic<size_t>                              size{ 0 };
+         std::atomic<uint64_t>                            hits{ 0 };
+         std::atomic<uint64_t>                            misses{ 0 };
+      };
+
+      cache_state& state()
+      {
+         static cache_state cache;
+         return cache;
+      }
+
+      fc::sha256 cache_key( const signature_type& sig, const digest_type& digest )
+      {
+         fc::sha256::encoder enc;
+         enc.write( digest.data(), digest.data_size() );
+         enc.write( (const char*)sig.begin(), sig.size() );
+         return enc.result();
+      }
+   }
+
+   fc::ecc::public_key_data recover_key( const signature_type& sig, const digest_type& digest, cache_mode mode )
+   {
+      cache_state& cache = state();
+      if( mode == cache_mode::lookup_only && cache.size == 0 )
+      {
+         ++cache.misses;
+         return fc::ecc::public_key( sig, digest ).serialize();
+      }
+
+      const fc::sha256 key = cache_key( sig, digest );
+      {
+         std::lock_guard<std::mutex> lock( cache.mutex );
+         const auto itr = cache.keys.find( key );
+         if( itr != cache.keys.end() )
+         {
+            ++cache.hits;
+            return itr->second;
+         }
+      }
+      ++cache.misses;
+
+      // recover outside of the lock so that other threads are not held up
+      const fc::ecc::public_key_data recovered = fc::ecc::public_key( sig, digest ).serialize();
+      if( mode == cache_mode::lookup_only )
+         return recovered;
+
+      std::lock_guard<std::mutex> lock( cache.mutex );
+      if( cache.keys.emplace( key, recovered ).second )
+      {
+         cache.insertion_order.push_back( key );
+         while( cache.insertion_order.size() > BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE )
+         {
+            cache.keys.erase( cache.insertion_order.front() );
+            cache.insertion_order.pop_front();
+         }
+         cache.size = cache.keys.size();
+      }
+      return recovered;
+   }
+
+   signature_cache_stats get_stats()
+   {
+      cache_state& cache = state();
+      std::lock_guard<std::mutex> lock( cache.mutex );
+      signature_cache_stats stats;
+      stats.hits = cache.hits;
+      stats.misses = cache.misses;
+      stats.size = cache.keys.size();
+      stats.capacity = BTS_BLOCKCHAIN_SIGNATURE_CACHE_SIZE;
+      return stats;
+   }
+
+   void reset_stats()
+   {
+      cache_state& cache = state();
+      cache.hits = 0;
+      cache.misses = 0;
+   }
+
+   void clear()
+   {
+      cache_state& cache = state();
+      std::lock_guard<std::mutex> lock( cache.mutex );
+      cache.keys.clear();
+      cache.insertion_order.clear();
+      cache.size = 0;
+   }
+
+} } } // bts::blockchain::signature_cache
@@ -1,5 +1,6 @@
 #include <bts/blockchain/chain_interface.hpp>
 #include <bts/blockchain/operation_factory.hpp>
+#include <bts/blockchain/signature_cache.hpp>
 #include <bts/blockchain/transaction_evaluation_state.hpp>
 
 #include <bts/blockchain/fork_blocks.hpp>
@@ -201,7 +202,9 @@ namespace bts { namespace blockchain {
            auto digest = trx_arg.digest( _chain_id );
            for( const auto& sig : trx.signatures )
            {
-              auto key = fc::ecc::public_key( sig, digest ).serialize();
+              auto key = signature_cache::recover_key( sig, digest, _cache_recovered_keys
+                                                       ? signature_cache::cache_mode::insert_on_miss
+                                                       : signature_cache::cache_mode::lookup_only );
               signed_keys.insert( address(key) );
               signed_keys.insert( address(pts_address(key,false,56) ) );
               signed_keys.insert( address(pts_address(key,true,56) )  );
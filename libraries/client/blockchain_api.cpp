@@ -474,6 +474,23 @@ vector<slot_record> client_impl::blockchain_get_delegate_slot_records( const str
    return _chain_db->get_delegate_slot_records( delegate_record->id, start_block_num, count );
 }
 
+fc::variant_object client_impl::blockchain_get_database_metrics()const
+{
+   return _chain_db->get_metrics();
+}
+
+void client_impl::blockchain_reset_database_metrics()
+{
+   _chain_db->reset_metrics();
+}
+
+delegate_participation_record client_impl::blockchain_get_delegate_participation( const string& delegate_name )const
+{
+   const auto delegate_record = _chain_db->get_account_record( delegate_name );
+   FC_ASSERT( delegate_record.valid() && delegate_record->is_delegate(), "${n} is not a delegate!", ("n",delegate_name) );
+   return _chain_db->get_delegate_participation( delegate_record->id );
+}
+
 string client_impl::blockchain_get_block_signee( const string& block )const
 {
    if( block.size() == 40 )
@@ -508,9 +525,14 @@ bool client_impl::blockchain_verify_signature(const string& signer, const fc::sh
     }
 }
 
-void client_impl::blockchain_dump_state( const string& path )const
+void client_impl::blockchain_dump_state( const string& path, const string& format )const
+{
+   _chain_db->dump_state( fc::path( path ), format );
+}
+
+fc::sha256 client_impl::blockchain_export_snapshot( const string& path )
 {
-   _chain_db->dump_state( fc::path( path ) );
+   return _chain_db->export_snapshot( fc::path( path ) );
 }
 
 vector<bts::blockchain::api_market_status> client_impl::blockchain_list_markets()const
@@ -97,13 +97,16 @@ program_options::variables_map parse_option_variables(int argc, char** argv)
          ("data-dir", program_options::value<string>(), "Set client data directory")
 
          ("genesis-config", program_options::value<string>(),
-          "Generate a genesis state with the given JSON file instead of using the built-in "
-          "genesis block (only accepted when the blockchain is empty)")
+          "Generate a genesis state with the given JSON file, or .dat image from bts_genesis_to_bin, instead of using the "
+          "built-in genesis block (only accepted when the blockchain is empty)")
 
          ("rebuild-index", "Same as --resync-blockchain, except it preserves the raw blockchain data rather "
                            "than downloading a new copy")
          ("resync-blockchain", "Delete our copy of the blockchain at startup and download a "
                                "fresh copy of the entire blockchain from the network")
+         ("bootstrap-snapshot", program_options::value<string>(),
+          "Initialize an empty blockchain from the given state snapshot and only sync blocks after it")
+         ("trust-snapshot", "Accept a --bootstrap-snapshot even if its digest is not in the list of known checkpoints")
 
          ("p2p-port", program_options::value<uint16_t>(), "Set network port to listen on")
          ("accept-incoming-connections", program_options::value<bool>()->default_value(true), "Set to false to reject incoming p2p connections and only establish outbound connections")
@@ -407,6 +410,10 @@ void load_and_configure_chain_database( const fc::path& datadir,
       }
       else if (option_variables.count("rebuild-index"))
       {
+         const auto snapshot_base = chain_database::get_snapshot_base(datadir / "chain");
+         FC_ASSERT(!snapshot_base.valid(), "This blockchain was bootstrapped from a snapshot at block ${num}, so --rebuild-index "
+                   "cannot replay it from genesis; use --resync-blockchain with --bootstrap-snapshot instead",
+                   ("num",snapshot_base->block_num));
          std::cout << "Clearing database index\n";
          try
          {
@@ -566,6 +573,7 @@ void client_impl::start_delegate_loop()
    if (!_time_discontinuity_connection.connected())
       _time_discontinuity_connection = bts::blockchain::time_discontinuity_signal.connect([=](){ reschedule_delegate_loop(); });
    _delegate_loop_complete = fc::async( [=](){ delegate_loop(); }, "delegate_loop" );
+   start_block_template_loop();
 }
 
 void client_impl::cancel_delegate_loop()
@@ -580,6 +588,7 @@ void client_impl::cancel_delegate_loop()
    {
       wlog( "Unexpected exception thrown from delegate_loop(): ${e}", ("e",e.to_detail_string() ) );
    }
+   cancel_block_template_loop();
 }
 
 void client_impl::delegate_loop()
@@ -663,6 +672,54 @@ void client_impl::delegate_loop()
       _delegate_loop_complete = fc::schedule( [=](){ delegate_loop(); }, scheduled_time, "delegate_loop" );
 }
 
+void client_impl::start_block_template_loop()
+{
+   if( !_block_template_loop_done.valid() || _block_template_loop_done.ready() )
+      _block_template_loop_done = fc::async( [=](){ block_template_loop(); }, "block_template" );
+}
+
+void client_impl::cancel_block_template_loop()
+{
+   try
+   {
+      _block_template_loop_done.cancel_and_wait(__FUNCTION__);
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Unexpected exception thrown from block_template_loop(): ${e}", ("e",e.to_detail_string() ) );
+   }
+}
+
+// Keeps the block our next delegate slot would produce assembled ahead of time, see chain_database::update_block_template
+void client_impl::block_template_loop()
+{
+   try
+   {
+      if( !_sync_mode && _wallet->is_open() && _wallet->is_unlocked() )
+      {
+         const vector<wallet_account_record> enabled_delegates = _wallet->get_my_delegates( enabled_delegate_status );
+         if( !enabled_delegates.empty() )
+         {
+            const auto next_block_time = _wallet->get_next_producible_block_timestamp( enabled_delegates );
+            if( next_block_time.valid() && *next_block_time > blockchain::now() )
+               _chain_db->update_block_template( *next_block_time );
+         }
+      }
+   }
+   catch( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Error updating block template: ${e}", ("e",e.to_detail_string()) );
+   }
+
+   if( !_block_template_loop_done.canceled() )
+      _block_template_loop_done = fc::schedule( [=](){ block_template_loop(); },
+                                                fc::time_point::now() + fc::seconds( 1 ), "block_template" );
+}
+
 void client_impl::set_target_connections( uint32_t target )
 {
    auto params = fc::mutable_variant_object();
@@ -1229,6 +1286,80 @@ void client_impl::blocks_too_old_monitor_task()
       "block_monitor_task");
 }
 
+/** Logs one line summarizing where block processing time went since the last time it was called */
+void client_impl::configure_chain_database( chain_database& chain_db )const
+{
+   chain_db.set_unified_index_storage( _config.unified_chain_index, size_t( _config.chain_index_cache_size_mb ) * 1024 * 1024 );
+   chain_db.set_database_options( _config.chain_database_options );
+}
+
+void client_impl::database_metrics_log_task()
+{
+   try
+   {
+      // the metrics are also read and reset through the api, so this only logs the change since last time
+      const auto metrics = _chain_db->get_metrics();
+      // a total smaller than last time means someone reset the metrics in between
+      const auto since_last_time = []( uint64_t total, uint64_t last_total ) { return total >= last_total ? total - last_total : total; };
+
+      const auto phases = metrics["extend_chain_phases"].as<std::map<std::string, bts::db::latency_histogram>>();
+      std::string phase_summary;
+      for( const auto& phase : phases )
+      {
+         auto& logged = _logged_phase_count_and_usec[ phase.first ];
+         const uint64_t count = since_last_time( phase.second.count, logged.first );
+         const uint64_t usec = count ? since_last_time( phase.second.total_usec, logged.second ) : 0;
+         logged = std::make_pair( phase.second.count, phase.second.total_usec );
+         if( count == 0 ) continue;
+         phase_summary += " " + phase.first + "=" + fc::to_string( usec / count ) + "us";
+      }
+
+      std::vector<std::pair<uint64_t, std::string>> tables;
+      for( const auto& table : metrics["tables"].get_object() )
+      {
+         const auto stats = table.value().as<bts::db::table_stats>();
+         const uint64_t usec = stats.read_latency.total_usec + stats.write_latency.total_usec;
+         auto& logged = _logged_table_usec[ table.key() ];
+         tables.emplace_back( since_last_time( usec, logged ), table.key() );
+         logged = usec;
+      }
+      std::sort( tables.rbegin(), tables.rend() );
+      if( tables.size() > 5 ) tables.resize( 5 );
+      std::string table_summary;
+      for( const auto& table : tables )
+         table_summary += " " + table.second + "=" + fc::to_string( table.first / 1000 ) + "ms";
+
+      ilog( "database metrics: average block phase times:${phases}; busiest tables:${tables}",
+            ("phases",phase_summary)("tables",table_summary) );
+   }
+   catch( const fc::canceled_exception& )
+   {
+      throw;
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Error logging database metrics: ${e}", ("e",e.to_detail_string()) );
+   }
+
+   if( !_database_metrics_log_done.canceled() )
+      _database_metrics_log_done = fc::schedule( [=](){ database_metrics_log_task(); },
+                                                 fc::time_point::now() + fc::seconds( _config.database_metrics_log_interval_sec ),
+                                                 "database_metrics_log_task" );
+}
+
+void client_impl::cancel_database_metrics_log_task()
+{
+   try
+   {
+      if( _database_metrics_log_done.valid() )
+         _database_metrics_log_done.cancel_and_wait( __FUNCTION__ );
+   }
+   catch( const fc::exception& e )
+   {
+      wlog( "Unexpected exception thrown while canceling database_metrics_log_task(): ${e}", ("e",e.to_detail_string() ) );
+   }
+}
+
 void client_impl::cancel_blocks_too_old_monitor_task()
 {
    try
@@ -1309,6 +1440,26 @@ void client::open( const path& data_dir, fc::optional<fc::path> genesis_file_pat
          //FIXME: is it really correct to continue here without rethrowing?
       }
 
+      my->configure_chain_database( *my->_chain_db );
+
+      if( my->_bootstrap_snapshot_file.valid() )
+      {
+         if( fc::exists( data_dir / "chain/index" ) || fc::exists( data_dir / "chain/raw_chain" ) )
+         {
+            std::cout << "Ignoring --bootstrap-snapshot because the blockchain is not empty\n";
+         }
+         else
+         {
+            // the snapshot must be written in the index layout the chain database is about to be opened with
+            std::cout << "Bootstrapping blockchain from snapshot: " << my->_bootstrap_snapshot_file->preferred_string() << "\n";
+            auto importing_chain_db = std::make_shared<chain_database>();
+            my->configure_chain_database( *importing_chain_db );
+            const auto header = importing_chain_db->import_snapshot( data_dir / "chain", *my->_bootstrap_snapshot_file,
+                                                                     my->_trust_bootstrap_snapshot );
+            std::cout << "Blockchain state restored as of block " << header.block_num << "\n";
+         }
+      }
+
       bool attempt_to_recover_database = false;
       try
       {
@@ -1335,13 +1486,22 @@ void client::open( const path& data_dir, fc::optional<fc::path> genesis_file_pat
          my->_chain_db->open(data_dir / "chain", genesis_file_path, reindex_status_callback);
       }
 
+      if( my->_config.enable_database_metrics )
+      {
+         my->_chain_db->enable_metrics( true );
+         if( my->_config.database_metrics_log_interval_sec > 0 )
+            my->_database_metrics_log_done = fc::schedule( [=](){ my->database_metrics_log_task(); },
+                                                           fc::time_point::now() + fc::seconds( my->_config.database_metrics_log_interval_sec ),
+                                                           "database_metrics_log_task" );
+      }
+
       my->_wallet = std::make_shared<bts::wallet::wallet>( my->_chain_db, my->_config.wallet_enabled );
       my->_wallet->set_data_directory( data_dir / "wallets" );
 
       if (my->_config.mail_server_enabled)
       {
          my->_mail_server = std::make_shared<bts::mail::server>();
-         my->_mail_server->open( data_dir / "mail" );
+         my->_mail_server->open( data_dir / "mail", my->_config.mail_server_retention_days );
       }
       my->_mail_client = std::make_shared<bts::mail::client>(my->_wallet, my->_chain_db);
       my->_mail_client->open( data_dir / "mail_client" );
@@ -1479,6 +1639,12 @@ void client::configure_from_command_line(int argc, char** argv)
    // TODO: rename it to smething better
    load_and_configure_chain_database(datadir, option_variables);
 
+   if (option_variables.count("bootstrap-snapshot"))
+   {
+      my->_bootstrap_snapshot_file = fc::path(option_variables["bootstrap-snapshot"].as<string>());
+      my->_trust_bootstrap_snapshot = option_variables.count("trust-snapshot") != 0;
+   }
+
    fc::optional<fc::path> genesis_file_path;
    if (option_variables.count("genesis-config"))
       genesis_file_path = option_variables["genesis-config"].as<string>();
@@ -8,6 +8,7 @@
 #include <fc/thread/thread.hpp>
 #include <fc/log/logger_config.hpp>
 #include <memory>
+#include <set>
 #include <boost/program_options.hpp>
 
 
@@ -40,7 +41,10 @@ namespace bts { namespace client {
       : enable(false),
         rpc_endpoint(fc::ip::endpoint::from_string("127.0.0.1:0")),
         httpd_endpoint(fc::ip::endpoint::from_string("127.0.0.1:0")),
-        htdocs("./htdocs")
+        htdocs("./htdocs"),
+        cached_methods{ "blockchain_list_markets", "blockchain_market_order_book", "blockchain_market_status",
+                        "blockchain_list_delegates" },
+        response_cache_size(1000)
       {}
 
       bool             enable;
@@ -49,6 +53,10 @@ namespace bts { namespace client {
       fc::ip::endpoint rpc_endpoint;
       fc::ip::endpoint httpd_endpoint;
       fc::path         htdocs;
+      /** read-only methods whose HTTP responses are reused until the head block changes, so their results must not depend on the time */
+      std::set<std::string> cached_methods;
+      /** the most responses kept for distinct method and parameter combinations, 0 disables the cache */
+      uint32_t         response_cache_size;
 
       bool is_valid() const; /* Currently just checks if rpc port is set */
     };
@@ -90,6 +98,11 @@ namespace bts { namespace client {
                   "188.226.195.137:60696"
                   }),
           mail_server_enabled(false),
+          mail_server_retention_days(BTS_MAIL_DEFAULT_RETENTION_DAYS),
+          unified_chain_index(false),
+          chain_index_cache_size_mb(64),
+          enable_database_metrics(false),
+          database_metrics_log_interval_sec(300),
           wallet_enabled(true),
           ignore_console(false),
           use_upnp(true),
@@ -105,6 +118,13 @@ namespace bts { namespace client {
           vector<string>      chain_servers;
           chain_server_config chain_server;
           bool                mail_server_enabled;
+          uint32_t            mail_server_retention_days;
+          bool                unified_chain_index;
+          uint32_t            chain_index_cache_size_mb;
+          /** LevelDB options by chain database directory name, e.g. "balance_db", or "default" */
+          std::map<std::string, bts::db::level_options> chain_database_options;
+          bool                enable_database_metrics;
+          uint32_t            database_metrics_log_interval_sec;
           bool                wallet_enabled;
           bool                ignore_console;
           bool                use_upnp;
@@ -205,10 +225,11 @@ namespace bts { namespace client {
 extern const std::string BTS_MESSAGE_MAGIC;
 
 FC_REFLECT(bts::client::client_notification, (timestamp)(message)(signature) )
-FC_REFLECT( bts::client::rpc_server_config, (enable)(rpc_user)(rpc_password)(rpc_endpoint)(httpd_endpoint)(htdocs) )
+FC_REFLECT( bts::client::rpc_server_config, (enable)(rpc_user)(rpc_password)(rpc_endpoint)(httpd_endpoint)(htdocs)(cached_methods)(response_cache_size) )
 FC_REFLECT( bts::client::chain_server_config, (enabled)(listen_port) )
 FC_REFLECT( bts::client::config,
-            (rpc)(default_peers)(chain_servers)(chain_server)(mail_server_enabled)
+            (rpc)(default_peers)(chain_servers)(chain_server)(mail_server_enabled)(mail_server_retention_days)
+            (unified_chain_index)(chain_index_cache_size_mb)(chain_database_options)(enable_database_metrics)(database_metrics_log_interval_sec)
             (wallet_enabled)(ignore_console)(logging)
             (delegate_server)
             (default_delegate_peers)
@@ -150,7 +150,9 @@ public:
    virtual ~client_impl() override
    {
       cancel_blocks_too_old_monitor_task();
+      cancel_database_metrics_log_task();
       cancel_rebroadcast_pending_loop();
+      cancel_block_template_loop();
       if( _chain_downloader_future.valid() && !_chain_downloader_future.ready() )
          _chain_downloader_future.cancel_and_wait(__FUNCTION__);
       _rpc_server.reset(); // this needs to shut down before the _p2p_node because several RPC requests will try to dereference _p2p_node.  Shutting down _rpc_server kills all active/pending requests
@@ -185,6 +187,11 @@ public:
    void delegate_loop();
    void set_target_connections( uint32_t target );
 
+   void start_block_template_loop();
+   void cancel_block_template_loop();
+   void block_template_loop();
+   fc::future<void> _block_template_loop_done;
+
    void start_rebroadcast_pending_loop();
    void cancel_rebroadcast_pending_loop();
    void rebroadcast_pending_loop();
@@ -202,6 +209,10 @@ public:
    bool on_new_transaction(const signed_transaction& trx);
    void blocks_too_old_monitor_task();
    void cancel_blocks_too_old_monitor_task();
+   /** applies the configured index layout and LevelDB options, which must be set before the database is opened */
+   void configure_chain_database( chain_database& chain_db )const;
+   void database_metrics_log_task();
+   void cancel_database_metrics_log_task();
 
    /* Implement node_delegate */
    // @{
@@ -244,6 +255,9 @@ public:
    std::unique_ptr<TeeDevice>                              _tee_device;
    std::unique_ptr<TeeStream>                              _tee_stream;
    bool                                                    _enable_ulog = false;
+   /** set by --bootstrap-snapshot; imported by open() once the chain database's storage options are known */
+   fc::optional<fc::path>                                  _bootstrap_snapshot_file;
+   bool                                                    _trust_bootstrap_snapshot = false;
 
    fc::path                                                _data_dir;
 
@@ -290,6 +304,10 @@ public:
    bts::net::node_ptr                                      _p2p_node = nullptr;
    bts_gntp_notifier_ptr                                   _notifier;
    fc::future<void>                                        _blocks_too_old_monitor_done;
+   fc::future<void>                                        _database_metrics_log_done;
+   /** totals seen by the previous database_metrics_log_task, which logs what changed since then */
+   std::map<std::string, std::pair<uint64_t, uint64_t>>   _logged_phase_count_and_usec;
+   std::map<std::string, uint64_t>                         _logged_table_usec;
 
    const unsigned                                          _blockchain_synopsis_size_limit;
 
@@ -18,6 +18,31 @@ namespace bts { namespace db {
               _cache[itr.key()]  = itr.value();
          }
 
+         void open( const fc::path& dir, const level_options& options, bool flush_on_store = true )
+         {
+           _flush_on_store = flush_on_store;
+           _db.open( dir, options );
+           for( auto itr = _db.begin(); itr.valid(); ++itr )
+              _cache[itr.key()]  = itr.value();
+         }
+
+         void open( shared_level_database& shared_db, const std::string& table_name, bool flush_on_store = true )
+         {
+           _flush_on_store = flush_on_store;
+           _db.open( shared_db, table_name );
+           for( auto itr = _db.begin(); itr.valid(); ++itr )
+              _cache[itr.key()]  = itr.value();
+           // writes in an aborted batch never reach the database, so the cache must forget them too
+           _shared_db = &shared_db;
+           _table_name = table_name;
+           _shared_db->set_abort_handler( _table_name, [this](){ reload_cache(); } );
+         }
+
+         const leveldb::Comparator* key_comparator()const
+         {
+           return _db.key_comparator();
+         }
+
          void close()
          {
             if(_pending_flush.valid() )
@@ -27,6 +52,11 @@ namespace bts { namespace db {
             _cache.clear();
             _dirty.clear();
             _dirty_remove.clear();
+            if( _shared_db != nullptr )
+            {
+               _shared_db->clear_abort_handler( _table_name );
+               _shared_db = nullptr;
+            }
             _db.close();
          }
 
@@ -57,6 +87,7 @@ namespace bts { namespace db {
         fc::optional<Value> fetch_optional( const Key& k )
         {
            auto itr = _cache.find(k);
+           record_cache_lookup( itr != _cache.end() );
            if( itr != _cache.end() ) return itr->second;
            return fc::optional<Value>();
         }
@@ -64,6 +95,7 @@ namespace bts { namespace db {
         Value fetch( const Key& key ) const
         { try {
            auto itr = _cache.find(key);
+           record_cache_lookup( itr != _cache.end() );
            if( itr != _cache.end() ) return itr->second;
            FC_CAPTURE_AND_THROW( fc::key_not_found_exception, (key) );
         } FC_CAPTURE_AND_RETHROW( (key) ) }
@@ -167,7 +199,9 @@ namespace bts { namespace db {
 
         iterator find( const Key& key )
         {
-           return iterator( _cache.find(key), _cache.begin(), _cache.end() );
+           auto itr = _cache.find(key);
+           record_cache_lookup( itr != _cache.end() );
+           return iterator( itr, _cache.begin(), _cache.end() );
         }
         iterator lower_bound( const Key& key )
         {
@@ -180,18 +214,92 @@ namespace bts { namespace db {
             _db.export_to_json( path );
         } FC_CAPTURE_AND_RETHROW( (path) ) }
 
+        void export_to_binary( const fc::path& path )const
+        { try {
+            _db.export_to_binary( path );
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        void export_to_json_lines( const fc::path& path )const
+        { try {
+            _db.export_to_json_lines( path );
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        uint64_t import_from_binary( const fc::path& path )
+        { try {
+            const uint64_t count = _db.import_from_binary( path );
+            reload_cache();
+            return count;
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        uint64_t import_from_json_lines( const fc::path& path )
+        { try {
+            const uint64_t count = _db.import_from_json_lines( path );
+            reload_cache();
+            return count;
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        uint64_t export_raw( std::ostream& out, fc::sha256::encoder& digest )
+        { try {
+            if( _pending_flush.valid() )
+               _pending_flush.wait();
+            flush();
+            return _db.export_raw( out, digest );
+        } FC_CAPTURE_AND_RETHROW() }
+
+        uint64_t import_raw( std::istream& in, fc::sha256::encoder& digest )
+        { try {
+            const uint64_t count = _db.import_raw( in, digest );
+            reload_cache();
+            return count;
+        } FC_CAPTURE_AND_RETHROW() }
+
         size_t size() const
         {
           return _cache.size();
         }
 
+        /** @return the writes made to the underlying database along with the lookups served from the cache */
+        table_stats get_stats()const
+        {
+          table_stats stats = _db.get_stats();
+          stats.cache_hits = _cache_hits;
+          stats.cache_misses = _cache_misses;
+          return stats;
+        }
+        void reset_stats()
+        {
+          _db.reset_stats();
+          _cache_hits = 0;
+          _cache_misses = 0;
+        }
+
       private:
+        void record_cache_lookup( bool hit )const
+        {
+            if( !table_stats_enabled() ) return;
+            if( hit ) ++_cache_hits;
+            else ++_cache_misses;
+        }
+
+        void reload_cache()
+        {
+            _cache.clear();
+            _dirty.clear();
+            _dirty_remove.clear();
+            for( auto itr = _db.begin(); itr.valid(); ++itr )
+               _cache[itr.key()] = itr.value();
+        }
+
         CacheType                _cache;
         std::set<Key>            _dirty;
         std::set<Key>            _dirty_remove;
         level_map<Key,Value>     _db;
         bool                     _flush_on_store;
         fc::future<void>         _pending_flush;
+        shared_level_database*   _shared_db = nullptr;
+        std::string              _table_name;
+        mutable uint64_t         _cache_hits = 0;
+        mutable uint64_t         _cache_misses = 0;
    };
 
 } }
@@ -0,0 +1,250 @@
+#pragma once
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/io/datastream.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
+#include <fc/uint128.hpp>
+
+#include <boost/preprocessor/seq/for_each.hpp>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace bts { namespace db {
+
+  /**
+   *  Encodes keys of type T so that comparing the encoded bytes with memcmp orders them exactly as
+   *  operator< orders the keys.  A level_map whose key type has such an encoding stores its keys this
+   *  way and lets LevelDB use its default bytewise comparator, instead of unpacking both keys for every
+   *  comparison.
+   *
+   *  To give a key type an encoding, specialize memcmp_key with enabled = true and static encode and
+   *  decode functions, next to the definition of the type so that every level_map of it agrees.
+   *  Composite keys are encoded by concatenating the encodings of their members in the order
+   *  operator< compares them, which only works if each member's encoding is self-delimiting.
+   */
+  template<typename T, typename Enable = void>
+  struct memcmp_key
+  {
+     static const bool enabled = false;
+  };
+
+  namespace detail
+  {
+     template<typename Stream, typename T>
+     void write_big_endian( Stream& s, T value )
+     {
+        char buffer[sizeof(T)];
+        for( int i = int(sizeof(T)) - 1; i >= 0; --i )
+        {
+           buffer[i] = char( value & 0xff );
+           value = T( value >> 8 );
+        }
+        s.write( buffer, sizeof(T) );
+     }
+
+     template<typename T>
+     T read_big_endian( fc::datastream<const char*>& s )
+     {
+        char buffer[sizeof(T)];
+        s.read( buffer, sizeof(T) );
+        T value = 0;
+        for( size_t i = 0; i < sizeof(T); ++i )
+           value = T( ( value << 8 ) | uint8_t( buffer[i] ) );
+        return value;
+     }
+  }
+
+  template<typename T>
+  struct memcmp_key<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value
+                                               && !std::is_same<T, bool>::value>::type>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const T& v ) { detail::write_big_endian( s, v ); }
+     static void decode( fc::datastream<const char*>& s, T& v ) { v = detail::read_big_endian<T>( s ); }
+  };
+
+  /** two's complement with the sign bit flipped orders negative numbers first */
+  template<typename T>
+  struct memcmp_key<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+  {
+     typedef typename std::make_unsigned<T>::type unsigned_type;
+     static const unsigned_type sign_bit = unsigned_type( 1 ) << ( sizeof(T) * 8 - 1 );
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const T& v ) { detail::write_big_endian( s, unsigned_type( unsigned_type( v ) ^ sign_bit ) ); }
+     static void decode( fc::datastream<const char*>& s, T& v ) { v = T( detail::read_big_endian<unsigned_type>( s ) ^ sign_bit ); }
+  };
+
+  template<typename T>
+  struct memcmp_key<T, typename std::enable_if<std::is_enum<T>::value>::type>
+  {
+     typedef typename std::underlying_type<T>::type underlying_type;
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const T& v ) { memcmp_key<underlying_type>::encode( s, underlying_type( v ) ); }
+     static void decode( fc::datastream<const char*>& s, T& v )
+     {
+        underlying_type tmp;
+        memcmp_key<underlying_type>::decode( s, tmp );
+        v = T( tmp );
+     }
+  };
+
+  template<>
+  struct memcmp_key<fc::signed_int>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const fc::signed_int& v ) { memcmp_key<decltype(v.value)>::encode( s, v.value ); }
+     static void decode( fc::datastream<const char*>& s, fc::signed_int& v ) { memcmp_key<decltype(v.value)>::decode( s, v.value ); }
+  };
+
+  template<>
+  struct memcmp_key<fc::unsigned_int>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const fc::unsigned_int& v ) { memcmp_key<decltype(v.value)>::encode( s, v.value ); }
+     static void decode( fc::datastream<const char*>& s, fc::unsigned_int& v ) { memcmp_key<decltype(v.value)>::decode( s, v.value ); }
+  };
+
+  template<>
+  struct memcmp_key<fc::time_point_sec>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const fc::time_point_sec& v ) { memcmp_key<uint32_t>::encode( s, v.sec_since_epoch() ); }
+     static void decode( fc::datastream<const char*>& s, fc::time_point_sec& v )
+     {
+        uint32_t seconds;
+        memcmp_key<uint32_t>::decode( s, seconds );
+        v = fc::time_point_sec( seconds );
+     }
+  };
+
+  template<>
+  struct memcmp_key<fc::uint128>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const fc::uint128& v )
+     {
+        detail::write_big_endian( s, v.hi );
+        detail::write_big_endian( s, v.lo );
+     }
+     static void decode( fc::datastream<const char*>& s, fc::uint128& v )
+     {
+        const uint64_t hi = detail::read_big_endian<uint64_t>( s );
+        const uint64_t lo = detail::read_big_endian<uint64_t>( s );
+        v = fc::uint128( hi, lo );
+     }
+  };
+
+  /** hashes are already ordered by memcmp of their bytes */
+  template<typename T>
+  struct memcmp_key<T, typename std::enable_if<std::is_same<T, fc::ripemd160>::value || std::is_same<T, fc::sha256>::value>::type>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const T& v ) { s.write( v.data(), v.data_size() ); }
+     static void decode( fc::datastream<const char*>& s, T& v ) { s.read( v.data(), v.data_size() ); }
+  };
+
+  /**
+   *  Strings are terminated by "\0\x01" and embedded zeros are escaped as "\0\xff", so that a string
+   *  sorts before every longer string it is a prefix of and the encoding is self-delimiting.
+   */
+  template<>
+  struct memcmp_key<std::string>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const std::string& v )
+     {
+        size_t start = 0;
+        for( size_t zero = v.find( '\0' ); zero != std::string::npos; zero = v.find( '\0', start ) )
+        {
+           s.write( v.data() + start, zero - start );
+           s.write( "\0\xff", 2 );
+           start = zero + 1;
+        }
+        s.write( v.data() + start, v.size() - start );
+        s.write( "\0\x01", 2 );
+     }
+     static void decode( fc::datastream<const char*>& s, std::string& v )
+     {
+        v.clear();
+        char c;
+        while( true )
+        {
+           s.read( &c, 1 );
+           if( c != '\0' )
+           {
+              v.push_back( c );
+              continue;
+           }
+           s.read( &c, 1 );
+           if( c == '\x01' )
+              return;
+           FC_ASSERT( c == '\xff', "Invalid string key encoding" );
+           v.push_back( '\0' );
+        }
+     }
+  };
+
+  template<typename A, typename B>
+  struct memcmp_key<std::pair<A,B>, typename std::enable_if<memcmp_key<A>::enabled && memcmp_key<B>::enabled>::type>
+  {
+     static const bool enabled = true;
+
+     template<typename Stream>
+     static void encode( Stream& s, const std::pair<A,B>& v )
+     {
+        memcmp_key<A>::encode( s, v.first );
+        memcmp_key<B>::encode( s, v.second );
+     }
+     static void decode( fc::datastream<const char*>& s, std::pair<A,B>& v )
+     {
+        memcmp_key<A>::decode( s, v.first );
+        memcmp_key<B>::decode( s, v.second );
+     }
+  };
+
+} } // bts::db
+
+#define BTS_DB_MEMCMP_KEY_ENCODE_MEMBER( r, VALUE, MEMBER ) \
+   bts::db::memcmp_key<decltype(VALUE.MEMBER)>::encode( s, VALUE.MEMBER );
+
+#define BTS_DB_MEMCMP_KEY_DECODE_MEMBER( r, VALUE, MEMBER ) \
+   bts::db::memcmp_key<decltype(VALUE.MEMBER)>::decode( s, VALUE.MEMBER );
+
+/**
+ *  Gives a key type the memcmp_key encoding made of its MEMBERS, which must be listed in the order
+ *  operator< compares them and must themselves have memcmp_key encodings.  Like FC_REFLECT, this must
+ *  be used in the global namespace.
+ */
+#define BTS_DB_MEMCMP_KEY( TYPE, MEMBERS ) \
+namespace bts { namespace db { \
+   template<> \
+   struct memcmp_key<TYPE> \
+   { \
+      static const bool enabled = true; \
+      template<typename Stream> \
+      static void encode( Stream& s, const TYPE& v ) { BOOST_PP_SEQ_FOR_EACH( BTS_DB_MEMCMP_KEY_ENCODE_MEMBER, v, MEMBERS ) } \
+      static void decode( fc::datastream<const char*>& s, TYPE& v ) { BOOST_PP_SEQ_FOR_EACH( BTS_DB_MEMCMP_KEY_DECODE_MEMBER, v, MEMBERS ) } \
+   }; \
+} }
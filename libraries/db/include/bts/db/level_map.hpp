@@ -2,7 +2,6 @@
 #include <bts/db/exception.hpp>
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
-#include <leveldb/cache.h>
 #include <leveldb/write_batch.h>
 
 #include <fc/filesystem.hpp>
@@ -13,15 +12,134 @@
 
 #include <fc/log/logger.hpp>
 
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/level_options.hpp>
+#include <bts/db/shared_level_database.hpp>
+#include <bts/db/table_stats.hpp>
 #include <bts/db/upgrade_leveldb.hpp>
 #include <fc/io/json.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/crypto/city.hpp>
 
+#include <cstring>
 #include <fstream>
 
 namespace bts { namespace db {
 
   namespace ldb = leveldb;
 
+  namespace detail
+  {
+     /** fc::raw-compatible output stream that also feeds everything it writes into a digest */
+     struct hashing_ostream
+     {
+        std::ostream&        out;
+        fc::sha256::encoder& digest;
+
+        void write( const char* data, size_t size )
+        {
+           out.write( data, size );
+           digest.write( data, (uint32_t)size );
+        }
+        void put( char c ) { write( &c, 1 ); }
+     };
+
+     /** fc::raw-compatible input stream that also feeds everything it reads into a digest */
+     struct hashing_istream
+     {
+        std::istream&        in;
+        fc::sha256::encoder& digest;
+
+        void read( char* data, size_t size )
+        {
+           in.read( data, size );
+           FC_ASSERT( in.gcount() == std::streamsize(size), "unexpected end of stream" );
+           digest.write( data, (uint32_t)size );
+        }
+        void get( char& c ) { read( &c, 1 ); }
+     };
+
+     /** fc::raw-compatible output stream that appends to a buffer */
+     struct vector_ostream
+     {
+        std::vector<char>& buffer;
+
+        void write( const char* data, size_t size ) { buffer.insert( buffer.end(), data, data + size ); }
+        void put( char c ) { buffer.push_back( c ); }
+     };
+
+     /**
+      *  fc::raw-compatible output stream for building a database key, which stays on the stack unless
+      *  the key is unusually large
+      */
+     class key_buffer
+     {
+        public:
+           key_buffer(){}
+           key_buffer( const key_buffer& other ) { write( other.data(), other.size() ); }
+           key_buffer& operator=( const key_buffer& ) = delete;
+
+           void write( const char* data, size_t size )
+           {
+              if( _heap.empty() && _size + size <= sizeof(_stack) )
+              {
+                 memcpy( _stack + _size, data, size );
+              }
+              else
+              {
+                 if( _heap.empty() ) _heap.assign( _stack, _stack + _size );
+                 _heap.insert( _heap.end(), data, data + size );
+              }
+              _size += size;
+           }
+           void put( char c ) { write( &c, 1 ); }
+
+           const char* data()const { return _heap.empty() ? _stack : _heap.data(); }
+           size_t      size()const { return _size; }
+           ldb::Slice  slice()const { return ldb::Slice( data(), _size ); }
+
+        private:
+           char              _stack[128];
+           size_t            _size = 0;
+           std::vector<char> _heap;
+     };
+
+     /** record format shared by export_raw() and export_to_binary() */
+     template<typename Stream>
+     void pack_raw_record( Stream& stream, const ldb::Slice& key, const ldb::Slice& value )
+     {
+        fc::raw::pack( stream, fc::unsigned_int( (uint32_t)key.size() ) );
+        stream.write( key.data(), key.size() );
+        fc::raw::pack( stream, fc::unsigned_int( (uint32_t)value.size() ) );
+        stream.write( value.data(), value.size() );
+     }
+
+     template<typename Stream>
+     void unpack_raw_record( Stream& stream, std::vector<char>& key, std::vector<char>& value )
+     {
+        fc::unsigned_int size;
+        fc::raw::unpack( stream, size );
+        key.resize( size.value );
+        if( size.value ) stream.read( key.data(), key.size() );
+        fc::raw::unpack( stream, size );
+        value.resize( size.value );
+        if( size.value ) stream.read( value.data(), value.size() );
+     }
+  }
+
+  /**
+   *  written at the start of every file produced by level_map::export_to_binary()
+   *
+   *  format_version 2 stores keys in their memcmp_key encoding; version 1 dumps held fc::raw keys and
+   *  can't be imported.
+   */
+  struct binary_dump_header
+  {
+     std::string magic = "bts::db::level_map";
+     uint32_t    format_version = 2;
+     std::string value_type;
+  };
+
   /**
    *  @brief implements a high-level API on top of Level DB that stores items using fc::raw / reflection
    *
@@ -30,34 +148,37 @@ namespace bts { namespace db {
   class level_map
   {
      public:
+        /** whether keys are stored with their memcmp_key encoding and ordered by LevelDB's bytewise comparator */
+        static const bool memcmp_keys = memcmp_key<Key>::enabled;
+
         void open( const fc::path& dir, bool create = true, size_t cache_size = 0 )
+        {
+           level_options options;
+           options.cache_size = cache_size;
+           open( dir, options, create );
+        }
+
+        void open( const fc::path& dir, const level_options& options, bool create = true )
         { try {
            ldb::Options opts;
-           opts.comparator = &_comparer;
+           opts.comparator = key_comparator();
            opts.create_if_missing = create;
-
-           if (cache_size) {
-               _cache.reset(leveldb::NewLRUCache(cache_size));
-               opts.block_cache = _cache.get();
-           }
-           /*
-           if( ldb::kMajorVersion > 1 || ( leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16 ) )
-           {
-               // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
-               // on corruption in later versions.
-               opts.paranoid_checks = true;
-           }
-           opts.max_open_files = 64;
-
-           _read_options.verify_checksums = true;
-           _iter_options.verify_checksums = true;
-           _iter_options.fill_cache = false;
-           _sync_options.sync = true;
-           */
+           _options.apply( options, opts );
 
            /// \warning Given path must exist to succeed toNativeAnsiPath
            fc::create_directories(dir);
 
+           try_upgrade_key_encoding( dir, memcmp_keys ? memcmp_key_encoding_name : raw_key_encoding_name, &_comparer, opts,
+                                     []( const ldb::Slice& raw_key ) -> std::string
+                                     {
+                                        Key k;
+                                        fc::datastream<const char*> ds( raw_key.data(), raw_key.size() );
+                                        fc::raw::unpack( ds, k );
+                                        detail::key_buffer encoded;
+                                        encode_key( encoded, k );
+                                        return std::string( encoded.data(), encoded.size() );
+                                     } );
+
            std::string ldbPath = dir.to_native_ansi_path();
 
            ldb::DB* ndb = nullptr;
@@ -69,38 +190,73 @@ namespace bts { namespace db {
                     ("msg",ntrxstat.ToString())
                     );
            }
-           _db.reset(ndb);
+           _owned_db.reset(ndb);
+           _db = ndb;
            try_upgrade_db( dir,ndb, fc::get_typename<Value>::name(),sizeof(Value) );
-        } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+        } FC_RETHROW_EXCEPTIONS( warn, "", ("dir",dir)("options",options) ) }
+
+        /**
+         *  Opens this map as the named table of a shared database, which must already be open and
+         *  have had this map's key_comparator() registered under the same name.
+         */
+        void open( shared_level_database& shared_db, const std::string& table_name )
+        { try {
+           FC_ASSERT( shared_db.is_open(), "Shared database is not open!" );
+           shared_db.register_table( table_name, key_comparator() );
+           _prefix = shared_db.table_prefix( table_name );
+           _shared_db = &shared_db;
+           _db = shared_db.get_db();
+        } FC_CAPTURE_AND_RETHROW( (table_name) ) }
 
         bool is_open()const
         {
-          return !!_db;
+          return _db != nullptr;
         }
 
         void close()
         {
-          _db.reset();
-          _cache.reset();
+          _db = nullptr;
+          _owned_db.reset();
+          _options.reset();
+          _shared_db = nullptr;
+          _prefix.clear();
         }
 
+        /** The ordering of this map's keys, for registering it as a table of a shared_level_database */
+        const leveldb::Comparator* key_comparator()const
+        {
+          if( memcmp_keys )
+             return leveldb::BytewiseComparator();
+          return &_comparer;
+        }
+
+        /** a point lookup, which unlike find() can be answered from the bloom filter when the key is absent */
         fc::optional<Value> fetch_optional( const Key& k )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           auto itr = find( k );
-           if( itr.valid() ) return itr.value();
-           return fc::optional<Value>();
-        } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+           std::string value;
+           auto status = get_value( k, value );
+           if( status.IsNotFound() )
+           {
+             return fc::optional<Value>();
+           }
+           if( !status.ok() )
+           {
+               FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
+           }
+           fc::datastream<const char*> ds(value.c_str(), value.size());
+           Value tmp;
+           fc::raw::unpack(ds, tmp);
+           return tmp;
+        } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) ); }
 
         Value fetch( const Key& k )
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
            std::string value;
-           auto status = _db->Get( ldb::ReadOptions(), ks, &value );
+           auto status = get_value( k, value );
            if( status.IsNotFound() )
            {
              FC_THROW_EXCEPTION( fc::key_not_found_exception, "unable to find key ${key}", ("key",k) );
@@ -121,14 +277,13 @@ namespace bts { namespace db {
              iterator(){}
              bool valid()const
              {
-                return _it && _it->Valid();
+                return _it && _it->Valid() && ( _prefix.empty() || _it->key().starts_with( _prefix ) );
              }
 
              Key key()const
              {
                  Key tmp_key;
-                 fc::datastream<const char*> ds2( _it->key().data(), _it->key().size() );
-                 fc::raw::unpack( ds2, tmp_key );
+                 unpack_key( ldb::Slice( _it->key().data() + _prefix.size(), _it->key().size() - _prefix.size() ), tmp_key );
                  return tmp_key;
              }
 
@@ -145,18 +300,21 @@ namespace bts { namespace db {
 
            protected:
              friend class level_map;
-             iterator( ldb::Iterator* it )
-             :_it(it){}
+             iterator( ldb::Iterator* it, const std::string& prefix )
+             :_it(it),_prefix(prefix.data(), prefix.size()){}
 
              std::shared_ptr<ldb::Iterator> _it;
+             ldb::Slice                     _prefix;
         };
 
         iterator begin() const
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->SeekToFirst();
+           if( table_stats_enabled() ) ++_stats.seeks;
+
+           iterator itr( _db->NewIterator( _options.scan_options() ), _prefix );
+           seek_to_first( itr._it.get() );
 
            if( itr._it->status().IsNotFound() )
            {
@@ -178,30 +336,23 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           ldb::Slice key_slice;
+           const bool measure = table_stats_enabled();
+           const fc::time_point start = measure ? fc::time_point::now() : fc::time_point();
 
            /** avoid dynamic memory allocation at this step if possible, most
             * keys should be relatively small in size and not require dynamic
             * memory allocation to seralize the key.
             */
-           fc::array<char,256+sizeof(Key)>  stack_buffer;
-
-           size_t pack_size = fc::raw::pack_size(key);
-           if( pack_size <= stack_buffer.size() )
-           {
-              fc::datastream<char*> ds( stack_buffer.data, stack_buffer.size() );
-              fc::raw::pack( ds ,key );
-              key_slice = ldb::Slice( stack_buffer.data, pack_size );
-           }
-           else
-           {
-              auto kslice = fc::raw::pack( key );
-              key_slice = ldb::Slice( kslice.data(), kslice.size() );
-           }
+           const detail::key_buffer packed_key = pack_key( key );
+           const ldb::Slice key_slice = packed_key.slice();
 
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           iterator itr( _db->NewIterator( _options.read_options() ), _prefix );
            itr._it->Seek( key_slice );
-           if( itr.valid() && itr.key() == key )
+           /* encoded keys are equal exactly when the comparator says so, which operator== may not agree with */
+           const bool found = itr.valid() && ( memcmp_keys ? itr._it->key() == key_slice : itr.key() == key );
+           if( measure )
+              _stats.record_read( found ? itr._it->value().size() : 0, found, fc::time_point::now() - start );
+           if( found )
            {
               return itr;
            }
@@ -212,10 +363,12 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( key );
-           ldb::Slice key_slice( kslice.data(), kslice.size() );
+           if( table_stats_enabled() ) ++_stats.seeks;
+
+           const detail::key_buffer packed_key = pack_key( key );
+           const ldb::Slice key_slice = packed_key.slice();
 
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           iterator itr( _db->NewIterator( _options.read_options() ), _prefix );
            itr._it->Seek( key_slice );
            return itr;
         } FC_RETHROW_EXCEPTIONS( warn, "error finding ${key}", ("key",key) ) }
@@ -224,8 +377,8 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->SeekToLast();
+           iterator itr( _db->NewIterator( _options.read_options() ), _prefix );
+           seek_to_last( itr._it.get() );
            return itr;
         } FC_RETHROW_EXCEPTIONS( warn, "error finding last" ) }
 
@@ -233,15 +386,14 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
-           FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           iterator itr( _db->NewIterator( _options.read_options() ), _prefix );
+           FC_ASSERT( itr._it != nullptr );
+           seek_to_last( itr._it.get() );
+           if( !itr.valid() )
            {
              return false;
            }
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           k = itr.key();
            return true;
         } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" ); }
 
@@ -249,18 +401,15 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
-           FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           iterator itr( _db->NewIterator( _options.read_options() ), _prefix );
+           FC_ASSERT( itr._it != nullptr );
+           seek_to_last( itr._it.get() );
+           if( !itr.valid() )
            {
              return false;
            }
-           fc::datastream<const char*> ds( it->value().data(), it->value().size() );
-           fc::raw::unpack( ds, v );
-
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           v = itr.value();
+           k = itr.key();
            return true;
         } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" ); }
 
@@ -307,6 +456,11 @@ namespace bts { namespace db {
             {
               FC_ASSERT(_map->is_open(), "Database is not open!");
 
+              // writes already went into the shared database's batch
+              if( _map->shared_batch() != nullptr )
+                return;
+
+              scoped_latency_timer timer( table_stats_enabled() ? &_map->_stats.write_latency : nullptr );
               ldb::Status status = _map->_db->Write(ldb::WriteOptions(), &_batch);
               if (status.IsNotFound())
                 FC_THROW_EXCEPTION(fc::key_not_found_exception, "unable to find key while applying batch");
@@ -322,22 +476,37 @@ namespace bts { namespace db {
             _batch.Clear();
           }
 
+        private:
+          leveldb::WriteBatch* target()
+          {
+            leveldb::WriteBatch* shared = _map->shared_batch();
+            return shared != nullptr ? shared : &_batch;
+          }
+        public:
+
           void store(const Key& k, const Value& v)
           {
-            std::vector<char> kslice = fc::raw::pack(k);
-            ldb::Slice ks(kslice.data(), kslice.size());
+            const detail::key_buffer kslice = _map->pack_key(k);
+            const ldb::Slice ks = kslice.slice();
 
             auto vec = fc::raw::pack(v);
             ldb::Slice vs(vec.data(), vec.size());
 
-            _batch.Put(ks, vs);
+            target()->Put(ks, vs);
+            if( table_stats_enabled() )
+            {
+              ++_map->_stats.writes;
+              _map->_stats.bytes_written += ks.size() + vs.size();
+            }
           }
 
           void remove(const Key& k, bool sync = false)
           {
-            std::vector<char> kslice = fc::raw::pack(k);
-            ldb::Slice ks(kslice.data(), kslice.size());
-            _batch.Delete(ks);
+            const detail::key_buffer kslice = _map->pack_key(k);
+            const ldb::Slice ks = kslice.slice();
+            target()->Delete(ks);
+            if( table_stats_enabled() )
+              ++_map->_stats.removes;
           }
         };
 
@@ -350,13 +519,28 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
+           const detail::key_buffer kslice = pack_key( k );
+           const ldb::Slice ks = kslice.slice();
 
            auto vec = fc::raw::pack(v);
            ldb::Slice vs( vec.data(), vec.size() );
 
+           if( leveldb::WriteBatch* batch = shared_batch() )
+           {
+              batch->Put( ks, vs );
+              if( table_stats_enabled() )
+              {
+                 ++_stats.writes;
+                 _stats.bytes_written += ks.size() + vs.size();
+              }
+              return;
+           }
+
+           const bool measure = table_stats_enabled();
+           const fc::time_point start = measure ? fc::time_point::now() : fc::time_point();
            auto status = _db->Put( ldb::WriteOptions(), ks, vs );
+           if( measure )
+              _stats.record_write( ks.size() + vs.size(), fc::time_point::now() - start );
            if( !status.ok() )
            {
                FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString() ) );
@@ -367,9 +551,21 @@ namespace bts { namespace db {
         { try {
            FC_ASSERT( is_open(), "Database is not open!" );
 
-           std::vector<char> kslice = fc::raw::pack( k );
-           ldb::Slice ks( kslice.data(), kslice.size() );
+           const detail::key_buffer kslice = pack_key( k );
+           const ldb::Slice ks = kslice.slice();
+
+           if( leveldb::WriteBatch* batch = shared_batch() )
+           {
+              batch->Delete( ks );
+              if( table_stats_enabled() ) ++_stats.removes;
+              return;
+           }
+
+           const bool measure = table_stats_enabled();
+           const fc::time_point start = measure ? fc::time_point::now() : fc::time_point();
            auto status = _db->Delete( ldb::WriteOptions(), ks );
+           if( measure )
+              _stats.record_remove( fc::time_point::now() - start );
            if( status.IsNotFound() )
            {
              FC_THROW_EXCEPTION( fc::key_not_found_exception, "unable to find key ${key}", ("key",k) );
@@ -399,6 +595,218 @@ namespace bts { namespace db {
             fs.write( "]", 1 );
         } FC_CAPTURE_AND_RETHROW( (path) ) }
 
+        /**
+         *  Streams every record to out as its raw packed key and value, in database order, and feeds
+         *  the same bytes into digest.  Two databases with the same contents always produce the same
+         *  bytes, so the digest can be used to commit to the contents of the table.
+         *
+         *  @return the number of records written
+         */
+        uint64_t export_raw( std::ostream& out, fc::sha256::encoder& digest )const
+        { try {
+           FC_ASSERT( is_open(), "Database is not open!" );
+
+           detail::hashing_ostream stream{ out, digest };
+           ldb::ReadOptions iter_options = _options.scan_options();
+           iter_options.fill_cache = false;
+           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( iter_options ) );
+
+           uint64_t count = 0;
+           for( seek_to_first( it.get() ); in_table( it.get() ); it->Next() )
+           {
+              stream.put( 1 );
+              detail::pack_raw_record( stream, table_key( it.get() ), it->value() );
+              ++count;
+           }
+           if( !it->status().ok() )
+               FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", it->status().ToString() ) );
+           stream.put( 0 );
+           return count;
+        } FC_RETHROW_EXCEPTIONS( warn, "error exporting database" ) }
+
+        /**
+         *  Reads records written by export_raw() and stores them, feeding the bytes read into digest.
+         *  Records are written in batches since the input is already in database order.
+         *
+         *  @return the number of records read
+         */
+        uint64_t import_raw( std::istream& in, fc::sha256::encoder& digest, uint32_t records_per_batch = 10000 )
+        { try {
+           FC_ASSERT( is_open(), "Database is not open!" );
+
+           detail::hashing_istream stream{ in, digest };
+           ldb::WriteBatch batch;
+           uint32_t records_in_batch = 0;
+           uint64_t count = 0;
+           std::vector<char> key_data;
+           std::vector<char> value_data;
+
+           const auto write_batch = [&]()
+           {
+              auto status = _db->Write( ldb::WriteOptions(), &batch );
+              if( !status.ok() )
+                  FC_THROW_EXCEPTION( db_exception, "database error while importing: ${msg}", ("msg", status.ToString() ) );
+              batch.Clear();
+              records_in_batch = 0;
+           };
+
+           char more_records = 0;
+           stream.get( more_records );
+           while( more_records )
+           {
+              detail::unpack_raw_record( stream, key_data, value_data );
+              key_data.insert( key_data.begin(), _prefix.begin(), _prefix.end() );
+              batch.Put( ldb::Slice( key_data.data(), key_data.size() ), ldb::Slice( value_data.data(), value_data.size() ) );
+              ++count;
+              if( ++records_in_batch >= records_per_batch )
+                 write_batch();
+
+              stream.get( more_records );
+           }
+           if( records_in_batch )
+              write_batch();
+           return count;
+        } FC_RETHROW_EXCEPTIONS( warn, "error importing database" ) }
+
+        /**
+         *  Writes every record to path in chunks of up to records_per_chunk raw records (or about 1MiB), each followed
+         *  by a checksum of its contents.  This is much faster and smaller than export_to_json(), and
+         *  the result can be loaded back with import_from_binary().
+         */
+        void export_to_binary( const fc::path& path, uint32_t records_per_chunk = 4096 )const
+        { try {
+            FC_ASSERT( !fc::exists( path ) );
+            FC_ASSERT( is_open(), "Database is not open!" );
+
+            std::ofstream fs( path.string(), std::ios::out | std::ios::binary );
+            binary_dump_header header;
+            header.value_type = fc::get_typename<Value>::name();
+            fc::raw::pack( fs, header );
+
+            ldb::ReadOptions iter_options = _options.scan_options();
+            iter_options.fill_cache = false;
+            std::unique_ptr<ldb::Iterator> it( _db->NewIterator( iter_options ) );
+
+            std::vector<char> chunk;
+            detail::vector_ostream chunk_stream{ chunk };
+            uint32_t records_in_chunk = 0;
+            const auto write_chunk = [&]()
+            {
+               fc::raw::pack( fs, records_in_chunk );
+               fc::raw::pack( fs, chunk );
+               fc::raw::pack( fs, fc::city_hash64( chunk.data(), chunk.size() ) );
+               chunk.clear();
+               records_in_chunk = 0;
+            };
+
+            for( seek_to_first( it.get() ); in_table( it.get() ); it->Next() )
+            {
+               detail::pack_raw_record( chunk_stream, table_key( it.get() ), it->value() );
+               // also cap the size of a chunk, since fc::raw limits how large a vector it will unpack
+               if( ++records_in_chunk >= records_per_chunk || chunk.size() >= 1024 * 1024 )
+                  write_chunk();
+            }
+            if( !it->status().ok() )
+                FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", it->status().ToString() ) );
+            if( records_in_chunk )
+               write_chunk();
+            write_chunk(); // an empty chunk marks the end of the file
+
+            fs.flush();
+            FC_ASSERT( fs.good(), "Error writing ${path}", ("path",path) );
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        /**
+         *  Loads a file written by export_to_binary(), verifying each chunk's checksum before it is
+         *  written to the database in a single batch.
+         *
+         *  @return the number of records loaded
+         */
+        uint64_t import_from_binary( const fc::path& path )
+        { try {
+            FC_ASSERT( fc::exists( path ) );
+            FC_ASSERT( is_open(), "Database is not open!" );
+
+            std::ifstream fs( path.string(), std::ios::in | std::ios::binary );
+            binary_dump_header header;
+            fc::raw::unpack( fs, header );
+            FC_ASSERT( header.magic == binary_dump_header().magic, "Not a level_map dump", ("header",header) );
+            FC_ASSERT( header.format_version == binary_dump_header().format_version,
+                       "Unsupported level_map dump format; export it again with this version",
+                       ("format_version",header.format_version)("expected",binary_dump_header().format_version) );
+            FC_ASSERT( header.value_type == fc::get_typename<Value>::name(), "Dump contains the wrong type of record",
+                       ("value_type",header.value_type)("expected",fc::get_typename<Value>::name()) );
+
+            uint64_t count = 0;
+            std::vector<char> chunk;
+            std::vector<char> key_data;
+            std::vector<char> value_data;
+            while( true )
+            {
+               uint32_t records_in_chunk = 0;
+               uint64_t checksum = 0;
+               fc::raw::unpack( fs, records_in_chunk );
+               fc::raw::unpack( fs, chunk );
+               fc::raw::unpack( fs, checksum );
+               FC_ASSERT( fs.good(), "Unexpected end of file after ${count} records", ("count",count) );
+               FC_ASSERT( checksum == fc::city_hash64( chunk.data(), chunk.size() ), "Checksum mismatch after ${count} records", ("count",count) );
+               if( records_in_chunk == 0 )
+                  break;
+
+               ldb::WriteBatch batch;
+               fc::datastream<const char*> chunk_stream( chunk.data(), chunk.size() );
+               for( uint32_t i = 0; i < records_in_chunk; ++i )
+               {
+                  detail::unpack_raw_record( chunk_stream, key_data, value_data );
+                  key_data.insert( key_data.begin(), _prefix.begin(), _prefix.end() );
+                  batch.Put( ldb::Slice( key_data.data(), key_data.size() ), ldb::Slice( value_data.data(), value_data.size() ) );
+               }
+               auto status = _db->Write( ldb::WriteOptions(), &batch );
+               if( !status.ok() )
+                   FC_THROW_EXCEPTION( db_exception, "database error while importing: ${msg}", ("msg", status.ToString() ) );
+               count += records_in_chunk;
+            }
+            return count;
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        /** writes one compact JSON [key, value] array per line, which diffs and greps well */
+        void export_to_json_lines( const fc::path& path )const
+        { try {
+            FC_ASSERT( !fc::exists( path ) );
+
+            std::ofstream fs( path.string() );
+            for( auto iter = begin(); iter.valid(); ++iter )
+            {
+                auto str = fc::json::to_string( std::make_pair( iter.key(), iter.value() ) );
+                str += "\n";
+                fs.write( str.c_str(), str.size() );
+            }
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        uint64_t import_from_json_lines( const fc::path& path )
+        { try {
+            FC_ASSERT( fc::exists( path ) );
+
+            std::ifstream fs( path.string() );
+            write_batch batch = create_batch();
+            uint64_t count = 0;
+            std::string line;
+            while( std::getline( fs, line ) )
+            {
+                if( line.empty() ) continue;
+                const auto record = fc::json::from_string( line ).as<std::pair<Key, Value>>();
+                batch.store( record.first, record.second );
+                if( ++count % 4096 == 0 )
+                   batch.commit();
+            }
+            batch.commit();
+            return count;
+        } FC_CAPTURE_AND_RETHROW( (path) ) }
+
+        /** @return the operations counted since the database was opened or reset_stats() was called */
+        const table_stats& get_stats()const { return _stats; }
+        void reset_stats() { _stats = table_stats(); }
+
         // note: this loops through all the items in the database, so it's not exactly fast.  it's intended for debugging, nothing else.
         size_t size() const
         {
@@ -413,6 +821,88 @@ namespace bts { namespace db {
         }
 
      private:
+        /** @return the key as stored in the database, behind this table's prefix if it is part of a shared database */
+        detail::key_buffer pack_key( const Key& k )const
+        {
+           detail::key_buffer kslice;
+           kslice.write( _prefix.data(), _prefix.size() );
+           encode_key( kslice, k );
+           return kslice;
+        }
+
+        template<typename Stream>
+        static void encode_key( Stream& s, const Key& k )
+        {
+           encode_key( s, k, std::integral_constant<bool, memcmp_keys>() );
+        }
+        template<typename Stream>
+        static void encode_key( Stream& s, const Key& k, std::true_type )  { memcmp_key<Key>::encode( s, k ); }
+        template<typename Stream>
+        static void encode_key( Stream& s, const Key& k, std::false_type ) { fc::raw::pack( s, k ); }
+
+        static void unpack_key( const ldb::Slice& key, Key& k )
+        {
+           fc::datastream<const char*> ds( key.data(), key.size() );
+           decode_key( ds, k, std::integral_constant<bool, memcmp_keys>() );
+        }
+        static void decode_key( fc::datastream<const char*>& ds, Key& k, std::true_type )  { memcmp_key<Key>::decode( ds, k ); }
+        static void decode_key( fc::datastream<const char*>& ds, Key& k, std::false_type ) { fc::raw::unpack( ds, k ); }
+
+        void seek_to_first( ldb::Iterator* it )const
+        {
+           if( _prefix.empty() )
+              it->SeekToFirst();
+           else
+              it->Seek( _prefix );
+        }
+
+        void seek_to_last( ldb::Iterator* it )const
+        {
+           if( _prefix.empty() )
+           {
+              it->SeekToLast();
+              return;
+           }
+           // seek to where the next table would start, then step back
+           std::string next_table = _prefix;
+           next_table.back() = '\x01';
+           it->Seek( next_table );
+           if( it->Valid() )
+              it->Prev();
+           else
+              it->SeekToLast();
+        }
+
+        bool in_table( ldb::Iterator* it )const
+        {
+           return it->Valid() && ( _prefix.empty() || it->key().starts_with( _prefix ) );
+        }
+
+        ldb::Slice table_key( ldb::Iterator* it )const
+        {
+           ldb::Slice key = it->key();
+           key.remove_prefix( _prefix.size() );
+           return key;
+        }
+
+        ldb::Status get_value( const Key& k, std::string& value )const
+        {
+           const bool measure = table_stats_enabled();
+           const fc::time_point start = measure ? fc::time_point::now() : fc::time_point();
+
+           const detail::key_buffer kslice = pack_key( k );
+           const ldb::Slice ks = kslice.slice();
+           auto status = _db->Get( _options.read_options(), ks, &value );
+           if( measure )
+              _stats.record_read( value.size(), status.ok(), fc::time_point::now() - start );
+           return status;
+        }
+
+        leveldb::WriteBatch* shared_batch()const
+        {
+           return _shared_db != nullptr ? _shared_db->active_batch() : nullptr;
+        }
+
         class key_compare : public leveldb::Comparator
         {
           public:
@@ -434,15 +924,18 @@ namespace bts { namespace db {
             void FindShortSuccessor( std::string* )const{};
         };
 
-        std::unique_ptr<leveldb::DB>    _db;
-        std::unique_ptr<leveldb::Cache> _cache;
+        /** declared before _owned_db so that the cache and filter policy outlive the database */
+        level_options_state             _options;
+        std::unique_ptr<leveldb::DB>    _owned_db;
+        /** either _owned_db or the database shared with other tables */
+        leveldb::DB*                    _db = nullptr;
+        shared_level_database*          _shared_db = nullptr;
+        /** prepended to every key when this table is part of a shared database */
+        std::string                     _prefix;
         key_compare                     _comparer;
-        /*
-        ldb::ReadOptions                _read_options;
-        ldb::ReadOptions                _iter_options;
-        ldb::WriteOptions               _write_options;
-        ldb::WriteOptions               _sync_options;
-        */
+        mutable table_stats             _stats;
   };
 
 } } // bts::db
+
+FC_REFLECT( bts::db::binary_dump_header, (magic)(format_version)(value_type) )
@@ -0,0 +1,68 @@
+#pragma once
+#include <leveldb/options.h>
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+
+namespace bts { namespace db {
+
+  /**
+   *  LevelDB tuning for a single database.  Sizes are in bytes and a value of 0 keeps LevelDB's own
+   *  default, so a default constructed level_options opens a database exactly as before.
+   */
+  struct level_options
+  {
+     /** memtable size; larger buffers mean fewer, larger level-0 files when writing heavily */
+     uint64_t write_buffer_size = 0;
+     /** uncompressed size of a table block; smaller blocks make point lookups read less */
+     uint32_t block_size = 0;
+     /** bits per key of a bloom filter, which lets lookups of absent keys skip most table files; 0 for none */
+     uint32_t bloom_filter_bits = 0;
+     /** size of a block cache private to this database */
+     uint64_t cache_size = 0;
+     int32_t  max_open_files = 0;
+     bool     compression = true;
+     bool     paranoid_checks = false;
+     bool     verify_checksums = false;
+     /** whether blocks read by scans over the whole database are added to the block cache */
+     bool     fill_cache_on_scan = false;
+  };
+
+  /**
+   *  Owns the cache and filter policy a level_options refers to, which must outlive the database
+   *  opened with them.
+   */
+  class level_options_state
+  {
+     public:
+        level_options_state();
+
+        /** sets everything level_options covers on opts, which should already have its comparator */
+        void apply( const level_options& options, leveldb::Options& opts );
+        void reset();
+
+        leveldb::ReadOptions read_options()const { return _read_options; }
+        leveldb::ReadOptions scan_options()const { return _scan_options; }
+
+     private:
+        std::unique_ptr<leveldb::Cache>              _cache;
+        std::unique_ptr<const leveldb::FilterPolicy> _filter_policy;
+        leveldb::ReadOptions                         _read_options;
+        leveldb::ReadOptions                         _scan_options;
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::level_options,
+            (write_buffer_size)
+            (block_size)
+            (bloom_filter_bits)
+            (cache_size)
+            (max_open_files)
+            (compression)
+            (paranoid_checks)
+            (verify_checksums)
+            (fill_cache_on_scan) )
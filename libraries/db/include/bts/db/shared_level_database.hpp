@@ -0,0 +1,98 @@
+#pragma once
+#include <bts/db/level_options.hpp>
+
+#include <leveldb/db.h>
+#include <leveldb/comparator.h>
+#include <leveldb/write_batch.h>
+
+#include <fc/filesystem.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  A single LevelDB instance holding many tables, each of which is a level_map whose keys are stored
+   *  behind a prefix made of the table's name.  Compared with a LevelDB instance per table this shares
+   *  one log, memtable, block cache and set of compaction threads and file handles, and writes to
+   *  several tables can be committed together with start_batch() and commit_batch().
+   *
+   *  Keys of different tables are ordered by table name, and keys within a table by the table's own
+   *  comparator.  LevelDB may compare any two keys as soon as it is opened, so every table must be
+   *  registered before open() is called.
+   */
+  class shared_level_database
+  {
+     public:
+        shared_level_database();
+        ~shared_level_database();
+
+        void                        register_table( const std::string& name, const leveldb::Comparator* key_comparator );
+        /** @return the bytes prepended to every key of the named table */
+        std::string                 table_prefix( const std::string& name )const;
+
+        /** options apply to the database as a whole, rather than to any one table */
+        void                        open( const fc::path& dir, const level_options& options, bool create = true );
+        bool                        is_open()const;
+        void                        close();
+        leveldb::DB*                get_db()const;
+
+        /**
+         *  Until the batch is committed, writes to every table in this database are queued in it.  Reads
+         *  do not see queued writes, so a batch should only span writes that do not read back keys
+         *  written earlier in the same batch.
+         */
+        void                        start_batch();
+        void                        commit_batch();
+        /** discards the queued writes and calls every abort handler */
+        void                        abort_batch();
+        /** @return the batch queued writes should go to, or nullptr if no batch is in progress */
+        leveldb::WriteBatch*        active_batch();
+
+        /**
+         *  Tables that keep their contents in memory, like cached_level_map, have already applied writes
+         *  that are queued in a batch, so they register a handler to reload themselves when it is aborted.
+         */
+        void                        set_abort_handler( const std::string& table_name, std::function<void()> handler );
+        void                        clear_abort_handler( const std::string& table_name );
+
+        /**
+         *  Starts a batch that is only written by commit().  If it goes out of scope uncommitted, for
+         *  instance because of an exception, the batch is aborted, so a failed operation leaves neither
+         *  its writes on disk nor their effects on the tables' caches.
+         */
+        class scoped_batch
+        {
+           public:
+              scoped_batch( shared_level_database* db );
+              ~scoped_batch();
+              void commit();
+
+           private:
+              shared_level_database* _db;
+        };
+
+     private:
+        class table_comparator : public leveldb::Comparator
+        {
+           public:
+              int         Compare( const leveldb::Slice& a, const leveldb::Slice& b )const override;
+              /* renamed whenever the order of any table's keys changes, so that LevelDB refuses the old database */
+              const char* Name()const override { return "bts::db::shared_level_database.v2"; }
+              void        FindShortestSeparator( std::string*, const leveldb::Slice& )const override {}
+              void        FindShortSuccessor( std::string* )const override {}
+
+              std::map<std::string, const leveldb::Comparator*> tables;
+        };
+
+        table_comparator                     _comparator;
+        level_options_state                  _options;
+        std::unique_ptr<leveldb::DB>         _db;
+        std::unique_ptr<leveldb::WriteBatch> _batch;
+        std::map<std::string, std::function<void()>> _abort_handlers;
+  };
+
+} } // bts::db
@@ -0,0 +1,77 @@
+#pragma once
+#include <fc/reflect/reflect.hpp>
+#include <fc/time.hpp>
+#include <vector>
+
+namespace bts { namespace db {
+
+  /**
+   *  Collection of table_stats is off by default so that the only cost to every database operation
+   *  is this check.  It is global because the level_maps of a process are generally diagnosed together.
+   */
+  bool table_stats_enabled();
+  void enable_table_stats( bool enabled );
+
+  /** Counts operations by how long they took, bucket i holding those that took under 2^i microseconds */
+  struct latency_histogram
+  {
+     static const uint32_t bucket_count = 24;
+
+     uint64_t              count = 0;
+     uint64_t              total_usec = 0;
+     uint64_t              max_usec = 0;
+     std::vector<uint64_t> buckets;
+
+     void record( const fc::microseconds& latency );
+     /** clears the counts without moving the histogram, so running scoped_latency_timers stay valid */
+     void reset();
+  };
+
+  /** Operation counters for a single level_map or cached_level_map */
+  struct table_stats
+  {
+     uint64_t          reads = 0;
+     uint64_t          read_misses = 0;
+     uint64_t          seeks = 0;
+     uint64_t          writes = 0;
+     uint64_t          removes = 0;
+     uint64_t          bytes_read = 0;
+     uint64_t          bytes_written = 0;
+     uint64_t          cache_hits = 0;
+     uint64_t          cache_misses = 0;
+     latency_histogram read_latency;
+     latency_histogram write_latency;
+
+     void record_read( size_t bytes, bool found, const fc::microseconds& latency );
+     void record_write( size_t bytes, const fc::microseconds& latency );
+     void record_remove( const fc::microseconds& latency );
+  };
+
+  /** Times a scope when table stats are enabled, and does nothing when they are not */
+  class scoped_latency_timer
+  {
+     public:
+        scoped_latency_timer( latency_histogram* histogram )
+        :_histogram(histogram),_start( histogram ? fc::time_point::now() : fc::time_point() ){}
+        ~scoped_latency_timer() { if( _histogram ) _histogram->record( fc::time_point::now() - _start ); }
+
+     private:
+        latency_histogram* _histogram;
+        fc::time_point     _start;
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::latency_histogram, (count)(total_usec)(max_usec)(buckets) )
+FC_REFLECT( bts::db::table_stats,
+            (reads)
+            (read_misses)
+            (seeks)
+            (writes)
+            (removes)
+            (bytes_read)
+            (bytes_written)
+            (cache_hits)
+            (cache_misses)
+            (read_latency)
+            (write_latency) )
@@ -1,11 +1,13 @@
 #pragma once
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
+#include <leveldb/options.h>
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/exception/exception.hpp>
 #include <functional>
 #include <map>
+#include <string>
 
 namespace fc { class path; }
 
@@ -112,4 +114,26 @@ namespace bts { namespace db {
 
     void try_upgrade_db( const fc::path& dir, leveldb::DB* dbase, const char* record_type, size_t record_type_size );
 
+    /** keys packed with fc::raw and ordered by a comparator that unpacks them, as every database used to be */
+    static const char raw_key_encoding_name[] = "fc::raw";
+    /** keys encoded with bts::db::memcmp_key and ordered by LevelDB's bytewise comparator */
+    static const char memcmp_key_encoding_name[] = "memcmp";
+
+    /** converts a key from the fc::raw encoding to the current one */
+    typedef std::function<std::string(const leveldb::Slice&)> reencode_key_function;
+
+    /**
+     *  Unlike value types, a change to how keys are encoded changes their order, so the database cannot be
+     *  upgraded in place.  Each database records its key encoding in a KEY_ENCODING file, those without one
+     *  being fc::raw, and when it differs from key_encoding every record is copied into a new database with
+     *  its key passed through reencode_key.  The new database then replaces the old one, which is kept
+     *  until the swap is complete so that an interrupted upgrade can be resumed.
+     *
+     *  @param old_comparator the fc::raw comparator the database was created with
+     *  @param options        the options the database will be opened with, including its new comparator
+     */
+    void try_upgrade_key_encoding( const fc::path& dir, const std::string& key_encoding,
+                                   const leveldb::Comparator* old_comparator, const leveldb::Options& options,
+                                   const reencode_key_function& reencode_key );
+
 } } // namespace db
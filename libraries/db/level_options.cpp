@@ -0,0 +1,47 @@
+#include <bts/db/level_options.hpp>
+
+namespace bts { namespace db {
+
+    level_options_state::level_options_state()
+    {
+        reset();
+    }
+
+    void level_options_state::apply( const level_options& options, leveldb::Options& opts )
+    {
+        reset();
+
+        if( options.write_buffer_size )
+            opts.write_buffer_size = options.write_buffer_size;
+        if( options.block_size )
+            opts.block_size = options.block_size;
+        if( options.max_open_files )
+            opts.max_open_files = options.max_open_files;
+        if( options.cache_size )
+        {
+            _cache.reset( leveldb::NewLRUCache( options.cache_size ) );
+            opts.block_cache = _cache.get();
+        }
+        if( options.bloom_filter_bits )
+        {
+            _filter_policy.reset( leveldb::NewBloomFilterPolicy( options.bloom_filter_bits ) );
+            opts.filter_policy = _filter_policy.get();
+        }
+        opts.compression = options.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+        opts.paranoid_checks = options.paranoid_checks;
+
+        _read_options.verify_checksums = options.verify_checksums;
+        _scan_options.verify_checksums = options.verify_checksums;
+        _scan_options.fill_cache = options.fill_cache_on_scan;
+    }
+
+    void level_options_state::reset()
+    {
+        _filter_policy.reset();
+        _cache.reset();
+        _read_options = leveldb::ReadOptions();
+        _scan_options = leveldb::ReadOptions();
+        _scan_options.fill_cache = false;
+    }
+
+} } // bts::db
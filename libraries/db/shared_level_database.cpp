@@ -0,0 +1,195 @@
+#include <bts/db/exception.hpp>
+#include <bts/db/shared_level_database.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <cstring>
+
+namespace bts { namespace db {
+
+    namespace
+    {
+        /** splits a key into the table name it is prefixed with and the key within that table */
+        void split_key( const leveldb::Slice& key, leveldb::Slice& table, leveldb::Slice& table_key )
+        {
+            const char* separator = static_cast<const char*>( memchr( key.data(), 0, key.size() ) );
+            if( separator == nullptr )
+            {
+                table = key;
+                table_key = leveldb::Slice();
+                return;
+            }
+            const size_t table_size = separator - key.data();
+            table = leveldb::Slice( key.data(), table_size );
+            table_key = leveldb::Slice( separator + 1, key.size() - table_size - 1 );
+        }
+    }
+
+    int shared_level_database::table_comparator::Compare( const leveldb::Slice& a, const leveldb::Slice& b )const
+    {
+        leveldb::Slice a_table, a_key, b_table, b_key;
+        split_key( a, a_table, a_key );
+        split_key( b, b_table, b_key );
+
+        const int table_order = a_table.compare( b_table );
+        if( table_order != 0 )
+            return table_order;
+
+        /* a bare prefix, as used to seek to the start of a table, comes before every key in the table */
+        if( a_key.empty() || b_key.empty() )
+            return int( !a_key.empty() ) - int( !b_key.empty() );
+
+        const auto itr = tables.find( a_table.ToString() );
+        if( itr == tables.end() )
+            return a_key.compare( b_key );
+        return itr->second->Compare( a_key, b_key );
+    }
+
+    shared_level_database::shared_level_database()
+    {
+    }
+
+    shared_level_database::~shared_level_database()
+    {
+        close();
+    }
+
+    void shared_level_database::register_table( const std::string& name, const leveldb::Comparator* key_comparator )
+    { try {
+        FC_ASSERT( !name.empty() && name.find( '\0' ) == std::string::npos, "Invalid table name" );
+        const auto itr = _comparator.tables.find( name );
+        if( itr != _comparator.tables.end() )
+        {
+            FC_ASSERT( itr->second == key_comparator, "Table was registered by another level_map" );
+            return;
+        }
+        FC_ASSERT( !is_open(), "Tables must be registered before the database is opened" );
+        _comparator.tables[ name ] = key_comparator;
+    } FC_CAPTURE_AND_RETHROW( (name) ) }
+
+    std::string shared_level_database::table_prefix( const std::string& name )const
+    { try {
+        FC_ASSERT( _comparator.tables.find( name ) != _comparator.tables.end(), "Table was never registered" );
+        return name + '\0';
+    } FC_CAPTURE_AND_RETHROW( (name) ) }
+
+    void shared_level_database::open( const fc::path& dir, const level_options& options, bool create )
+    { try {
+        FC_ASSERT( !is_open(), "Database is already open" );
+
+        leveldb::Options opts;
+        opts.comparator = &_comparator;
+        opts.create_if_missing = create;
+        _options.apply( options, opts );
+
+        fc::create_directories( dir );
+        std::string ldb_path = dir.to_native_ansi_path();
+
+        leveldb::DB* ndb = nullptr;
+        const auto status = leveldb::DB::Open( opts, ldb_path.c_str(), &ndb );
+        if( !status.ok() )
+        {
+            FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+                                ("db",dir)("msg",status.ToString()) );
+        }
+        _db.reset( ndb );
+    } FC_CAPTURE_AND_RETHROW( (dir)(options) ) }
+
+    bool shared_level_database::is_open()const
+    {
+        return !!_db;
+    }
+
+    void shared_level_database::close()
+    {
+        if( _batch )
+        {
+            wlog( "Closing shared database with an uncommitted batch" );
+            _batch.reset();
+        }
+        _abort_handlers.clear();
+        _db.reset();
+        _options.reset();
+    }
+
+    leveldb::DB* shared_level_database::get_db()const
+    {
+        return _db.get();
+    }
+
+    void shared_level_database::start_batch()
+    { try {
+        FC_ASSERT( is_open(), "Database is not open!" );
+        FC_ASSERT( !_batch, "A batch is already in progress" );
+        _batch.reset( new leveldb::WriteBatch() );
+    } FC_CAPTURE_AND_RETHROW() }
+
+    void shared_level_database::commit_batch()
+    { try {
+        FC_ASSERT( is_open(), "Database is not open!" );
+        FC_ASSERT( !!_batch, "No batch is in progress" );
+        std::unique_ptr<leveldb::WriteBatch> batch = std::move( _batch );
+        const auto status = _db->Write( leveldb::WriteOptions(), batch.get() );
+        if( !status.ok() )
+        {
+            _batch = std::move( batch );
+            abort_batch();
+            FC_THROW_EXCEPTION( db_exception, "database error while applying batch: ${msg}", ("msg", status.ToString()) );
+        }
+    } FC_CAPTURE_AND_RETHROW() }
+
+    void shared_level_database::abort_batch()
+    {
+        if( !_batch ) return;
+        _batch.reset();
+        for( const auto& item : _abort_handlers )
+        {
+            try
+            {
+                item.second();
+            }
+            catch( const fc::exception& e )
+            {
+                elog( "Error reloading table ${table} after aborting batch: ${e}", ("table",item.first)("e",e.to_detail_string()) );
+            }
+        }
+    }
+
+    void shared_level_database::set_abort_handler( const std::string& table_name, std::function<void()> handler )
+    {
+        _abort_handlers[ table_name ] = std::move( handler );
+    }
+
+    void shared_level_database::clear_abort_handler( const std::string& table_name )
+    {
+        _abort_handlers.erase( table_name );
+    }
+
+    leveldb::WriteBatch* shared_level_database::active_batch()
+    {
+        return _batch.get();
+    }
+
+    shared_level_database::scoped_batch::scoped_batch( shared_level_database* db )
+    :_db( db )
+    {
+        if( _db ) _db->start_batch();
+    }
+
+    shared_level_database::scoped_batch::~scoped_batch()
+    {
+        if( !_db ) return;
+        wlog( "Aborting uncommitted batch" );
+        _db->abort_batch();
+    }
+
+    void shared_level_database::scoped_batch::commit()
+    {
+        if( !_db ) return;
+        shared_level_database* db = _db;
+        _db = nullptr;
+        db->commit_batch();
+    }
+
+} } // bts::db
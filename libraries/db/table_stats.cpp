@@ -0,0 +1,63 @@
+#include <bts/db/table_stats.hpp>
+#include <algorithm>
+
+namespace bts { namespace db {
+
+    static bool table_stats_are_enabled = false;
+
+    bool table_stats_enabled()
+    {
+        return table_stats_are_enabled;
+    }
+
+    void enable_table_stats( bool enabled )
+    {
+        table_stats_are_enabled = enabled;
+    }
+
+    void latency_histogram::record( const fc::microseconds& latency )
+    {
+        const uint64_t usec = std::max<int64_t>( latency.count(), 0 );
+        if( buckets.empty() )
+            buckets.resize( bucket_count );
+
+        uint32_t bucket = 0;
+        while( bucket + 1 < bucket_count && (uint64_t(1) << bucket) <= usec )
+            ++bucket;
+        ++buckets[ bucket ];
+
+        ++count;
+        total_usec += usec;
+        max_usec = std::max( max_usec, usec );
+    }
+
+    void latency_histogram::reset()
+    {
+        count = 0;
+        total_usec = 0;
+        max_usec = 0;
+        buckets.clear();
+    }
+
+    void table_stats::record_read( size_t bytes, bool found, const fc::microseconds& latency )
+    {
+        ++reads;
+        if( found ) bytes_read += bytes;
+        else ++read_misses;
+        read_latency.record( latency );
+    }
+
+    void table_stats::record_write( size_t bytes, const fc::microseconds& latency )
+    {
+        ++writes;
+        bytes_written += bytes;
+        write_latency.record( latency );
+    }
+
+    void table_stats::record_remove( const fc::microseconds& latency )
+    {
+        ++removes;
+        write_latency.record( latency );
+    }
+
+} } // bts::db
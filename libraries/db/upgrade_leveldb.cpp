@@ -1,10 +1,13 @@
 #include <bts/db/exception.hpp>
 #include <bts/db/upgrade_leveldb.hpp>
+#include <fc/filesystem.hpp>
 #include <fc/log/logger.hpp>
+#include <leveldb/write_batch.h>
 #include <boost/filesystem.hpp>
 #include <fstream>
 #include <boost/regex.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <memory>
 
 namespace bts { namespace db {
 
@@ -94,4 +97,125 @@ namespace bts { namespace db {
 
       }
     }
+
+    namespace
+    {
+        std::string read_key_encoding( const fc::path& dir )
+        {
+            const fc::path key_encoding_filename = dir / "KEY_ENCODING";
+            if( !boost::filesystem::exists( key_encoding_filename ) )
+                return raw_key_encoding_name;
+            boost::filesystem::ifstream is( key_encoding_filename );
+            std::string key_encoding;
+            std::getline( is, key_encoding );
+            return key_encoding;
+        }
+
+        void write_key_encoding( const fc::path& dir, const std::string& key_encoding )
+        {
+            boost::filesystem::ofstream os( dir / "KEY_ENCODING" );
+            os << key_encoding << std::endl;
+        }
+
+        leveldb::DB* open_for_upgrade( const fc::path& dir, const leveldb::Options& options )
+        {
+            leveldb::DB* dbase = nullptr;
+            const auto status = leveldb::DB::Open( options, dir.to_native_ansi_path(), &dbase );
+            if( !status.ok() )
+                FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+                                    ("db",dir)("msg",status.ToString()) );
+            return dbase;
+        }
+    }
+
+    void try_upgrade_key_encoding( const fc::path& dir, const std::string& key_encoding,
+                                   const leveldb::Comparator* old_comparator, const leveldb::Options& options,
+                                   const reencode_key_function& reencode_key )
+    { try {
+        const fc::path new_dir = dir.parent_path() / ( dir.filename().string() + ".rekeyed" );
+        const fc::path old_dir = dir.parent_path() / ( dir.filename().string() + ".old" );
+
+        // finish a swap that was interrupted after the new database was complete
+        if( fc::exists( old_dir ) )
+        {
+            if( fc::exists( new_dir ) )
+            {
+                fc::remove_all( dir );
+                fc::rename( new_dir, dir );
+            }
+            fc::remove_all( old_dir );
+        }
+        // otherwise an unfinished new database is just discarded
+        if( fc::exists( new_dir ) )
+            fc::remove_all( new_dir );
+
+        // a new database
+        if( !fc::exists( dir / "CURRENT" ) )
+        {
+            fc::create_directories( dir );
+            write_key_encoding( dir, key_encoding );
+            return;
+        }
+
+        const std::string old_key_encoding = read_key_encoding( dir );
+        if( old_key_encoding == key_encoding )
+        {
+            if( !fc::exists( dir / "KEY_ENCODING" ) )
+                write_key_encoding( dir, key_encoding );
+            return;
+        }
+        FC_ASSERT( old_key_encoding == raw_key_encoding_name && reencode_key,
+                   "Keys of ${db} are encoded as ${old}, which cannot be converted to ${new}",
+                   ("db",dir)("old",old_key_encoding)("new",key_encoding) );
+
+        ilog( "Converting keys of database ${db} from ${old} to ${new}",
+              ("db",dir.preferred_string())("old",old_key_encoding)("new",key_encoding) );
+
+        uint64_t count = 0;
+        {
+            leveldb::Options old_options = options;
+            old_options.comparator = old_comparator;
+            old_options.create_if_missing = false;
+            std::unique_ptr<leveldb::DB> old_db( open_for_upgrade( dir, old_options ) );
+
+            leveldb::Options new_options = options;
+            new_options.create_if_missing = true;
+            new_options.error_if_exists = true;
+            fc::create_directories( new_dir );
+            std::unique_ptr<leveldb::DB> new_db( open_for_upgrade( new_dir, new_options ) );
+
+            leveldb::ReadOptions iter_options;
+            iter_options.fill_cache = false;
+            std::unique_ptr<leveldb::Iterator> itr( old_db->NewIterator( iter_options ) );
+
+            leveldb::WriteBatch batch;
+            const auto write_batch = [&]()
+            {
+                const auto status = new_db->Write( leveldb::WriteOptions(), &batch );
+                if( !status.ok() )
+                    FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", status.ToString()) );
+                batch.Clear();
+            };
+            for( itr->SeekToFirst(); itr->Valid(); itr->Next() )
+            {
+                batch.Put( reencode_key( itr->key() ), itr->value() );
+                if( ++count % 10000 == 0 )
+                    write_batch();
+            }
+            if( !itr->status().ok() )
+                FC_THROW_EXCEPTION( db_exception, "database error: ${msg}", ("msg", itr->status().ToString()) );
+            write_batch();
+        }
+
+        if( fc::exists( dir / "RECORD_TYPE" ) )
+            fc::copy( dir / "RECORD_TYPE", new_dir / "RECORD_TYPE" );
+        write_key_encoding( new_dir, key_encoding );
+
+        fc::rename( dir, old_dir );
+        fc::rename( new_dir, dir );
+        fc::remove_all( old_dir );
+
+        ilog( "Converted ${count} keys of database ${db}", ("count",count)("db",dir.preferred_string()) );
+    } FC_CAPTURE_AND_RETHROW( (dir)(key_encoding) ) }
+
 } } // namespace bts;:db
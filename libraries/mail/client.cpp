@@ -9,7 +9,9 @@
 #include <fc/io/json.hpp>
 #include <fc/network/tcp_socket.hpp>
 
+#include <atomic>
 #include <queue>
+#include <thread>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -108,6 +110,71 @@ struct mail_index_record {
     fc::time_point_sec timestamp;
 };
 
+/**
+ * Searches for a nonce which brings a message's proof-of-work hash (its content.id()) down to a target.
+ *
+ * The message is packed once up front. Each attempt patches the nonce into a copy of the packed bytes and
+ * hashes that, rather than re-serializing the message. A single search object may be shared by several
+ * threads, each searching its own range of nonces.
+ */
+class proof_of_work_search {
+public:
+    proof_of_work_search(const message& content, const ripemd160& target)
+        : _packed_message(fc::raw::pack(content)),
+          _nonce_offset(fc::raw::pack_size(content.type) + fc::raw::pack_size(content.recipient)),
+          _target(target)
+    {
+        vector<char> packed_copy(_packed_message);
+        FC_ASSERT(hash_with_nonce(packed_copy, content.nonce) == content.id(),
+                  "Unable to locate the nonce in the packed message");
+    }
+
+    /**
+     * Tries nonces upward from first_nonce until one meets the target, stop becomes true, or the deadline passes.
+     * @param found_nonce Set to the winning nonce, if one was found
+     * @return The number of hashes computed
+     */
+    uint64_t search(uint64_t first_nonce,
+                    const fc::time_point& deadline,
+                    const std::atomic<bool>& stop,
+                    fc::optional<uint64_t>& found_nonce) const
+    {
+        vector<char> packed_copy(_packed_message);
+        uint64_t nonce = first_nonce;
+        uint64_t hashes = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            //Reading the clock costs more than a hash; only check it every so often
+            for (int i = 0; i < 1024; ++i, ++nonce) {
+                ++hashes;
+                if (hash_with_nonce(packed_copy, nonce) <= _target) {
+                    found_nonce = nonce;
+                    return hashes;
+                }
+            }
+            if (fc::time_point::now() >= deadline)
+                break;
+        }
+        return hashes;
+    }
+
+private:
+    ripemd160 hash_with_nonce(vector<char>& packed_copy, uint64_t nonce) const {
+        //fc::raw packs integers in native byte order, so this matches what packing the message would produce
+        memcpy(packed_copy.data() + _nonce_offset, &nonce, sizeof(nonce));
+        return ripemd160::hash(packed_copy.data(), packed_copy.size());
+    }
+
+    const vector<char> _packed_message;
+    const size_t _nonce_offset;
+    const ripemd160 _target;
+};
+
+//Servers from before a method was added answer it with an unknown method error
+static bool is_unknown_method_error(const variant& error) {
+    return error.is_object() && error.get_object().contains("code") &&
+           error.get_object()["code"].as_int64() == bts::rpc::unknown_method::code_value;
+}
+
 class client_impl {
 protected:
     //Dummy types to act as mnemonics for multi_index indices
@@ -131,7 +198,8 @@ public:
 
     job_queue _transmit_message_jobs;
     fc::future<void> _transmit_message_worker;
-    fc::thread _proof_of_work_thread;
+    std::vector<std::unique_ptr<fc::thread>> _proof_of_work_threads;
+    double _proof_of_work_hash_rate;
 
     fc::future<void> _archive_indexing_future;
     fc::thread _archive_indexing_thread;
@@ -180,9 +248,13 @@ public:
         : self(self),
           _wallet(wallet),
           _chain(chain),
-          _proof_of_work_thread("Mail client proof-of-work thread"),
+          _proof_of_work_hash_rate(0),
           _archive_indexing_thread("Mail client indexing thread")
-    {}
+    {
+        unsigned thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned i = 0; i < thread_count; ++i)
+            _proof_of_work_threads.emplace_back(new fc::thread("Mail client proof-of-work thread"));
+    }
     ~client_impl(){
         _proof_of_work_worker.cancel_and_wait("Mail client destroyed");
         _archive_indexing_future.cancel_and_wait();
@@ -363,28 +435,58 @@ public:
                 return;
             }
 
-            std::unique_ptr<fc::future<void>> slave_handle_uptr(new fc::future<void>());
-            fc::future<void>* slave_handle = slave_handle_uptr.get();
-            while (_processing_db.fetch(message_id).status != client::canceled &&
-                   email->content.id() > email->proof_of_work_target) {
+            bool found = email->content.id() <= email->proof_of_work_target;
+            while (!found && _processing_db.fetch(message_id).status != client::canceled) {
+                //Checkpoint: refresh the timestamp so the message isn't too old when it's done, and save progress
                 email->content.timestamp = blockchain::now();
                 _processing_db.store(email->id, *email);
 
+                const proof_of_work_search search(email->content, email->proof_of_work_target);
+                const uint64_t first_nonce = email->content.nonce;
+                const fc::time_point start_time = fc::time_point::now();
+                const fc::time_point deadline = start_time + BTS_MAIL_PROOF_OF_WORK_CHECKPOINT_INTERVAL;
+                std::atomic<bool> stop(false);
+                vector<fc::optional<uint64_t>> found_nonces(_proof_of_work_threads.size());
+                vector<fc::future<uint64_t>> slaves;
+                slaves.reserve(_proof_of_work_threads.size());
+
+                //Each thread searches its own range of nonces; whichever finds a solution first stops the others
+                for (size_t i = 0; i < _proof_of_work_threads.size(); ++i)
+                    slaves.push_back(_proof_of_work_threads[i]->async([&, i] {
+                        uint64_t hashes = search.search(first_nonce + i * BTS_MAIL_PROOF_OF_WORK_NONCE_RANGE,
+                                                        deadline, stop, found_nonces[i]);
+                        if (found_nonces[i])
+                            stop = true;
+                        return hashes;
+                    }, "Mail client proof-of-work worker"));
+
+                uint64_t total_hashes = 0;
                 try {
-                    *slave_handle = _proof_of_work_thread.async([email, slave_handle] {
-                        fc::time_point start_time = fc::time_point::now();
-                        while (!slave_handle->canceled() &&
-                               fc::time_point::now() - start_time < fc::seconds(1) &&
-                               email->content.id() > email->proof_of_work_target)
-                            ++email->content.nonce;
-                    }, "Mail client proof-of-work worker");
-
-                    slave_handle->wait();
+                    for (auto& slave : slaves)
+                        total_hashes += slave.wait();
                 } catch (fc::canceled_exception&) {
-                    slave_handle->cancel();
-                    _proof_of_work_thread.quit();
+                    //The slaves refer to this stack frame, so they must finish before we unwind it
+                    //We can't block on them with fc while canceled, but stopping takes at most a few hundred hashes
+                    stop = true;
+                    for (auto& slave : slaves)
+                        while (!slave.ready())
+                            std::this_thread::yield();
                     throw;
                 }
+
+                double elapsed_seconds = (fc::time_point::now() - start_time).count() / 1000000.0;
+                _proof_of_work_hash_rate = total_hashes / std::max(elapsed_seconds, 0.001);
+                ilog("Proof-of-work for message ${id}: ${hashes} hashes at ${rate} hashes/sec on ${threads} threads",
+                     ("id", message_id)("hashes", total_hashes)("rate", _proof_of_work_hash_rate)
+                     ("threads", _proof_of_work_threads.size()));
+
+                email->content.nonce = first_nonce + _proof_of_work_threads.size() * BTS_MAIL_PROOF_OF_WORK_NONCE_RANGE;
+                for (const auto& nonce : found_nonces)
+                    if (nonce) {
+                        email->content.nonce = *nonce;
+                        found = true;
+                        break;
+                    }
             }
 
             if (_processing_db.fetch(message_id).status == client::canceled) {
@@ -642,7 +744,7 @@ public:
                 fetch_tasks.push_back(fc::async([=] {
                     //TODO: This whole design needs to be rethought. This is just a simplistic first effort.
                     //Right now we get the inventory, then download and store ALL of it locally.
-                    //Downloading is done synchronously, with one message downloaded before the next starts.
+                    //Downloading is done synchronously, one batch of messages at a time.
                     //No deduplication of effort is done; i.e. if a given message is on three servers, we'll download
                     //it three times.
                     tcp_socket sock;
@@ -655,6 +757,7 @@ public:
                         return;
                     }
 
+                    bool batch_fetch_supported = true;
                     int received = BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE;
                     while (received == BTS_MAIL_CLIENT_MAX_INVENTORY_SIZE) {
                         mutable_variant_object request;
@@ -682,26 +785,67 @@ public:
                         inventory_type results = response["result"].as<inventory_type>();
                         received = results.size();
 
-                        for (std::pair<fc::time_point, message_id_type> email : results) {
-                            request["id"] = 1;
-                            request["method"] = "mail_fetch_message";
-                            request["params"] = vector<variant>({variant(email.second)});
-
-                            fc::json::to_stream(sock, variant_object(request));
-                            fc::getline(sock, raw_response);
-                            response = fc::json::from_string(raw_response).as<variant_object>();
-
-                            if (response["id"].as_int64() != 1)
-                                wlog("Server response has wrong ID... attempting to press on. Expected: 1; got: ${r}",
-                                     ("r", response["id"]));
-                            if (response.contains("error")) {
-                                elog("Server ${server} gave error ${error} on request ${request}",
-                                     ("server", server)("error", response["error"])("request", request));
-                                sock.close();
-                                return;
+                        //Fetch the messages in batches rather than making a round trip for each one
+                        vector<message> ciphertexts;
+                        for (size_t batch_start = 0; batch_start < results.size(); batch_start += BTS_MAIL_FETCH_MESSAGES_LIMIT) {
+                            vector<message_id_type> batch_ids;
+                            for (size_t i = batch_start; i < results.size() && i < batch_start + BTS_MAIL_FETCH_MESSAGES_LIMIT; ++i)
+                                batch_ids.push_back(results[i].second);
+
+                            if (batch_fetch_supported) {
+                                request["id"] = 1;
+                                request["method"] = "mail_fetch_messages";
+                                request["params"] = vector<variant>({variant(batch_ids)});
+
+                                fc::json::to_stream(sock, variant_object(request));
+                                fc::getline(sock, raw_response);
+                                response = fc::json::from_string(raw_response).as<variant_object>();
+
+                                if (response["id"].as_int64() != 1)
+                                    wlog("Server response has wrong ID... attempting to press on. Expected: 1; got: ${r}",
+                                         ("r", response["id"]));
+                                if (!response.contains("error")) {
+                                    for (message& ciphertext : response["result"].as<vector<message>>())
+                                        ciphertexts.push_back(std::move(ciphertext));
+                                    continue;
+                                }
+                                if (!is_unknown_method_error(response["error"])) {
+                                    elog("Server ${server} gave error ${error} on request ${request}",
+                                         ("server", server)("error", response["error"])("request", request));
+                                    sock.close();
+                                    return;
+                                }
+                                wlog("Server ${server} does not support mail_fetch_messages; fetching messages one at a time",
+                                     ("server", server));
+                                batch_fetch_supported = false;
                             }
 
-                            message ciphertext = response["result"].as<message>();
+                            //Servers from before mail_fetch_messages only serve one message per request
+                            for (const message_id_type& id : batch_ids) {
+                                request["id"] = 1;
+                                request["method"] = "mail_fetch_message";
+                                request["params"] = vector<variant>({variant(id)});
+
+                                fc::json::to_stream(sock, variant_object(request));
+                                fc::getline(sock, raw_response);
+                                response = fc::json::from_string(raw_response).as<variant_object>();
+
+                                if (response["id"].as_int64() != 1)
+                                    wlog("Server response has wrong ID... attempting to press on. Expected: 1; got: ${r}",
+                                         ("r", response["id"]));
+                                if (response.contains("error")) {
+                                    elog("Server ${server} gave error ${error} on request ${request}",
+                                         ("server", server)("error", response["error"])("request", request));
+                                    sock.close();
+                                    return;
+                                }
+
+                                ciphertexts.push_back(response["result"].as<message>());
+                            }
+                        }
+
+                        for (message& ciphertext : ciphertexts) {
+                            const message_id_type message_id = ciphertext.id();
                             message plaintext = _wallet->mail_open(account.account_address, ciphertext);
                             email_header header;
                             header.id = ciphertext.id();
@@ -729,7 +873,7 @@ public:
                             mail_archive_record record(std::move(ciphertext), header, account.account_address);
                             bool new_mail = false;
 
-                            if (auto optional_record = _archive.fetch_optional(email.second)) {
+                            if (auto optional_record = _archive.fetch_optional(message_id)) {
                                 record = *optional_record;
                                 if (record.status == client::accepted) {
                                     //We sent this message, but it's still newly received mail
@@ -741,7 +885,7 @@ public:
 
                             record.mail_servers.insert(std::move(server));
 
-                            _archive.store(email.second, record);
+                            _archive.store(message_id, record);
                             _mail_index.insert(header);
 
                             if (new_mail) {
@@ -919,6 +1063,11 @@ std::vector<email_header> client::get_messages_by_recipient(std::string recipien
     return my->get_messages_by_recipient(recipient);
 }
 
+double client::get_proof_of_work_hash_rate() const
+{
+    return my->_proof_of_work_hash_rate;
+}
+
 std::vector<email_header> client::get_messages_from_to(std::string sender, std::string recipient)
 {
     FC_ASSERT(my->is_open());
@@ -65,6 +65,9 @@ public:
     std::vector<email_header> get_messages_by_sender(string sender);
     std::vector<email_header> get_messages_by_recipient(string recipient);
     std::vector<email_header> get_messages_from_to(string sender, string recipient);
+
+    /// Hashes per second achieved across all threads during the most recent proof-of-work checkpoint interval
+    double get_proof_of_work_hash_rate() const;
 private:
     std::shared_ptr<detail::client_impl> my;
 };
@@ -1,7 +1,13 @@
 #pragma once
 
 #define BTS_MAIL_INVENTORY_FETCH_LIMIT 4096
+#define BTS_MAIL_FETCH_MESSAGES_LIMIT 256
+#define BTS_MAIL_DEFAULT_RETENTION_DAYS 30
 #define BTS_MAIL_MAX_MESSAGE_SIZE_BYTES (1024*1024)
 #define BTS_MAIL_MAX_MESSAGE_AGE (fc::minutes(5))
 #define BTS_MAIL_PROOF_OF_WORK_TARGET (fc::ripemd160("000ffffffdeadbeeffffffffffffffffffffffff"))
+//How often a message undergoing proof-of-work gets a fresh timestamp and has its progress saved
+#define BTS_MAIL_PROOF_OF_WORK_CHECKPOINT_INTERVAL (fc::seconds(5))
+//Size of the nonce range each proof-of-work thread searches between checkpoints
+#define BTS_MAIL_PROOF_OF_WORK_NONCE_RANGE (uint64_t(1) << 32)
 #define BTS_MAIL_DEFAULT_MAIL_SERVERS (std::unordered_set<std::string>({"nathanhourt.com"}))
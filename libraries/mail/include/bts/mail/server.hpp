@@ -21,6 +21,10 @@ namespace bts { namespace mail {
     *  mail_store( owner, message )
     *  mail_fetch_inventory( owner, start_time, limit ) => vector<message_id_type>
     *  mail_fetch_message( message_id_type )
+    *  mail_fetch_messages( vector<message_id_type> ) => vector<message>
+    *
+    *  Messages are stored in one segment per day of receipt, and segments older than the
+    *  retention period are deleted outright.
     */
     class server : public std::enable_shared_from_this<server>
     {
@@ -28,7 +32,7 @@ namespace bts { namespace mail {
           server();
           ~server();
 
-          void open( const fc::path& data_dir );
+          void open( const fc::path& data_dir, uint32_t retention_days = BTS_MAIL_DEFAULT_RETENTION_DAYS );
           void close();
           
           void store(const message& msg );
@@ -37,6 +41,8 @@ namespace bts { namespace mail {
                                           const fc::time_point& start, 
                                           uint32_t limit = BTS_MAIL_INVENTORY_FETCH_LIMIT )const;
           message fetch_message( const message_id_type& inventory_id )const;
+          /** Fetches up to BTS_MAIL_FETCH_MESSAGES_LIMIT messages; ids not stored on this server are skipped */
+          std::vector<message> fetch_messages( const std::vector<message_id_type>& inventory_ids )const;
 
        private:
           std::unique_ptr<detail::server_impl> my;
@@ -5,23 +5,62 @@
 #include <bts/blockchain/time.hpp>
 #include <fc/reflect/variant.hpp>
 #include <fc/crypto/ripemd160.hpp>
+#include <fc/filesystem.hpp>
 #include <fc/time.hpp>
 
 namespace bts { namespace mail {
 
+/**
+ *  Key of the inventory index within a segment.  The receive time is split into two 32 bit
+ *  fields so the key packs into 28 bytes with no padding.
+ */
 struct mail_index
 {
+   mail_index():received_sec(0),received_usec(0){}
+   mail_index( const bts::blockchain::address& owner, const fc::time_point& received )
+   :owner(owner),
+    received_sec( received.sec_since_epoch() ),
+    received_usec( received.time_since_epoch().count() % 1000000 ){}
+
+   fc::time_point received()const
+   {
+      return fc::time_point( fc::seconds(received_sec) + fc::microseconds(received_usec) );
+   }
+
    bts::blockchain::address    owner;
-   fc::time_point              received;
+   uint32_t                    received_sec;
+   uint32_t                    received_usec;
 };
 
 bool operator < ( const mail_index& a, const mail_index& b )
 {
    if( a.owner < b.owner ) return true;
-   if( a.owner == b.owner ) return a.received < b.received;
+   if( a.owner == b.owner )
+   {
+      if( a.received_sec < b.received_sec ) return true;
+      if( a.received_sec == b.received_sec ) return a.received_usec < b.received_usec;
+   }
    return false;
 }
 bool operator == ( const mail_index& a, const mail_index& b )
+{
+   return a.owner == b.owner && a.received_sec == b.received_sec && a.received_usec == b.received_usec;
+}
+
+/** Inventory key used before storage was split into segments; only read when migrating */
+struct legacy_mail_index
+{
+   bts::blockchain::address    owner;
+   fc::time_point              received;
+};
+
+bool operator < ( const legacy_mail_index& a, const legacy_mail_index& b )
+{
+   if( a.owner < b.owner ) return true;
+   if( a.owner == b.owner ) return a.received < b.received;
+   return false;
+}
+bool operator == ( const legacy_mail_index& a, const legacy_mail_index& b )
 {
    return a.owner == b.owner && a.received == b.received;
 }
@@ -34,20 +73,63 @@ namespace bts { namespace mail {
 
    namespace detail
    {
+      /**
+       *  All messages received on one (UTC) day, with the inventory index for them.  Expiring
+       *  old mail is done by deleting whole segments, so no database ever has to be compacted.
+       */
+      struct mail_segment
+      {
+         bts::db::level_pod_map< mail_index, message_id_type >   inventory_db;
+         bts::db::level_map< message_id_type, message >          data_db;
+         fc::path                                                path;
+
+         void open( const fc::path& segment_path )
+         {
+            path = segment_path;
+            inventory_db.open( path / "mail_inventory_db" );
+            data_db.open( path / "mail_data_db" );
+         }
+
+         void close()
+         {
+            inventory_db.close();
+            data_db.close();
+         }
+      };
+
       class server_impl
       {
           public:
-            server_impl( const fc::path& data_dir )
+            server_impl( const fc::path& data_dir, uint32_t retention_days )
+            :_segments_dir( data_dir / "segments" ),
+             _retention_days( std::max<uint32_t>( retention_days, 1 ) )
             {
-               _mail_inventory_db.open( data_dir / "mail_inventory_db" );
-               _mail_data_db.open( data_dir / "mail_data_db" );
+               fc::create_directories( _segments_dir );
+               fc::directory_iterator end_itr;
+               for( fc::directory_iterator itr( _segments_dir ); itr != end_itr; ++itr )
+               {
+                  if( !fc::is_directory( *itr ) )
+                     continue;
+                  try
+                  {
+                     uint32_t day = day_of( fc::time_point_sec::from_iso_string( itr->filename().string() + "T00:00:00" ) );
+                     get_segment( day );
+                  }
+                  catch ( const fc::exception& e )
+                  {
+                     wlog( "ignoring unexpected directory ${d} in mail storage: ${e}", ("d",*itr)("e",e.to_detail_string()) );
+                  }
+               }
+
+               migrate_unsegmented_databases( data_dir );
+               drop_expired_segments();
             }
 
             ~server_impl()
             {
                try {
-                  _mail_inventory_db.close();
-                  _mail_data_db.close();
+                  for( auto& segment : _segments )
+                     segment.second->close();
                } 
                catch ( const fc::exception& e )
                {
@@ -55,20 +137,98 @@ namespace bts { namespace mail {
                }
             }
 
+            static uint32_t day_of( const fc::time_point& time )
+            {
+               return time.sec_since_epoch() / (60 * 60 * 24);
+            }
+
+            mail_segment& get_segment( uint32_t day )
+            {
+               auto itr = _segments.find( day );
+               if( itr != _segments.end() )
+                  return *itr->second;
+
+               std::string name = fc::time_point_sec( day * (60 * 60 * 24) ).to_iso_string().substr( 0, 10 );
+               std::unique_ptr<mail_segment> segment( new mail_segment );
+               segment->open( _segments_dir / name );
+               return *_segments.emplace( day, std::move(segment) ).first->second;
+            }
+
+            void drop_expired_segments()
+            {
+               uint32_t today = day_of( blockchain::now() );
+               if( today < _retention_days )
+                  return;
+               uint32_t oldest_retained_day = today - _retention_days + 1;
+
+               while( !_segments.empty() && _segments.begin()->first < oldest_retained_day )
+               {
+                  fc::path segment_path = _segments.begin()->second->path;
+                  ilog( "removing expired mail segment ${path}", ("path",segment_path) );
+                  _segments.begin()->second->close();
+                  _segments.erase( _segments.begin() );
+                  fc::remove_all( segment_path );
+               }
+            }
+
+            /** Moves mail from the single pair of databases used before segmenting into per-day segments */
+            void migrate_unsegmented_databases( const fc::path& data_dir )
+            { try {
+               const fc::path old_inventory_dir = data_dir / "mail_inventory_db";
+               const fc::path old_data_dir = data_dir / "mail_data_db";
+               if( !fc::exists( old_inventory_dir ) || !fc::exists( old_data_dir ) )
+                  return;
+
+               ilog( "migrating mail server storage to per-day segments" );
+               {
+                  bts::db::level_pod_map< legacy_mail_index, message_id_type > old_inventory_db;
+                  bts::db::level_map< message_id_type, message >               old_data_db;
+                  old_inventory_db.open( old_inventory_dir );
+                  old_data_db.open( old_data_dir );
+
+                  for( auto itr = old_inventory_db.begin(); itr.valid(); ++itr )
+                  {
+                     const legacy_mail_index key = itr.key();
+                     const message_id_type inventory_id = itr.value();
+                     const auto msg = old_data_db.fetch_optional( inventory_id );
+                     if( !msg )
+                        continue;
+
+                     mail_segment& segment = get_segment( day_of( key.received ) );
+                     segment.inventory_db.store( mail_index( key.owner, key.received ), inventory_id );
+                     segment.data_db.store( inventory_id, *msg );
+                  }
+
+                  old_inventory_db.close();
+                  old_data_db.close();
+               }
+               fc::remove_all( old_inventory_dir );
+               fc::remove_all( old_data_dir );
+            } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
+
             void store( const message& msg )
             { try {
                FC_ASSERT( msg.data.size() > 0 );
 
                auto inventory_id = msg.id();
+               // the same clock check_incoming_message() and the clients' last_fetch times use
+               const fc::time_point now = blockchain::now();
 
                /**
                 *  Prevent the same message from going to multiple accounts.
+                *
+                *  Messages must be stored within BTS_MAIL_MAX_MESSAGE_AGE of their timestamp, which is
+                *  part of their id, so a duplicate can only be in the segment for today or the one for
+                *  that long ago.
                 */
-               if( _mail_data_db.fetch_optional(inventory_id) )
+               if( find_message( inventory_id, day_of( now - BTS_MAIL_MAX_MESSAGE_AGE ) ) )
                   FC_THROW_EXCEPTION( message_already_stored, "Message already stored on server." );
 
-               _mail_inventory_db.store( mail_index{msg.recipient,fc::time_point::now()}, inventory_id );
-               _mail_data_db.store( inventory_id, msg );
+               drop_expired_segments();
+
+               mail_segment& segment = get_segment( day_of( now ) );
+               segment.inventory_db.store( mail_index( msg.recipient, now ), inventory_id );
+               segment.data_db.store( inventory_id, msg );
             } FC_CAPTURE_AND_RETHROW( (msg) ) }
 
             inventory_type fetch_inventory( const bts::blockchain::address& owner, 
@@ -81,24 +241,60 @@ namespace bts { namespace mail {
                inventory_type result;
                result.reserve( limit );
 
-               auto itr = _mail_inventory_db.lower_bound( mail_index{ owner, start } );
-               while( itr.valid() && result.size() < limit )
+               // segments are ordered by day, so scanning them in order keeps the inventory sorted by time
+               for( auto segment_itr = _segments.lower_bound( day_of( start ) );
+                    segment_itr != _segments.end() && result.size() < limit;
+                    ++segment_itr )
                {
-                  const auto key = itr.key();
-                  if( key.owner == owner )
-                     result.push_back( pair<fc::time_point,message_id_type>(key.received,itr.value()) );
-                  else
-                     return result;
-                  ++itr;
+                  auto itr = segment_itr->second->inventory_db.lower_bound( mail_index( owner, start ) );
+                  while( itr.valid() && result.size() < limit )
+                  {
+                     const auto key = itr.key();
+                     if( key.owner != owner )
+                        break;
+                     result.push_back( pair<fc::time_point,message_id_type>(key.received(),itr.value()) );
+                     ++itr;
+                  }
                }
                return result;
             } FC_CAPTURE_AND_RETHROW( (owner)(start)(limit) ) }
 
+            /** Searches the segments from newest down to oldest_day for a message */
+            fc::optional<message> find_message( const message_id_type& inventory_id, uint32_t oldest_day = 0 )
+            {
+               for( auto itr = _segments.rbegin(); itr != _segments.rend() && itr->first >= oldest_day; ++itr )
+               {
+                  auto msg = itr->second->data_db.fetch_optional( inventory_id );
+                  if( msg )
+                     return msg;
+               }
+               return fc::optional<message>();
+            }
+
             message fetch_message( const message_id_type& inventory_id )
             { try {
-               return _mail_data_db.fetch( inventory_id );
+               auto msg = find_message( inventory_id );
+               if( !msg )
+                  FC_THROW_EXCEPTION( fc::key_not_found_exception, "Message not stored on server." );
+               return *msg;
             } FC_CAPTURE_AND_RETHROW( (inventory_id) ) }
 
+            vector<message> fetch_messages( const vector<message_id_type>& inventory_ids )
+            { try {
+               FC_ASSERT( inventory_ids.size() <= BTS_MAIL_FETCH_MESSAGES_LIMIT,
+                          "Cannot fetch more than ${limit} messages at once", ("limit",BTS_MAIL_FETCH_MESSAGES_LIMIT) );
+
+               vector<message> result;
+               result.reserve( inventory_ids.size() );
+               for( const auto& inventory_id : inventory_ids )
+               {
+                  auto msg = find_message( inventory_id );
+                  if( msg )
+                     result.push_back( std::move( *msg ) );
+               }
+               return result;
+            } FC_CAPTURE_AND_RETHROW( (inventory_ids) ) }
+
             void check_incoming_message( const message& msg )
             { try {
                auto now = blockchain::now();
@@ -121,8 +317,9 @@ namespace bts { namespace mail {
             } FC_CAPTURE_AND_RETHROW( (msg) ) }
 
          private:
-            bts::db::level_pod_map< mail_index, message_id_type >   _mail_inventory_db;
-            bts::db::level_map< message_id_type, message >          _mail_data_db;
+            fc::path                                            _segments_dir;
+            uint32_t                                            _retention_days;
+            std::map< uint32_t, std::unique_ptr<mail_segment> > _segments;
       };
 
    } // namespace detail
@@ -131,9 +328,9 @@ namespace bts { namespace mail {
    server::server(){}
    server::~server(){}
    
-   void server::open( const fc::path& datadir )
+   void server::open( const fc::path& datadir, uint32_t retention_days )
    {
-      my.reset( new detail::server_impl( datadir ) );
+      my.reset( new detail::server_impl( datadir, retention_days ) );
    }
    void server::close()
    {
@@ -156,7 +353,12 @@ namespace bts { namespace mail {
    {
       return my->fetch_message( inventory_id );
    }
+   vector<message> server::fetch_messages( const vector<message_id_type>& inventory_ids )const
+   {
+      return my->fetch_messages( inventory_ids );
+   }
 
 } } // bts::mail
 
-FC_REFLECT( bts::mail::mail_index, (owner)(received) );
+FC_REFLECT( bts::mail::mail_index, (owner)(received_sec)(received_usec) );
+FC_REFLECT( bts::mail::legacy_mail_index, (owner)(received) );
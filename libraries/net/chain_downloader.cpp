@@ -1,53 +1,207 @@
 #include <algorithm>
 #include <bts/net/chain_downloader.hpp>
 #include <bts/net/chain_server_commands.hpp>
+#include <bts/net/config.hpp>
+#include <bts/utilities/compression.hpp>
 
 #include <fc/network/tcp_socket.hpp>
 #include <fc/io/raw_variant.hpp>
 #include <fc/thread/thread.hpp>
 
+#include <deque>
+#include <list>
+#include <map>
+
 namespace bts { namespace net {
 
     namespace detail {
+      struct download_worker {
+          fc::ip::endpoint               server;
+          fc::future<void>               done;
+          fc::time_point                 checkpoint;
+      };
+
       class chain_downloader_impl {
         public:
           chain_downloader* self;
 
-          std::unique_ptr<fc::tcp_socket> _client_socket;
           std::vector<fc::ip::endpoint> _chain_servers;
 
-          void connect_to_chain_server()
-          { try {
-              _client_socket = std::unique_ptr<fc::tcp_socket>(new fc::tcp_socket);
-              while(!_client_socket->is_open() && !_chain_servers.empty()) {
-                  auto next_server = _chain_servers.back();
-                  _chain_servers.pop_back();
-                  _client_socket = std::unique_ptr<fc::tcp_socket>(new fc::tcp_socket);
-                  try
-                  {
-                      ilog("Attempting to connect to chain server ${s}", ("s",next_server));
-                      _client_socket->connect_to(next_server);
-                  }
-                  catch ( const fc::canceled_exception& )
-                  {
-                      throw;
+          void add_chain_server(const fc::ip::endpoint& server)
+          {
+              if (std::find(_chain_servers.begin(), _chain_servers.end(), server) == _chain_servers.end())
+                  _chain_servers.push_back(server);
+          }
+
+          std::function<void (const blockchain::full_block&, uint32_t)> _new_block_callback;
+          /// The next block to hand to _new_block_callback
+          uint32_t _next_block_to_deliver = 1;
+          /// The first block not yet assigned to any range
+          uint32_t _next_range_start = 1;
+          /// The highest head block number reported by any server
+          uint32_t _target_block_number = 0;
+          /// Ranges which were assigned to a server that failed before delivering all of them
+          std::deque<std::pair<uint32_t, uint32_t>> _unfinished_ranges;
+          /// Blocks which arrived ahead of _next_block_to_deliver
+          std::map<uint32_t, blockchain::full_block> _received_blocks;
+          bool _delivering_blocks = false;
+
+          std::unique_ptr<fc::tcp_socket> connect_to_chain_server(const fc::ip::endpoint& server)
+          {
+              std::unique_ptr<fc::tcp_socket> client_socket(new fc::tcp_socket);
+              try
+              {
+                  ilog("Attempting to connect to chain server ${s}", ("s",server));
+                  client_socket->connect_to(server);
+              }
+              catch ( const fc::canceled_exception& )
+              {
+                  throw;
+              }
+              catch (const fc::exception& e) {
+                  wlog("Failed to connect to chain_server: ${e}", ("e", e.to_detail_string()));
+                  return nullptr;
+              }
+
+              uint32_t protocol_version = -1;
+              fc::raw::unpack(*client_socket, protocol_version);
+              if (protocol_version != PROTOCOL_VERSION) {
+                  wlog("Can't talk to chain server; he's using protocol ${srv} and I'm using ${cli}!",
+                       ("srv", protocol_version)("cli", PROTOCOL_VERSION));
+                  fc::raw::pack(*client_socket, finish);
+                  client_socket->close();
+                  return nullptr;
+              }
+              return client_socket;
+          }
+
+          /**
+           * Hands all blocks which are now contiguous with what the caller has already seen to the callback.
+           * Several workers may receive blocks at once, but only one of them delivers at a time so the callback
+           * always sees blocks in order.
+           */
+          void deliver_ready_blocks(download_worker& worker)
+          {
+              if (_delivering_blocks)
+                  return;
+              _delivering_blocks = true;
+              try {
+                  auto itr = _received_blocks.begin();
+                  while (itr != _received_blocks.end() && itr->first == _next_block_to_deliver) {
+                      worker.checkpoint = fc::time_point::now();
+                      // the callback may yield, and other workers may add blocks meanwhile; only retire this block
+                      // once the callback accepted it so a cancelled delivery doesn't leave a hole in the chain
+                      _new_block_callback(itr->second, _target_block_number - itr->first + 1);
+                      _received_blocks.erase(_next_block_to_deliver++);
+                      itr = _received_blocks.begin();
                   }
-                  catch (const fc::exception& e) {
-                      wlog("Failed to connect to chain_server: ${e}", ("e", e.to_detail_string()));
-                      _client_socket->close();
+              } catch (...) {
+                  _delivering_blocks = false;
+                  throw;
+              }
+              _delivering_blocks = false;
+          }
+
+          /**
+           * Picks the next range for a worker to download, or returns false if there's nothing left below head_block.
+           * Ranges are clamped to head_block, so a server is never asked for blocks it has told us it doesn't have.
+           */
+          bool take_range(uint32_t head_block, std::pair<uint32_t, uint32_t>& range)
+          {
+              for (auto itr = _unfinished_ranges.begin(); itr != _unfinished_ranges.end(); ++itr) {
+                  if (itr->first > head_block)
                       continue;
+                  range = *itr;
+                  _unfinished_ranges.erase(itr);
+                  if (range.second > head_block) {
+                      _unfinished_ranges.emplace_back(head_block + 1, range.second);
+                      range.second = head_block;
                   }
+                  return true;
+              }
+              if (_next_range_start > head_block)
+                  return false;
+              range.first = _next_range_start;
+              range.second = std::min(head_block, _next_range_start + BTS_NET_CHAIN_DOWNLOADER_RANGE_SIZE - 1);
+              _next_range_start = range.second + 1;
+              return true;
+          }
+
+          void download_from_server(download_worker& worker)
+          {
+              worker.checkpoint = fc::time_point::now();
+              auto client_socket = connect_to_chain_server(worker.server);
+              FC_ASSERT(client_socket, "could not start a session with chain server ${s}", ("s", worker.server));
+              worker.checkpoint = fc::time_point::now();
+              ilog("Connected to ${remote}", ("remote", worker.server));
+
+              uint8_t compression = bts::utilities::compression_available() ? zlib_compression : no_compression;
+              std::pair<uint32_t, uint32_t> range(1, 0);
+              try {
+                  while (true) {
+                      // don't run too far ahead of the blocks we've delivered, or we'll pile up blocks in memory
+                      while (_unfinished_ranges.empty() &&
+                             _next_range_start > _next_block_to_deliver + BTS_NET_CHAIN_DOWNLOADER_MAX_LOOKAHEAD_BLOCKS) {
+                          worker.checkpoint = fc::time_point::now();
+                          fc::usleep(fc::milliseconds(100));
+                      }
+
+                      uint32_t head_block = 0;
+                      fc::raw::pack(*client_socket, get_head_block_number);
+                      fc::raw::unpack(*client_socket, head_block);
+                      _target_block_number = std::max(_target_block_number, head_block);
+                      if (!take_range(head_block, range))
+                          break;
+
+                      ilog("Requesting blocks ${first} to ${last} from ${remote}",
+                           ("first", range.first)("last", range.second)("remote", worker.server));
+                      const uint32_t requested_first = range.first;
+                      fc::raw::pack(*client_socket, get_block_range);
+                      fc::raw::pack(*client_socket, range.first);
+                      fc::raw::pack(*client_socket, range.second);
+                      fc::raw::pack(*client_socket, compression);
+
+                      block_frame frame;
+                      fc::raw::unpack(*client_socket, frame);
+                      while (frame.block_count > 0) {
+                          worker.checkpoint = fc::time_point::now();
+                          FC_ASSERT(frame.uncompressed_size <= BTS_NET_CHAIN_SERVER_MAX_FRAME_SIZE * 2,
+                                    "chain server sent an oversized frame", ("size", frame.uncompressed_size));
+                          std::vector<char> payload = frame.compressed ?
+                                  bts::utilities::zlib_decompress(frame.data.data(), frame.data.size(), frame.uncompressed_size) :
+                                  std::move(frame.data);
+
+                          fc::datastream<const char*> payload_stream(payload.data(), payload.size());
+                          for (uint32_t i = 0; i < frame.block_count; ++i) {
+                              blockchain::full_block block;
+                              fc::raw::unpack(payload_stream, block);
+                              FC_ASSERT(block.block_num == range.first, "chain server sent blocks out of order",
+                                        ("expected", range.first)("got", block.block_num));
+                              _received_blocks.emplace(range.first++, std::move(block));
+                          }
+                          deliver_ready_blocks(worker);
+
+                          fc::raw::unpack(*client_socket, frame);
+                      }
+                      // an empty reply is still an answer; the server is alive, it just had nothing more to send
+                      worker.checkpoint = fc::time_point::now();
 
-                  uint32_t protocol_version = -1;
-                  fc::raw::unpack(*_client_socket, protocol_version);
-                  if (protocol_version != PROTOCOL_VERSION) {
-                      wlog("Can't talk to chain server; he's using protocol ${srv} and I'm using ${cli}!",
-                           ("srv", protocol_version)("cli", PROTOCOL_VERSION));
-                      fc::raw::pack(*_client_socket, finish);
-                      _client_socket->close();
+                      // The server stops at its own head block, which may be below what we asked for
+                      const bool received_nothing = range.first == requested_first;
+                      if (range.first <= range.second)
+                          _unfinished_ranges.emplace_back(range);
+                      range = std::make_pair(1, 0);
+                      // a server whose head went backwards (e.g. it switched forks) would just send nothing again
+                      if (received_nothing)
+                          break;
                   }
+                  fc::raw::pack(*client_socket, finish);
+              } catch (...) {
+                  if (range.first <= range.second)
+                      _unfinished_ranges.emplace_back(range);
+                  throw;
               }
-          } FC_RETHROW_EXCEPTIONS(error, "") }
+          }
 
           void get_all_blocks(std::function<void (const blockchain::full_block&, uint32_t)> new_block_callback,
                               uint32_t first_block_number)
@@ -55,70 +209,77 @@ namespace bts { namespace net {
               if (!new_block_callback)
                   return;
 
-              fc::future<void> work_future;
-              while(!_chain_servers.empty()) {
-                 try {
-                    fc::time_point checkpoint = fc::time_point::now();
-
-                    work_future = fc::async([&]{
-                       connect_to_chain_server();
-                       checkpoint = fc::time_point::now();
-                       FC_ASSERT(_client_socket->is_open(), "unable to connect to any chain server");
-                       ilog("Connected to ${remote}; requesting blocks after ${num}",
-                            ("remote", _client_socket->remote_endpoint())("num", first_block_number));
-
-                       ulog("Starting fast-sync of blocks from ${num}", ("num", first_block_number));
-                       auto start_time = fc::time_point::now();
-
-                       fc::raw::pack(*_client_socket, get_blocks_from_number);
-                       fc::raw::pack(*_client_socket, first_block_number);
-
-                       uint32_t blocks_to_retrieve = 0;
-                       uint32_t blocks_in = 0;
-                       fc::raw::unpack(*_client_socket, blocks_to_retrieve);
-                       ilog("Server at ${remote} is sending us ${num} blocks.",
-                            ("remote", _client_socket->remote_endpoint())("num", blocks_to_retrieve));
-
-                       while(blocks_to_retrieve > 0)
-                       {
-                           checkpoint = fc::time_point::now();
-                           blockchain::full_block block;
-                           fc::raw::unpack(*_client_socket, block);
-
-                           new_block_callback(block, blocks_to_retrieve);
-                           --blocks_to_retrieve;
-                           ++blocks_in;
-
-                           if(blocks_to_retrieve == 0) {
-                               fc::raw::unpack(*_client_socket, blocks_to_retrieve);
-                               if(blocks_to_retrieve > 0)
-                                   ilog("Server at ${remote} is sending us ${num} blocks.",
-                                        ("remote", _client_socket->remote_endpoint())("num", blocks_to_retrieve));
-                           }
-                       }
-                       checkpoint = fc::time_point::now();
-
-                       ulog("Finished fast-syncing ${num} blocks at ${rate} blocks/sec.",
-                            ("num", blocks_in)("rate", blocks_in/((fc::time_point::now() - start_time).count() / 1000000.0)));
-                       wlog("Finished getting ${num} blocks from ${remote} at ${rate} blocks/sec.",
-                            ("num", blocks_in)("remote", _client_socket->remote_endpoint())
-                            ("rate", blocks_in/((fc::time_point::now() - start_time).count() / 1000000.0)));
-                       fc::raw::pack(*_client_socket, finish);
-                    }, "get_all_blocks worker");
-
-                    while(!work_future.ready()) {
-                        if(fc::time_point::now() - checkpoint > fc::seconds(1)) {
-                            work_future.cancel_and_wait("Timed out");
-                            FC_THROW("Timed out");
-                        }
-                        fc::sleep_until(fc::time_point::now() + fc::milliseconds(500));
-                    }
-                 } catch(fc::canceled_exception) {
-                      work_future.cancel_and_wait();
-                      throw;
-                 }
-                 FC_CAPTURE_AND_LOG((_client_socket->remote_endpoint()))
+              _new_block_callback = new_block_callback;
+              _next_block_to_deliver = _next_range_start = std::max<uint32_t>(first_block_number, 1);
+              _target_block_number = 0;
+              _unfinished_ranges.clear();
+              _received_blocks.clear();
+
+              ulog("Starting fast-sync of blocks from ${num}", ("num", _next_block_to_deliver));
+              auto start_time = fc::time_point::now();
+
+              // std::list, so workers can keep references to their entries while others are added and removed
+              std::list<download_worker> workers;
+              // servers whose workers finished without error go back into _chain_servers once we're done, so a
+              // server that was merely behind the others can be used again by the next sync
+              std::vector<fc::ip::endpoint> healthy_servers;
+              auto return_healthy_servers = [&] {
+                  for (const fc::ip::endpoint& server : healthy_servers)
+                      add_chain_server(server);
+                  healthy_servers.clear();
+              };
+              bool started = false;
+              try {
+                  while (true) {
+                      // After the first round, only bring in more servers to pick up ranges a failed server left
+                      bool work_remains = !started || !_unfinished_ranges.empty();
+                      while (work_remains && !_chain_servers.empty() &&
+                             workers.size() < BTS_NET_CHAIN_DOWNLOADER_MAX_SERVER_CONNECTIONS) {
+                          workers.emplace_back();
+                          download_worker& worker = workers.back();
+                          worker.server = _chain_servers.back();
+                          _chain_servers.pop_back();
+                          worker.checkpoint = fc::time_point::now();
+                          worker.done = fc::async([this, &worker]{ download_from_server(worker); }, "chain_downloader worker");
+                      }
+                      started = true;
+                      if (workers.empty())
+                          break;
+
+                      fc::usleep(fc::milliseconds(500));
+
+                      for (auto itr = workers.begin(); itr != workers.end();) {
+                          if (!itr->done.ready() &&
+                              fc::time_point::now() - itr->checkpoint > fc::seconds(BTS_NET_CHAIN_DOWNLOADER_TIMEOUT_SEC)) {
+                              wlog("Chain server ${remote} timed out", ("remote", itr->server));
+                              itr->done.cancel_and_wait("Timed out");
+                          }
+                          if (itr->done.ready()) {
+                              try {
+                                  itr->done.wait();
+                                  healthy_servers.push_back(itr->server);
+                              } FC_CAPTURE_AND_LOG((itr->server))
+                              itr = workers.erase(itr);
+                          } else
+                              ++itr;
+                      }
+                  }
+              } catch (const fc::canceled_exception&) {
+                  for (auto& worker : workers)
+                      if (!worker.done.ready())
+                          worker.done.cancel_and_wait();
+                  return_healthy_servers();
+                  throw;
               }
+              return_healthy_servers();
+
+              if (!_unfinished_ranges.empty() || !_received_blocks.empty())
+                  wlog("Ran out of chain servers before downloading every block; stopped at block ${num}",
+                       ("num", _next_block_to_deliver));
+
+              uint32_t blocks_in = _next_block_to_deliver - std::max<uint32_t>(first_block_number, 1);
+              ulog("Finished fast-syncing ${num} blocks at ${rate} blocks/sec.",
+                   ("num", blocks_in)("rate", blocks_in/((fc::time_point::now() - start_time).count() / 1000000.0)));
           } FC_RETHROW_EXCEPTIONS(error, "", ("first_block_number", first_block_number)) }
       };
     } //namespace detail
@@ -135,8 +296,7 @@ namespace bts { namespace net {
 
     void chain_downloader::add_chain_server(const fc::ip::endpoint& server)
     {
-        if(std::find(my->_chain_servers.begin(), my->_chain_servers.end(), server) == my->_chain_servers.end())
-            my->_chain_servers.push_back(server);
+        my->add_chain_server(server);
     }
 
     void chain_downloader::add_chain_servers(const std::vector<fc::ip::endpoint>& servers)
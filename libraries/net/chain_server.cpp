@@ -1,6 +1,8 @@
 #include <bts/net/stcp_socket.hpp>
 #include <bts/net/chain_server.hpp>
 #include <bts/net/chain_server_commands.hpp>
+#include <bts/net/config.hpp>
+#include <bts/utilities/compression.hpp>
 
 #include <fc/io/raw_variant.hpp>
 #include <fc/thread/thread.hpp>
@@ -97,6 +99,77 @@ namespace bts { namespace net {
               } FC_RETHROW_EXCEPTIONS(error, "", ("remote_endpoint", connection_socket.remote_endpoint()))
             }
 
+            void handle_get_head_block_number(fc::tcp_socket& connection_socket) {
+                fc::raw::pack(connection_socket, _chain_db->get_head_block_num());
+            }
+
+            /**
+             * Reads blocks starting at next_block from the chain database and packs them into a single frame,
+             * advancing next_block past the blocks it consumed. Returns an empty frame when next_block > last_block.
+             */
+            block_frame build_frame(uint32_t& next_block, uint32_t last_block, bool compress) {
+                block_frame frame;
+                std::vector<char> payload;
+                while (next_block <= last_block &&
+                       frame.block_count < BTS_NET_CHAIN_SERVER_MAX_BLOCKS_PER_FRAME &&
+                       payload.size() < BTS_NET_CHAIN_SERVER_MAX_FRAME_SIZE) {
+                    auto packed_block = fc::raw::pack(_chain_db->get_block(next_block));
+                    payload.insert(payload.end(), packed_block.begin(), packed_block.end());
+                    ++frame.block_count;
+                    ++next_block;
+                }
+
+                frame.uncompressed_size = payload.size();
+                if (compress && !payload.empty()) {
+                    auto compressed_payload = bts::utilities::zlib_compress(payload.data(), payload.size());
+                    // not worth making the client inflate it if we didn't save anything
+                    if (compressed_payload.size() < payload.size()) {
+                        frame.compressed = true;
+                        frame.data = std::move(compressed_payload);
+                    }
+                }
+                if (!frame.compressed)
+                    frame.data = std::move(payload);
+                return frame;
+            }
+
+            void handle_get_block_range(fc::tcp_socket& connection_socket) {
+                uint32_t first_block;
+                uint32_t last_block;
+                uint8_t compression;
+                fc::raw::unpack(connection_socket, first_block);
+                fc::raw::unpack(connection_socket, last_block);
+                fc::raw::unpack(connection_socket, compression);
+                if (first_block == 0) first_block = 1;
+                last_block = std::min(last_block, _chain_db->get_head_block_num());
+                bool compress = compression == zlib_compression && bts::utilities::compression_available();
+
+                ilog("Streaming blocks from ${start} to ${finish} to ${remote}",
+                     ("start", first_block)("finish", last_block)("remote", connection_socket.remote_endpoint()));
+
+                // While one frame is being written to the socket, the next one is read from the database and
+                // compressed in a separate task, so disk, CPU and network stay busy at the same time.
+                uint32_t next_block = first_block;
+                fc::future<block_frame> read_ahead = fc::async([&]{ return build_frame(next_block, last_block, compress); },
+                                                               "chain_server read_ahead");
+                try {
+                    while (true) {
+                        block_frame frame = read_ahead.wait();
+                        if (frame.block_count == 0) {
+                            fc::raw::pack(connection_socket, frame);
+                            break;
+                        }
+                        read_ahead = fc::async([&]{ return build_frame(next_block, last_block, compress); },
+                                               "chain_server read_ahead");
+                        fc::raw::pack(connection_socket, frame);
+                    }
+                } catch (...) {
+                    if (read_ahead.valid() && !read_ahead.ready())
+                        read_ahead.cancel_and_wait(__FUNCTION__);
+                    throw;
+                }
+            }
+
             void serve_client(fc::tcp_socket* connection_socket) {
               try {
                 FC_ASSERT(connection_socket->is_open());
@@ -111,6 +184,12 @@ namespace bts { namespace net {
                       case get_blocks_from_number:
                         handle_get_blocks_from_number(*connection_socket);
                         break;
+                      case get_head_block_number:
+                        handle_get_head_block_number(*connection_socket);
+                        break;
+                      case get_block_range:
+                        handle_get_block_range(*connection_socket);
+                        break;
                       case finish:
                         break;
                     }
@@ -16,6 +16,9 @@ namespace bts { namespace net {
      * Before blocks can be downloaded, one or more endpoints which point to chain_servers must be provided. To start
      * the download, call get_blocks and provide a callback function which will handle the new blocks, and optionally
      * the block number to start downloading from.
+     *
+     * The chain is split into ranges which are downloaded from several chain_servers in parallel; blocks are
+     * reordered as necessary so the callback always receives them in sequence.
      */
     class chain_downloader {
         std::unique_ptr<detail::chain_downloader_impl> my;
@@ -41,7 +44,7 @@ namespace bts { namespace net {
         void add_chain_servers(const std::vector<fc::ip::endpoint>& servers);
 
         /**
-         * @brief Asynchronously retrieve all new blocks from one of the available chain_server nodes
+         * @brief Asynchronously retrieve all new blocks from the available chain_server nodes
          * @param new_block_callback Callback function taking the newly downloaded block and the count of blocks remaining
          * @param first_block_number The first block number to download. Defaults to 0, which means to download all
          * blocks in chain.
@@ -26,6 +26,15 @@ namespace bts { namespace net {
      *      full_block objects. When the server has finished sending these blocks, it repeats the procedure for
      *      any new blocks which have been made in the interim, so another count is sent, followed by that number
      *      of blocks. When the server sends a count of 0, there are no blocks, and the command is complete.
+     * * get_head_block_number
+     *      This command takes no arguments. The server responds with the number of its current head block.
+     * * get_block_range
+     *      This command takes three arguments: the numbers of the first and last blocks to retrieve, and a uint8_t
+     *      chain_server_compression value naming the codec the client can accept. The server responds with a
+     *      sequence of block_frame objects, each holding a batch of consecutive packed full_blocks, and finishes
+     *      with a frame whose block_count is 0. The range is truncated at the server's head block. Frames may be
+     *      compressed only if the client asked for compression; the server reads and compresses the next frame
+     *      while the current one is being sent.
      *
      * All block numbers are of type uint32_t
      */
@@ -7,14 +7,37 @@
 
 #include <fc/reflect/reflect.hpp>
 
-const static uint32_t PROTOCOL_VERSION = 0;
+#include <vector>
+
+const static uint32_t PROTOCOL_VERSION = 1;
 
 namespace bts { namespace net { namespace detail {
     enum chain_server_commands {
         finish = 0,
-        get_blocks_from_number
+        get_blocks_from_number,
+        get_head_block_number,
+        get_block_range
+    };
+
+    /// Compression codecs a client may request for get_block_range
+    enum chain_server_compression {
+        no_compression = 0,
+        zlib_compression
+    };
+
+    /**
+     * A batch of consecutive blocks sent in response to get_block_range. data holds block_count packed full_blocks,
+     * and is deflated if compressed is set, in which case uncompressed_size gives its size once inflated.
+     */
+    struct block_frame {
+        uint32_t          block_count = 0;
+        uint32_t          uncompressed_size = 0;
+        bool              compressed = false;
+        std::vector<char> data;
     };
 } } } //namespace bts::net::detail
 
-FC_REFLECT_ENUM(bts::net::detail::chain_server_commands, (finish)(get_blocks_from_number))
+FC_REFLECT_ENUM(bts::net::detail::chain_server_commands, (finish)(get_blocks_from_number)(get_head_block_number)(get_block_range))
 FC_REFLECT_TYPENAME(bts::net::detail::chain_server_commands)
+FC_REFLECT_ENUM(bts::net::detail::chain_server_compression, (no_compression)(zlib_compression))
+FC_REFLECT(bts::net::detail::block_frame, (block_count)(uncompressed_size)(compressed)(data))
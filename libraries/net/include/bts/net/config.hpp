@@ -14,6 +14,11 @@
  * 512 kb
  */
 #define MAX_MESSAGE_SIZE                                (512 * 1024)
+/**
+ * Each connection reads from its socket in chunks of up to this many bytes, which may
+ * hold many small messages.  Must be a multiple of 16 (the encryption block size).
+ */
+#define BTS_NET_RECEIVE_BUFFER_SIZE                     (64 * 1024)
 #define BTS_NET_DEFAULT_PEER_CONNECTION_RETRY_TIME      30 // seconds
 
 /**
@@ -35,6 +40,15 @@
 
 #define BTS_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * When an upload limit is set, peers hold back transactions and address
+ * messages while another peer has a block queued, so the block gets the
+ * bandwidth.  They wait at most this long, so a stalled peer can't hold
+ * everyone else up.
+ */
+#define BTS_NET_MAX_LOW_PRIORITY_SEND_DELAY_MS          1000
+#define BTS_NET_LOW_PRIORITY_SEND_RETRY_MS              10
+
 /**
  * We prevent a peer from offering us a list of blocks which, if we fetched them
  * all, would result in a blockchain that extended into the future.
@@ -48,4 +62,95 @@
 
 #define BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES           2
 
+/**
+ * The inventory each peer is known to have is remembered in a rolling bloom
+ * filter made of this many generations.  Each generation is sized for twice
+ * the items the previous one saw, between the minimum and maximum below, so
+ * quiet peers cost little memory.  A false positive only means we don't
+ * advertise an item to a peer that would have wanted it, which it will then
+ * hear about from its other peers.
+ */
+#define BTS_NET_INVENTORY_FILTER_GENERATIONS                4
+#define BTS_NET_INVENTORY_FILTER_MIN_ITEMS_PER_GENERATION   256
+#define BTS_NET_INVENTORY_FILTER_MAX_ITEMS_PER_GENERATION   4000
+#define BTS_NET_INVENTORY_FILTER_FALSE_POSITIVE_RATE        0.0001
+
+/**
+ * Transactions are advertised to our peers this long after we receive them, so
+ * that each peer gets one inventory message for all of the transactions that
+ * arrived in that time.  Blocks are advertised immediately.
+ */
+#define BTS_NET_INVENTORY_BATCH_INTERVAL_MS             200
+
 #define BTS_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      100
+
+/**
+ * During sync, the missing part of the chain is split into windows of this
+ * many consecutive blocks, and windows are handed out to the peers we're
+ * syncing with.
+ */
+#define BTS_NET_SYNC_WINDOW_SIZE                        20
+
+/**
+ * Each syncing peer is kept busy with enough outstanding sync block requests
+ * to cover this many seconds of its measured throughput (rounded up to a whole
+ * number of windows, and capped at BTS_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING)
+ */
+#define BTS_NET_SYNC_PIPELINE_DEPTH_SEC                 3
+
+/**
+ * If a sync block we requested hasn't arrived after this long, plus the time
+ * the peer needs to send the requests queued ahead of it at its measured
+ * throughput, we'll ask another peer that has it for a copy.  This must be
+ * shorter than the timeout for disconnecting peers that ignore our requests.
+ */
+#define BTS_NET_SYNC_STALLED_REQUEST_TIMEOUT_SEC        5
+
+/**
+ * A peer's sync throughput is updated once it has spent at least this long
+ * sending us blocks, so that blocks arriving back to back don't distort it.
+ */
+#define BTS_NET_SYNC_THROUGHPUT_SAMPLE_MS               250
+
+/**
+ * The chain_server batches blocks into frames of at most this many blocks or
+ * this many (uncompressed) bytes, whichever limit is reached first.  A frame
+ * always contains at least one block.
+ */
+#define BTS_NET_CHAIN_SERVER_MAX_BLOCKS_PER_FRAME       500
+#define BTS_NET_CHAIN_SERVER_MAX_FRAME_SIZE             (1024 * 1024)
+
+/**
+ * The chain_downloader splits the chain into ranges of this many blocks and
+ * spreads them over the chain_servers it's connected to.
+ */
+#define BTS_NET_CHAIN_DOWNLOADER_RANGE_SIZE             2000
+
+/**
+ * The chain_downloader won't start on a range that begins more than this many
+ * blocks past the next block it will hand to its caller, which bounds the number
+ * of out-of-order blocks it has to hold in memory.
+ */
+#define BTS_NET_CHAIN_DOWNLOADER_MAX_LOOKAHEAD_BLOCKS   20000
+
+/** Number of chain_servers the chain_downloader will download from at once */
+#define BTS_NET_CHAIN_DOWNLOADER_MAX_SERVER_CONNECTIONS 4
+
+/**
+ * The chain_downloader drops a chain_server connection that makes no progress
+ * for this long, and hands its unfinished range to another server.
+ */
+#define BTS_NET_CHAIN_DOWNLOADER_TIMEOUT_SEC            10
+
+/**
+ * Messages at least this large are compressed before sending to peers that
+ * support it.  Smaller ones aren't worth the per-message overhead.
+ */
+#define BTS_NET_MIN_COMPRESSED_MESSAGE_SIZE             512
+/**
+ * Name under which nodes advertise support for compressed_messages in the
+ * user_data of their hello message
+ */
+#define BTS_NET_MESSAGE_COMPRESSION_CODEC               "deflate_stream"
+/** zlib level used for p2p messages; 1 trades a little ratio for a lot of speed */
+#define BTS_NET_MESSAGE_COMPRESSION_LEVEL               1
@@ -4,8 +4,10 @@
 #include <bts/net/peer_database.hpp>
 #include <bts/net/message_oriented_connection.hpp>
 #include <bts/net/stcp_socket.hpp>
+#include <bts/net/rolling_bloom_filter.hpp>
 #include <bts/net/config.hpp>
 #include <bts/client/messages.hpp>
+#include <bts/utilities/compression.hpp>
 
 #include <boost/tuple/tuple.hpp>
 
@@ -18,6 +20,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <array>
 #include <queue>
 #include <boost/container/deque.hpp>
 
@@ -30,6 +33,8 @@ namespace bts { namespace net
       virtual void on_message(peer_connection* originating_peer,
                               const message& received_message) = 0;
       virtual void on_connection_closed(peer_connection* originating_peer) = 0;
+      /** called before a peer sends a transaction or address message; return true to make it wait for a while */
+      virtual bool should_defer_low_priority_messages(peer_connection* peer) { return false; }
     };
 
     class peer_connection;
@@ -52,6 +57,17 @@ namespace bts { namespace net
         connection_accepted, // we have sent them a connection_accepted
         connection_rejected // we have sent them a connection_rejected
       };
+      /** messages are sent in this order, messages of the same priority in the order they were queued */
+      enum message_priority
+      {
+        control_priority,          // handshake, time, firewall checks, item requests and everything else
+        block_priority,
+        block_inventory_priority,
+        sync_priority,             // blockchain item id lists, and blocks sent to a peer that is syncing from us
+        transaction_priority,      // transactions and their inventory
+        address_priority,
+        message_priority_count
+      };
       enum class connection_negotiation_status
       {
         disconnected,
@@ -88,8 +104,13 @@ namespace bts { namespace net
         {}
       };
       size_t _total_queued_messages_size;
-      std::queue<queued_message, std::list<queued_message> > _queued_messages;
+      std::array<std::queue<queued_message, std::list<queued_message> >, message_priority_count> _queued_messages; /// one queue per message_priority
       fc::future<void> _send_queued_messages_done;
+
+      /// created once the peer tells us it can decode compressed_messages; see enable_outbound_compression()
+      std::unique_ptr<bts::utilities::deflate_stream> _outbound_compressor;
+      /// created when the first compressed_message arrives
+      std::unique_ptr<bts::utilities::inflate_stream> _inbound_decompressor;
     public:
       fc::time_point connection_initiation_time;
       fc::time_point connection_closed_time;
@@ -152,6 +173,12 @@ namespace bts { namespace net
       item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
       fc::time_point_sec last_block_time_delegate_has_seen;
       bool inhibit_fetching_sync_blocks;
+      double sync_block_throughput; /// exponentially-weighted estimate of how many sync blocks per second this peer delivers to us
+      fc::time_point last_sync_block_received_time;
+      uint32_t sync_blocks_in_throughput_sample; /// blocks received since sync_block_throughput was last updated
+      fc::microseconds sync_throughput_sample_time; /// time the peer spent sending those blocks
+      /** how long to wait for a sync block before asking another peer, allowing for the requests queued ahead of it */
+      fc::microseconds get_sync_request_stall_timeout() const;
       /// @}
 
       /// non-synchronization state data
@@ -172,7 +199,7 @@ namespace bts { namespace net
                                                                           boost::multi_index::ordered_non_unique<boost::multi_index::tag<timestamp_index>,
                                                                                                                  boost::multi_index::member<timestamped_item_id, fc::time_point_sec, &timestamped_item_id::timestamp> > > > timestamped_items_set_type;
       timestamped_items_set_type inventory_peer_advertised_to_us;
-      timestamped_items_set_type inventory_advertised_to_peer;
+      rolling_bloom_filter known_inventory; /// items we've advertised to this peer or it has advertised to us, so we don't advertise them (again)
 
       item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
       /// @}
@@ -183,6 +210,8 @@ namespace bts { namespace net
 
       uint32_t last_known_fork_block_number;
 
+      uint64_t bytes_saved_by_compression; /// difference between the uncompressed and compressed size of everything we've compressed for this peer
+
       fc::future<void> accept_or_connect_task_done;
 
 #ifndef NDEBUG
@@ -226,8 +255,18 @@ namespace bts { namespace net
       void clear_old_inventory();
       bool is_inventory_advertised_to_us_list_full_for_transactions() const;
       bool is_inventory_advertised_to_us_list_full() const;
+      void record_sync_block_received(const fc::time_point& request_time);
+      uint32_t get_sync_request_capacity(uint32_t maximum_blocks_per_peer) const;
+      void enable_outbound_compression();
+      bool is_outbound_compression_enabled() const;
+      bool has_block_messages_queued() const;
+      /** true if blocks are queued and the send task has made progress since stalled_before */
+      bool is_sending_block_messages(const fc::time_point& stalled_before) const;
     private:
       void send_queued_messages_task();
+      message_priority get_message_priority(const message& message_to_send) const;
+      message_priority get_next_queued_message_priority() const; /// message_priority_count if nothing is queued
+      message compress_message(const message& message_to_compress);
       void accept_connection_task();
       void connect_to_task(const fc::ip::endpoint& remote_endpoint);
     };
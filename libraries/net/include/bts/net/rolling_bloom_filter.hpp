@@ -0,0 +1,62 @@
+#pragma once
+
+#include <bts/net/config.hpp>
+#include <bts/net/core_messages.hpp>
+
+#include <fc/time.hpp>
+
+#include <vector>
+
+namespace bts { namespace net {
+
+  /**
+   *  Remembers the items a peer is known to have for a fixed time window in a bounded amount of memory.
+   *
+   *  Items go into the newest of several generations of bloom filters.  When the newest generation has
+   *  covered its share of the window, or holds as many items as it was sized for, the oldest generation
+   *  is cleared and becomes the newest.  A new generation is sized for twice the items its predecessor
+   *  received in its share of the window (or for max_items_per_generation if its predecessor filled up),
+   *  so a peer that sees little traffic only needs a small filter.  contains() never misses an item
+   *  inserted within the window (unless items arrive faster than max_items_per_generation allows), and
+   *  reports an item that was never inserted with a probability of about false_positive_rate.
+   */
+  class rolling_bloom_filter
+  {
+  public:
+    rolling_bloom_filter(const fc::microseconds& window = fc::minutes(BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES),
+                         uint32_t max_items_per_generation = BTS_NET_INVENTORY_FILTER_MAX_ITEMS_PER_GENERATION,
+                         double false_positive_rate = BTS_NET_INVENTORY_FILTER_FALSE_POSITIVE_RATE,
+                         uint32_t min_items_per_generation = BTS_NET_INVENTORY_FILTER_MIN_ITEMS_PER_GENERATION);
+
+    void insert(const item_id& item);
+    bool contains(const item_id& item) const;
+    void clear();
+
+    /** bytes used by the filter bits */
+    size_t memory_usage() const;
+
+  private:
+    struct generation
+    {
+      std::vector<uint64_t> bits;
+      uint32_t              capacity;
+      uint32_t              item_count;
+      /** when the next generation took over, or fc::time_point::maximum() for the newest generation */
+      fc::time_point        end_time;
+    };
+
+    void rotate(uint32_t next_capacity);
+    void get_hashes(const item_id& item, uint64_t& first_hash, uint64_t& second_hash) const;
+
+    fc::microseconds        _window;
+    fc::microseconds        _generation_duration;
+    uint32_t                _min_items_per_generation;
+    uint32_t                _max_items_per_generation;
+    double                  _bits_per_item;
+    uint32_t                _hash_count;
+    std::vector<generation> _generations;
+    uint32_t                _newest_generation;
+    fc::time_point          _newest_generation_start_time;
+  };
+
+} } // end namespace bts::net
@@ -115,12 +115,16 @@ namespace bts { namespace net {
     }
 
 
+    /**
+     *  Reads as much as the socket has ready (up to the size of the receive buffer) at a time and
+     *  delivers every complete message in it, keeping any partial message for the next read.
+     *  The buffer is a shared_ptr so it outlives a read that is still in progress when we're canceled.
+     */
     void message_oriented_connection_impl::read_loop()
     {
       VERIFY_CORRECT_THREAD();
-      const int BUFFER_SIZE = 16;
-      const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
-      static_assert(BUFFER_SIZE >= sizeof(message_header), "insufficient buffer");
+      static_assert(BTS_NET_RECEIVE_BUFFER_SIZE % 16 == 0, "the receive buffer must hold whole encryption blocks");
+      static_assert(BTS_NET_RECEIVE_BUFFER_SIZE >= 16, "insufficient buffer");
 
       _connected_time = fc::time_point::now();
 
@@ -129,42 +133,70 @@ namespace bts { namespace net {
 
       try
       {
-        message m;
+        size_t buffer_size = BTS_NET_RECEIVE_BUFFER_SIZE;
+        std::shared_ptr<char> buffer(new char[buffer_size], [](char* p){ delete[] p; });
+        size_t buffer_start = 0; // first byte not yet handed out in a message
+        size_t buffer_end = 0;   // end of the decrypted data
         while( true )
         {
-          char buffer[BUFFER_SIZE];
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
-
-          FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
-
-          size_t remaining_bytes_with_padding = 16 * ((m.size - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          // every message is padded to a multiple of 16 bytes, so buffer_start and buffer_end always stay multiples of 16
+          size_t bytes_needed = 16;
+          while( buffer_end - buffer_start >= sizeof(message_header) )
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
-            _bytes_received += remaining_bytes_with_padding;
+            message m;
+            memcpy((char*)&m, buffer.get() + buffer_start, sizeof(message_header));
+            FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "", ("m.size",m.size)("MAX_MESSAGE_SIZE",MAX_MESSAGE_SIZE) );
+
+            size_t size_with_padding = 16 * ((sizeof(message_header) + m.size + 15) / 16);
+            if( buffer_end - buffer_start < size_with_padding )
+            {
+              bytes_needed = size_with_padding;
+              break;
+            }
+            const char* message_data = buffer.get() + buffer_start + sizeof(message_header);
+            m.data.assign(message_data, message_data + m.size);
+            buffer_start += size_with_padding;
+
+            _last_message_received_time = fc::time_point::now();
+
+            try
+            {
+              // message handling errors are warnings...
+              _delegate->on_message(_self, m);
+            }
+            /// Dedicated catches needed to distinguish from general fc::exception
+            catch ( const fc::canceled_exception& e ) { throw e; }
+            catch ( const fc::eof_exception& e ) { throw e; }
+            catch ( const fc::exception& e)
+            {
+              /// Here loop should be continued so exception should be just caught locally.
+              wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
+              throw;
+            }
           }
-          m.data.resize(m.size); // truncate off the padding bytes
 
-          _last_message_received_time = fc::time_point::now();
-
-          try
+          // move the partial message (if any) to the front, growing the buffer if the message won't fit,
+          // or shrinking it back once a large message has been handled
+          size_t new_buffer_size = std::max<size_t>(BTS_NET_RECEIVE_BUFFER_SIZE, bytes_needed);
+          if( new_buffer_size != buffer_size && (new_buffer_size > buffer_size || buffer_start == buffer_end) )
           {
-            // message handling errors are warnings...
-            _delegate->on_message(_self, m);
+            std::shared_ptr<char> new_buffer(new char[new_buffer_size], [](char* p){ delete[] p; });
+            memcpy(new_buffer.get(), buffer.get() + buffer_start, buffer_end - buffer_start);
+            buffer = new_buffer;
+            buffer_size = new_buffer_size;
+            buffer_end -= buffer_start;
+            buffer_start = 0;
           }
-          /// Dedicated catches needed to distinguish from general fc::exception
-          catch ( const fc::canceled_exception& e ) { throw e; }
-          catch ( const fc::eof_exception& e ) { throw e; }
-          catch ( const fc::exception& e)
+          else if( buffer_start > 0 )
           {
-            /// Here loop should be continued so exception should be just caught locally.
-            wlog( "message transmission failed ${er}", ("er", e.to_detail_string() ) );
-            throw;
+            memmove(buffer.get(), buffer.get() + buffer_start, buffer_end - buffer_start);
+            buffer_end -= buffer_start;
+            buffer_start = 0;
           }
+
+          size_t bytes_read = _sock.readsome(buffer, buffer_size - buffer_end, buffer_end);
+          _bytes_received += bytes_read;
+          buffer_end += bytes_read;
         }
       }
       catch ( const fc::canceled_exception& e )
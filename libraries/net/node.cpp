@@ -55,6 +55,7 @@
 #include <bts/client/messages.hpp>
 
 #include <bts/utilities/git_revision.hpp>
+#include <bts/utilities/compression.hpp>
 #include <fc/git_revision.hpp>
 
 //#define ENABLE_DEBUG_ULOGS
@@ -150,6 +151,7 @@ namespace bts { namespace net {
       void cache_message( const message& message_to_cache, const message_hash_type& hash_of_message_to_cache,
                         const message_propagation_data& propagation_data, const fc::uint160_t& message_content_hash );
       message get_message( const message_hash_type& hash_of_message_to_lookup );
+      bool contains( const message_hash_type& hash_of_message_to_lookup ) const;
       message_propagation_data get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const;
       size_t size() const { return _message_cache.size(); }
     };
@@ -183,6 +185,11 @@ namespace bts { namespace net {
       FC_THROW_EXCEPTION(  fc::key_not_found_exception, "Requested message not in cache" );
     }
 
+    bool blockchain_tied_message_cache::contains( const message_hash_type& hash_of_message_to_lookup ) const
+    {
+      return _message_cache.get<message_hash_index>().find( hash_of_message_to_lookup ) != _message_cache.get<message_hash_index>().end();
+    }
+
     message_propagation_data blockchain_tied_message_cache::get_message_propagation_data( const fc::uint160_t& hash_of_message_contents_to_lookup ) const
     {
       if( hash_of_message_contents_to_lookup != fc::uint160_t() )
@@ -436,6 +443,8 @@ namespace bts { namespace net { namespace detail {
       fc::promise<void>::ptr        _retrigger_advertise_inventory_loop_promise;
       fc::future<void>              _advertise_inventory_loop_done;
       std::unordered_set<item_id>   _new_inventory; /// list of items we have received but not yet advertised to our peers
+      bool                          _new_inventory_contains_block; /// set when a block is added to _new_inventory, so it's advertised without waiting for a batch of transactions
+      bool                          _batching_inventory; /// true while the loop is collecting transactions to advertise together
       // @}
 
       fc::future<void>     _terminate_inactive_connections_loop_done;
@@ -487,6 +496,7 @@ namespace bts { namespace net { namespace detail {
       blockchain_tied_message_cache _message_cache; /// cache message we have received and might be required to provide to other peers via inventory requests
 
       fc::rate_limiting_group _rate_limiter;
+      uint32_t _upload_bytes_per_second_limit; /// as passed to set_total_bandwidth_limit, 0 for unlimited
 
       uint32_t _last_reported_number_of_connections; // number of connections last reported to the client (to avoid sending duplicate messages)
 
@@ -546,6 +556,7 @@ namespace bts { namespace net { namespace detail {
       bool have_already_received_sync_item( const item_hash_t& item_hash );
       void request_sync_item_from_peer( const peer_connection_ptr& peer, const item_hash_t& item_to_request );
       void request_sync_items_from_peer( const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request );
+      void reassign_stalled_sync_requests();
       void fetch_sync_items_loop();
       void trigger_fetch_sync_items_loop();
 
@@ -632,6 +643,7 @@ namespace bts { namespace net { namespace detail {
                                                     const get_current_connections_reply_message& get_current_connections_reply_message_received);
 
       void on_connection_closed( peer_connection* originating_peer ) override;
+      bool should_defer_low_priority_messages( peer_connection* peer ) override;
 
       void send_sync_block_to_node_delegate(const bts::client::block_message& block_message_to_send);
       void process_backlog_of_sync_blocks();
@@ -753,6 +765,8 @@ namespace bts { namespace net { namespace detail {
       _suspend_fetching_sync_blocks(false),
       _items_to_fetch_updated(false),
       _items_to_fetch_sequence_counter(0),
+      _new_inventory_contains_block(false),
+      _batching_inventory(false),
       _user_agent_string(user_agent),
       _desired_number_of_connections(BTS_NET_DEFAULT_DESIRED_CONNECTIONS),
       _maximum_number_of_connections(BTS_NET_DEFAULT_MAX_CONNECTIONS),
@@ -761,6 +775,7 @@ namespace bts { namespace net { namespace detail {
       _most_recent_blocks_accepted(_maximum_number_of_connections),
       _total_number_of_unfetched_items(0),
       _rate_limiter(0, 0),
+      _upload_bytes_per_second_limit(0),
       _last_reported_number_of_connections(0),
       _peer_advertising_disabled(false),
       _average_network_read_speed_seconds(60),
@@ -969,6 +984,36 @@ namespace bts { namespace net { namespace detail {
       peer->send_message(fetch_items_message(bts::client::block_message_type, items_to_request));
     }
 
+    void node_impl::reassign_stalled_sync_requests()
+    {
+      VERIFY_CORRECT_THREAD();
+      ASSERT_TASK_NOT_PREEMPTED();
+      // If a peer is sitting on one of our sync requests, forget that we've requested it so the next pass
+      // of the scheduler can ask a different peer.  We leave the request in the original peer's
+      // sync_items_requested_from_peer so that we will still accept the block if it eventually shows up
+      // (and so that terminate_inactive_connections_loop() will disconnect the peer if it never does)
+      // A peer with a deep pipeline of requests takes longer to get to the last of them, so each peer's
+      // requests get a timeout that grows with how many are queued ahead of them
+      fc::time_point now = fc::time_point::now();
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        if (peer->sync_items_requested_from_peer.empty())
+          continue;
+        fc::time_point stalled_request_threshold = now - peer->get_sync_request_stall_timeout();
+        for (const peer_connection::item_to_time_map_type::value_type& item_and_time : peer->sync_items_requested_from_peer)
+        {
+          if (item_and_time.second >= stalled_request_threshold)
+            continue;
+          auto request_iter = _active_sync_requests.find(item_and_time.first.item_hash);
+          if (request_iter != _active_sync_requests.end())
+          {
+            dlog("sync request for ${item_hash} has stalled, making it available to other peers", ("item_hash", request_iter->first));
+            _active_sync_requests.erase(request_iter);
+          }
+        }
+      }
+    }
+
     void node_impl::fetch_sync_items_loop()
     {
       VERIFY_CORRECT_THREAD();
@@ -983,36 +1028,71 @@ namespace bts { namespace net { namespace detail {
 
           {
             ASSERT_TASK_NOT_PREEMPTED();
+            reassign_stalled_sync_requests();
+
             std::set<item_hash_t> sync_items_to_request;
 
-            // for each idle peer that we're syncing with
+            // gather every peer we're syncing with that can accept more requests, along with how many
+            // more blocks we want in flight from it.  Peers are never required to be idle; we keep a
+            // pipeline of requests outstanding proportional to the throughput we've measured from them
+            std::vector<peer_connection_ptr> peers_with_spare_capacity;
+            std::map<peer_connection_ptr, uint32_t> remaining_capacity;
             for( const peer_connection_ptr& peer : _active_connections )
             {
               if( peer->we_need_sync_items_from_peer &&
-                  sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() && // if we've already scheduled a request for this peer, don't consider scheduling another
-                  peer->idle() )
+                  !peer->inhibit_fetching_sync_blocks &&
+                  !peer->ids_of_items_to_get.empty() )
               {
-                if (!peer->inhibit_fetching_sync_blocks)
+                uint32_t capacity = peer->get_sync_request_capacity(_maximum_blocks_per_peer_during_syncing);
+                if (capacity)
                 {
-                  // loop through the items it has that we don't yet have on our blockchain
-                  for( unsigned i = 0; i < peer->ids_of_items_to_get.size(); ++i )
+                  peers_with_spare_capacity.push_back(peer);
+                  remaining_capacity[peer] = capacity;
+                }
+              }
+            }
+
+            // the fastest peers get first pick, so the earliest windows (the ones blocking the
+            // client from making progress) go to the peers that will deliver them soonest
+            std::sort(peers_with_spare_capacity.begin(), peers_with_spare_capacity.end(),
+                      [](const peer_connection_ptr& a, const peer_connection_ptr& b) { return a->sync_block_throughput > b->sync_block_throughput; });
+
+            // hand out windows of consecutive blocks one round at a time, so that each round every peer
+            // with spare capacity gets the next unrequested window from its list
+            bool window_assigned_this_round;
+            do
+            {
+              window_assigned_this_round = false;
+              for( const peer_connection_ptr& peer : peers_with_spare_capacity )
+              {
+                uint32_t& capacity = remaining_capacity[peer];
+                uint32_t window_size = std::min<uint32_t>(capacity, BTS_NET_SYNC_WINDOW_SIZE);
+                uint32_t items_in_window = 0;
+                for( unsigned i = 0; i < peer->ids_of_items_to_get.size() && items_in_window < window_size; ++i )
+                {
+                  item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
+                  // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
+                  if( !have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
+                      sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
+                      _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end() && // we've requested it in a previous iteration and we're still waiting for it to arrive
+                      peer->sync_items_requested_from_peer.find(item_id(bts::client::block_message_type, item_to_potentially_request)) == peer->sync_items_requested_from_peer.end() ) // this peer stalled on it before
                   {
-                    item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
-                    // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
-                    if( !have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
-                        sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
-                        _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end() ) // we've requested it in a previous iteration and we're still waiting for it to arrive
-                    {
-                      // then schedule a request from this peer
-                      sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
-                      sync_items_to_request.insert( item_to_potentially_request );
-                      if (sync_item_requests_to_send[peer].size() >= _maximum_blocks_per_peer_during_syncing)
-                        break;
-                    }
+                    // then schedule a request from this peer
+                    sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
+                    sync_items_to_request.insert( item_to_potentially_request );
+                    ++items_in_window;
                   }
                 }
+                if (items_in_window)
+                {
+                  capacity -= items_in_window;
+                  window_assigned_this_round = true;
+                }
               }
-            }
+              peers_with_spare_capacity.erase(std::remove_if(peers_with_spare_capacity.begin(), peers_with_spare_capacity.end(),
+                                                             [&](const peer_connection_ptr& peer) { return remaining_capacity[peer] == 0; }),
+                                              peers_with_spare_capacity.end());
+            } while (window_assigned_this_round && !peers_with_spare_capacity.empty());
           } // end non-preemptable section
 
           // make all the requests we scheduled in the loop above
@@ -1027,7 +1107,17 @@ namespace bts { namespace net { namespace detail {
         {
           dlog( "no sync items to fetch right now, going to sleep" );
           _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr( new fc::promise<void>("bts::net::retrigger_fetch_sync_items_loop") );
-          _retrigger_fetch_sync_items_loop_promise->wait();
+          try
+          {
+            // wake up periodically while requests are outstanding so we can notice stalled ones
+            if (_active_sync_requests.empty())
+              _retrigger_fetch_sync_items_loop_promise->wait();
+            else
+              _retrigger_fetch_sync_items_loop_promise->wait(fc::seconds(1));
+          }
+          catch (const fc::timeout_exception&)
+          {
+          }
           _retrigger_fetch_sync_items_loop_promise.reset();
         }
       } // while( !canceled )
@@ -1130,10 +1220,29 @@ namespace bts { namespace net { namespace detail {
       VERIFY_CORRECT_THREAD();
       while( !_advertise_inventory_loop_done.canceled() )
       {
+        // give transactions arriving close together a chance to be advertised in the same inventory message
+        if( !_new_inventory_contains_block )
+        {
+          _retrigger_advertise_inventory_loop_promise = fc::promise<void>::ptr( new fc::promise<void>("bts::net::advertise_inventory_batch") );
+          _batching_inventory = true;
+          try
+          {
+            _retrigger_advertise_inventory_loop_promise->wait( fc::milliseconds( BTS_NET_INVENTORY_BATCH_INTERVAL_MS ) );
+          }
+          catch (const fc::timeout_exception&)
+          {
+          }
+          _batching_inventory = false;
+          _retrigger_advertise_inventory_loop_promise.reset();
+          if( _advertise_inventory_loop_done.canceled() )
+            break;
+        }
+
         dlog( "beginning an iteration of advertise inventory" );
         // swap inventory into local variable, clearing the node's copy
         std::unordered_set<item_id> inventory_to_advertise;
         inventory_to_advertise.swap( _new_inventory );
+        _new_inventory_contains_block = false;
 
         // process all inventory to advertise and construct the inventory messages we'll send
         // first, then send them all in a batch (to avoid any fiber interruption points while
@@ -1151,11 +1260,10 @@ namespace bts { namespace net { namespace detail {
             // group the items we need to send by type, because we'll need to send one inventory message per type
             unsigned total_items_to_send_to_this_peer = 0;
             for( const item_id& item_to_advertise : inventory_to_advertise )
-              if( peer->inventory_advertised_to_peer.find(item_to_advertise) == peer->inventory_advertised_to_peer.end() &&
-                  peer->inventory_peer_advertised_to_us.find(item_to_advertise) == peer->inventory_peer_advertised_to_us.end() )
+              if( !peer->known_inventory.contains(item_to_advertise) )
               {
                 items_to_advertise_by_type[item_to_advertise.item_type].push_back( item_to_advertise.item_hash );
-                peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
+                peer->known_inventory.insert(item_to_advertise);
                 ++total_items_to_send_to_this_peer;
                 if (item_to_advertise.item_type == trx_message_type)
                   testnetlog("advertising transaction ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
@@ -1185,7 +1293,9 @@ namespace bts { namespace net { namespace detail {
     void node_impl::trigger_advertise_inventory_loop()
     {
       VERIFY_CORRECT_THREAD();
-      if( _retrigger_advertise_inventory_loop_promise )
+      // while batching, only a block (or shutting down) cuts the wait short
+      if( _retrigger_advertise_inventory_loop_promise && !_retrigger_advertise_inventory_loop_promise->ready() &&
+          ( !_batching_inventory || _new_inventory_contains_block || _advertise_inventory_loop_done.canceled() ) )
         _retrigger_advertise_inventory_loop_promise->set_value();
     }
 
@@ -1684,6 +1794,10 @@ namespace bts { namespace net { namespace detail {
       if (!_hard_fork_block_numbers.empty())
         user_data["last_known_fork_block_number"] = _hard_fork_block_numbers.back();
 
+      // codecs we can decode in a compressed_message; the peer may use any of them when sending to us
+      if (bts::utilities::compression_available())
+        user_data["compression"] = fc::variants{fc::variant(BTS_NET_MESSAGE_COMPRESSION_CODEC)};
+
       return user_data;
     }
     void node_impl::parse_hello_user_data_for_peer(peer_connection* originating_peer, const fc::variant_object& user_data)
@@ -1706,6 +1820,10 @@ namespace bts { namespace net { namespace detail {
         originating_peer->node_id = user_data["node_id"].as<node_id_t>();
       if (user_data.contains("last_known_fork_block_number"))
         originating_peer->last_known_fork_block_number = user_data["last_known_fork_block_number"].as<uint32_t>();
+      if (user_data.contains("compression"))
+        for (const fc::variant& codec : user_data["compression"].get_array())
+          if (codec.is_string() && codec.as_string() == BTS_NET_MESSAGE_COMPRESSION_CODEC)
+            originating_peer->enable_outbound_compression();
     }
 
     void node_impl::on_hello_message( peer_connection* originating_peer, const hello_message& hello_message_received )
@@ -2507,22 +2625,19 @@ namespace bts { namespace net { namespace detail {
       for( const item_hash_t& item_hash : item_ids_inventory_message_received.item_hashes_available )
       {
         item_id advertised_item_id( item_ids_inventory_message_received.item_type, item_hash );
-        bool we_advertised_this_item_to_a_peer = false;
-        bool we_requested_this_item_from_a_peer = false;
-        for( const peer_connection_ptr peer : _active_connections )
-        {
-          if( peer->inventory_advertised_to_peer.find(advertised_item_id) != peer->inventory_advertised_to_peer.end() )
-          {
-            we_advertised_this_item_to_a_peer = true;
-            break;
-          }
-          if( peer->items_requested_from_peer.find(advertised_item_id) != peer->items_requested_from_peer.end() )
-            we_requested_this_item_from_a_peer = true;
-        }
+        originating_peer->known_inventory.insert( advertised_item_id );
 
-        // if we have already advertised it to a peer, we must have it, no need to do anything else
-        if (!we_advertised_this_item_to_a_peer)
+        // if it's in our message cache we already have it, no need to do anything else
+        if( !_message_cache.contains( item_hash ) )
         {
+          bool we_requested_this_item_from_a_peer = false;
+          for( const peer_connection_ptr peer : _active_connections )
+            if( peer->items_requested_from_peer.find(advertised_item_id) != peer->items_requested_from_peer.end() )
+            {
+              we_requested_this_item_from_a_peer = true;
+              break;
+            }
+
           // if the peer has flooded us with transactions, don't add these to the inventory to prevent our
           // inventory list from growing without bound.  We try to allow fetching blocks even when
           // we've stopped fetching transactions.
@@ -2577,6 +2692,20 @@ namespace bts { namespace net { namespace detail {
         originating_peer->close_connection();
     }
 
+    bool node_impl::should_defer_low_priority_messages( peer_connection* peer )
+    {
+      VERIFY_CORRECT_THREAD();
+      // without a limit, each peer's transactions only compete with its own blocks, which its queue already orders
+      if( !_upload_bytes_per_second_limit )
+        return false;
+      // a peer whose socket has stopped draining would otherwise hold every other peer's transactions back
+      fc::time_point stalled_before = fc::time_point::now() - fc::milliseconds( BTS_NET_MAX_LOW_PRIORITY_SEND_DELAY_MS );
+      for( const peer_connection_ptr& active_peer : _active_connections )
+        if( active_peer.get() != peer && active_peer->is_sending_block_messages( stalled_before ) )
+          return true;
+      return false;
+    }
+
     void node_impl::on_connection_closed( peer_connection* originating_peer )
     {
       VERIFY_CORRECT_THREAD();
@@ -3080,11 +3209,19 @@ namespace bts { namespace net { namespace detail {
                                                                                              block_message_to_process.block_id ) );
         if( sync_item_iter != originating_peer->sync_items_requested_from_peer.end() )
         {
+          originating_peer->record_sync_block_received(sync_item_iter->second);
           originating_peer->sync_items_requested_from_peer.erase( sync_item_iter );
           _active_sync_requests.erase(block_message_to_process.block_id);
-          process_block_during_sync( originating_peer, block_message_to_process, message_hash );
-          if (originating_peer->idle())
-            trigger_fetch_sync_items_loop();
+          // if this request stalled and we reassigned it, another peer may have beaten this one to it
+          if (have_already_received_sync_item(block_message_to_process.block_id) ||
+              originating_peer->ids_of_items_being_processed.find(block_message_to_process.block_id) != originating_peer->ids_of_items_being_processed.end() ||
+              std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
+                        block_message_to_process.block_id) != _most_recent_blocks_accepted.end())
+            dlog("received a duplicate of sync block ${block_id}, discarding it", ("block_id", block_message_to_process.block_id));
+          else
+            process_block_during_sync( originating_peer, block_message_to_process, message_hash );
+          // we keep a pipeline of requests outstanding, so schedule more whenever a block arrives
+          trigger_fetch_sync_items_loop();
           return;
         }
       }
@@ -4043,7 +4180,7 @@ namespace bts { namespace net { namespace detail {
         ilog( "  peer ${endpoint}", ("endpoint", peer->get_remote_endpoint() ) );
         ilog( "    peer.ids_of_items_to_get size: ${size}", ("size", peer->ids_of_items_to_get.size() ) );
         ilog( "    peer.inventory_peer_advertised_to_us size: ${size}", ("size", peer->inventory_peer_advertised_to_us.size() ) );
-        ilog( "    peer.inventory_advertised_to_peer size: ${size}", ("size", peer->inventory_advertised_to_peer.size() ) );
+        ilog( "    peer.known_inventory memory usage: ${size} bytes", ("size", peer->known_inventory.memory_usage() ) );
         ilog( "    peer.items_requested_from_peer size: ${size}", ("size", peer->items_requested_from_peer.size() ) );
         ilog( "    peer.sync_items_requested_from_peer size: ${size}", ("size", peer->sync_items_requested_from_peer.size() ) );
       }
@@ -4156,6 +4293,13 @@ namespace bts { namespace net { namespace detail {
         peer_details["startingheight"] = ""; // TODO: fill me for bitcoin compatibility
         peer_details["banscore"] = ""; // TODO: fill me for bitcoin compatibility
         peer_details["syncnode"] = ""; // TODO: fill me for bitcoin compatibility
+        if (peer->we_need_sync_items_from_peer)
+        {
+          peer_details["sync_blocks_per_second"] = peer->sync_block_throughput;
+          peer_details["sync_blocks_in_flight"] = peer->sync_items_requested_from_peer.size();
+        }
+        peer_details["compression_enabled"] = peer->is_outbound_compression_enabled();
+        peer_details["bytes_saved_by_compression"] = peer->bytes_saved_by_compression;
 
         if (peer->bitshares_git_revision_sha)
         {
@@ -4245,6 +4389,8 @@ namespace bts { namespace net { namespace detail {
 
       _message_cache.cache_message( item_to_broadcast, hash_of_item_to_broadcast, propagation_data, hash_of_message_contents );
       _new_inventory.insert( item_id(item_to_broadcast.msg_type, hash_of_item_to_broadcast ) );
+      if( item_to_broadcast.msg_type == bts::client::block_message_type )
+        _new_inventory_contains_block = true;
       trigger_advertise_inventory_loop();
     }
 
@@ -4363,6 +4509,7 @@ namespace bts { namespace net { namespace detail {
     {
       VERIFY_CORRECT_THREAD();
       _rate_limiter.set_upload_limit( upload_bytes_per_second );
+      _upload_bytes_per_second_limit = upload_bytes_per_second;
       _rate_limiter.set_download_limit( download_bytes_per_second );
     }
 
@@ -30,8 +30,11 @@ namespace bts { namespace net
       we_need_sync_items_from_peer(true),
       last_block_number_delegate_has_seen(0),
       inhibit_fetching_sync_blocks(false),
+      sync_block_throughput(0.0),
+      sync_blocks_in_throughput_sample(0),
       transaction_fetching_inhibited_until(fc::time_point::min()),
-      last_known_fork_block_number(0)
+      last_known_fork_block_number(0),
+      bytes_saved_by_compression(0)
 #ifndef NDEBUG
       ,_thread(&fc::thread::current()),
       _send_message_queue_tasks_running(0)
@@ -210,6 +213,26 @@ namespace bts { namespace net
     void peer_connection::on_message( message_oriented_connection* originating_connection, const message& received_message )
     {
       VERIFY_CORRECT_THREAD();
+      if (received_message.msg_type == core_message_type_enum::compressed_message_type)
+      {
+        // a corrupt compressed message leaves the inflate stream unusable, so any exception
+        // here is allowed to propagate up and close the connection
+        compressed_message message_to_decompress = received_message.as<compressed_message>();
+        FC_ASSERT(message_to_decompress.uncompressed_size <= MAX_MESSAGE_SIZE,
+                  "compressed message would inflate to more than the maximum message size",
+                  ("uncompressed_size", message_to_decompress.uncompressed_size));
+        if (!_inbound_decompressor)
+          _inbound_decompressor.reset(new bts::utilities::inflate_stream);
+
+        message decompressed_message;
+        decompressed_message.msg_type = message_to_decompress.msg_type;
+        decompressed_message.data = _inbound_decompressor->decompress(message_to_decompress.compressed_data.data(),
+                                                                      message_to_decompress.compressed_data.size(),
+                                                                      message_to_decompress.uncompressed_size);
+        decompressed_message.size = message_to_decompress.uncompressed_size;
+        _node->on_message( this, decompressed_message );
+        return;
+      }
       _node->on_message( this, received_message );
     }
 
@@ -230,24 +253,48 @@ namespace bts { namespace net
         ~counter() { assert(_send_message_queue_tasks_counter == 1); --_send_message_queue_tasks_counter; dlog("leaving peer_connection::send_queued_messages_task()"); }
       } concurrent_invocation_counter(_send_message_queue_tasks_running);
 #endif
-      while (!_queued_messages.empty())
+      fc::microseconds low_priority_send_delay;
+      message_priority priority;
+      while ((priority = get_next_queued_message_priority()) != message_priority_count)
       {
-        _queued_messages.front().transmission_start_time = fc::time_point::now();
+        // under a bandwidth limit, let other peers' blocks go out before our transactions.  The delay only
+        // starts over once no other peer has blocks waiting, so a steady stream of blocks can't hold our
+        // transactions back for more than BTS_NET_MAX_LOW_PRIORITY_SEND_DELAY_MS at a time
+        if (priority >= transaction_priority)
+        {
+          if (!_node->should_defer_low_priority_messages(this))
+            low_priority_send_delay = fc::microseconds();
+          else if (low_priority_send_delay < fc::milliseconds(BTS_NET_MAX_LOW_PRIORITY_SEND_DELAY_MS))
+          {
+            fc::usleep(fc::milliseconds(BTS_NET_LOW_PRIORITY_SEND_RETRY_MS));
+            low_priority_send_delay += fc::milliseconds(BTS_NET_LOW_PRIORITY_SEND_RETRY_MS);
+            continue;
+          }
+        }
+
+        queued_message& next_message = _queued_messages[priority].front();
+        next_message.transmission_start_time = fc::time_point::now();
         try
         {
           dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
                "to send message of type ${type} for peer ${endpoint}",
-               ("type", _queued_messages.front().message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-          if (_queued_messages.front().message_send_time_field_offset != (size_t)-1)
+               ("type", next_message.message_to_send.msg_type)("endpoint", get_remote_endpoint()));
+          if (next_message.message_send_time_field_offset != (size_t)-1)
           {
             // patch the current time into the message.  Since this operates on the packed version of the structure,
             // it won't work for anything after a variable-length field
             std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
-            assert(_queued_messages.front().message_send_time_field_offset + packed_current_time.size() <= _queued_messages.front().message_to_send.data.size());
-            memcpy(_queued_messages.front().message_to_send.data.data() + _queued_messages.front().message_send_time_field_offset,
+            assert(next_message.message_send_time_field_offset + packed_current_time.size() <= next_message.message_to_send.data.size());
+            memcpy(next_message.message_to_send.data.data() + next_message.message_send_time_field_offset,
                    packed_current_time.data(), packed_current_time.size());
           }
-          _message_connection.send_message(_queued_messages.front().message_to_send);
+          // messages with a send time patched in are tiny; never compress those
+          if (_outbound_compressor &&
+              next_message.message_send_time_field_offset == (size_t)-1 &&
+              next_message.message_to_send.size >= BTS_NET_MIN_COMPRESSED_MESSAGE_SIZE)
+            _message_connection.send_message(compress_message(next_message.message_to_send));
+          else
+            _message_connection.send_message(next_message.message_to_send);
           dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
                ("endpoint", get_remote_endpoint()));
         }
@@ -277,19 +324,100 @@ namespace bts { namespace net
         {
           elog("message_oriented_exception::send_message() threw an unhandled exception");
         }
-        _queued_messages.front().transmission_finish_time = fc::time_point::now();
-        _total_queued_messages_size -= _queued_messages.front().message_to_send.size;
-        _queued_messages.pop();
+        next_message.transmission_finish_time = fc::time_point::now();
+        _total_queued_messages_size -= next_message.message_to_send.size;
+        _queued_messages[priority].pop();
       }
       dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
     }
 
+    peer_connection::message_priority peer_connection::get_message_priority(const message& message_to_send) const
+    {
+      switch (message_to_send.msg_type)
+      {
+      case block_message_type:
+        return peer_needs_sync_items_from_us ? sync_priority : block_priority;
+      case item_ids_inventory_message_type:
+        {
+          // item_type is the first field of the message, so there's no need to unpack the list of hashes
+          fc::datastream<const char*> ds(message_to_send.data.data(), message_to_send.data.size());
+          uint32_t item_type;
+          fc::raw::unpack(ds, item_type);
+          return item_type == block_message_type ? block_inventory_priority : transaction_priority;
+        }
+      case blockchain_item_ids_inventory_message_type:
+      case fetch_blockchain_item_ids_message_type:
+        return sync_priority;
+      case trx_message_type:
+        return transaction_priority;
+      case address_request_message_type:
+      case address_message_type:
+      case get_current_connections_reply_message_type:
+        return address_priority;
+      default:
+        return control_priority;
+      }
+    }
+
+    peer_connection::message_priority peer_connection::get_next_queued_message_priority() const
+    {
+      for (unsigned priority = 0; priority < message_priority_count; ++priority)
+        if (!_queued_messages[priority].empty())
+          return (message_priority)priority;
+      return message_priority_count;
+    }
+
+    bool peer_connection::has_block_messages_queued() const
+    {
+      VERIFY_CORRECT_THREAD();
+      return !_queued_messages[block_priority].empty() || !_queued_messages[block_inventory_priority].empty();
+    }
+
+    bool peer_connection::is_sending_block_messages(const fc::time_point& stalled_before) const
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!has_block_messages_queued())
+        return false;
+      // a peer that was idle until its blocks were queued hasn't stalled; one that has sent nothing since
+      // its oldest block was queued long ago has
+      fc::time_point oldest_enqueue_time = fc::time_point::maximum();
+      for (message_priority priority : {block_priority, block_inventory_priority})
+        if (!_queued_messages[priority].empty())
+          oldest_enqueue_time = std::min(oldest_enqueue_time, _queued_messages[priority].front().enqueue_time);
+      return std::max(oldest_enqueue_time, get_last_message_sent_time()) >= stalled_before;
+    }
+
+    message peer_connection::compress_message(const message& message_to_compress)
+    {
+      VERIFY_CORRECT_THREAD();
+      // The compressor's state carries over between messages, so every message compressed here must actually be
+      // sent, in order.  This is only called from send_queued_messages_task, which sends messages one at a time.
+      std::vector<char> compressed_data = _outbound_compressor->compress(message_to_compress.data.data(),
+                                                                         message_to_compress.data.size());
+      if (compressed_data.size() < message_to_compress.data.size())
+        bytes_saved_by_compression += message_to_compress.data.size() - compressed_data.size();
+      return message(compressed_message(message_to_compress.msg_type, message_to_compress.size, std::move(compressed_data)));
+    }
+
+    void peer_connection::enable_outbound_compression()
+    {
+      VERIFY_CORRECT_THREAD();
+      if (!_outbound_compressor && bts::utilities::compression_available())
+        _outbound_compressor.reset(new bts::utilities::deflate_stream(BTS_NET_MESSAGE_COMPRESSION_LEVEL));
+    }
+
+    bool peer_connection::is_outbound_compression_enabled() const
+    {
+      VERIFY_CORRECT_THREAD();
+      return (bool)_outbound_compressor;
+    }
+
     void peer_connection::send_message(const message& message_to_send, size_t message_send_time_field_offset)
     {
       VERIFY_CORRECT_THREAD();
       dlog("peer_connection::send_message() enqueueing message of type ${type} for peer ${endpoint}",
            ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-      _queued_messages.emplace(queued_message(message_to_send, message_send_time_field_offset));
+      _queued_messages[get_message_priority(message_to_send)].emplace(queued_message(message_to_send, message_send_time_field_offset));
       _total_queued_messages_size += message_to_send.size;
       if (_total_queued_messages_size > BTS_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES)
       {
@@ -405,20 +533,13 @@ namespace bts { namespace net
       VERIFY_CORRECT_THREAD();
       fc::time_point_sec oldest_inventory_to_keep(fc::time_point::now() - fc::minutes(BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES));
 
-      // expire old items from inventory_advertised_to_peer
-      auto oldest_inventory_to_keep_iter = inventory_advertised_to_peer.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      auto begin_iter = inventory_advertised_to_peer.get<timestamp_index>().begin();
-      unsigned number_of_elements_advertised_to_peer_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
-      inventory_advertised_to_peer.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
-
-      // also expire items from inventory_peer_advertised_to_us
-      oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
-      begin_iter = inventory_peer_advertised_to_us.get<timestamp_index>().begin();
+      // expire old items from inventory_peer_advertised_to_us (known_inventory expires its own items)
+      auto oldest_inventory_to_keep_iter = inventory_peer_advertised_to_us.get<timestamp_index>().lower_bound(oldest_inventory_to_keep);
+      auto begin_iter = inventory_peer_advertised_to_us.get<timestamp_index>().begin();
       unsigned number_of_elements_peer_advertised_to_discard = std::distance(begin_iter, oldest_inventory_to_keep_iter);
       inventory_peer_advertised_to_us.get<timestamp_index>().erase(begin_iter, oldest_inventory_to_keep_iter);
-      dlog("Expiring old inventory for peer ${peer}: removing ${to_peer} items advertised to peer (${remain_to_peer} left), and ${to_us} advertised to us (${remain_to_us} left)",
+      dlog("Expiring old inventory for peer ${peer}: removing ${to_us} items advertised to us (${remain_to_us} left)",
            ("peer", get_remote_endpoint())
-           ("to_peer", number_of_elements_advertised_to_peer_to_discard)("remain_to_peer", inventory_advertised_to_peer.size())
            ("to_us", number_of_elements_peer_advertised_to_discard)("remain_to_us", inventory_peer_advertised_to_us.size()));
     }
     // we have a higher limit for blocks than transactions so we will still fetch blocks even when transactions are throttled
@@ -437,4 +558,52 @@ namespace bts { namespace net
         BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES * BTS_BLOCKCHAIN_MAX_TRX_PER_SECOND * 60 + 
         (BTS_NET_MAX_INVENTORY_SIZE_IN_MINUTES + 1) * 60 / BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
     }
+
+    void peer_connection::record_sync_block_received(const fc::time_point& request_time)
+    {
+      VERIFY_CORRECT_THREAD();
+      // when requests are pipelined, the peer is busy from the time we asked for the block or the time it
+      // finished sending the previous block, whichever is later
+      fc::time_point now = fc::time_point::now();
+      fc::time_point busy_since = std::max(request_time, last_sync_block_received_time);
+      last_sync_block_received_time = now;
+
+      // blocks often arrive back to back, so a single block's interval says little; average over a sample
+      // long enough to measure instead
+      ++sync_blocks_in_throughput_sample;
+      sync_throughput_sample_time += now - busy_since;
+      if (sync_throughput_sample_time < fc::milliseconds(BTS_NET_SYNC_THROUGHPUT_SAMPLE_MS))
+        return;
+
+      double blocks_per_second = sync_blocks_in_throughput_sample * 1000000.0 / sync_throughput_sample_time.count();
+      sync_blocks_in_throughput_sample = 0;
+      sync_throughput_sample_time = fc::microseconds();
+      if (sync_block_throughput == 0.0)
+        sync_block_throughput = blocks_per_second;
+      else
+        sync_block_throughput = 0.8 * sync_block_throughput + 0.2 * blocks_per_second;
+    }
+
+    fc::microseconds peer_connection::get_sync_request_stall_timeout() const
+    {
+      VERIFY_CORRECT_THREAD();
+      // the peer answers our requests in order, so the last one waits for every other one to be sent first
+      fc::microseconds timeout = fc::seconds(BTS_NET_SYNC_STALLED_REQUEST_TIMEOUT_SEC);
+      if (sync_block_throughput > 0.0)
+        timeout += fc::microseconds((int64_t)(sync_items_requested_from_peer.size() * 1000000.0 / sync_block_throughput));
+      return timeout;
+    }
+
+    uint32_t peer_connection::get_sync_request_capacity(uint32_t maximum_blocks_per_peer) const
+    {
+      VERIFY_CORRECT_THREAD();
+      // until we've measured the peer, give it a single window
+      uint32_t desired_depth = (uint32_t)(sync_block_throughput * BTS_NET_SYNC_PIPELINE_DEPTH_SEC);
+      desired_depth = ((desired_depth + BTS_NET_SYNC_WINDOW_SIZE - 1) / BTS_NET_SYNC_WINDOW_SIZE) * BTS_NET_SYNC_WINDOW_SIZE;
+      desired_depth = std::max<uint32_t>(desired_depth, BTS_NET_SYNC_WINDOW_SIZE);
+      desired_depth = std::min(desired_depth, maximum_blocks_per_peer);
+      if (desired_depth <= sync_items_requested_from_peer.size())
+        return 0;
+      return desired_depth - (uint32_t)sync_items_requested_from_peer.size();
+    }
 } } // end namespace bts::net
@@ -0,0 +1,129 @@
+#include <bts/net/rolling_bloom_filter.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace bts { namespace net {
+
+  rolling_bloom_filter::rolling_bloom_filter(const fc::microseconds& window,
+                                             uint32_t max_items_per_generation,
+                                             double false_positive_rate,
+                                             uint32_t min_items_per_generation) :
+    _window(window),
+    _min_items_per_generation(std::min(min_items_per_generation, max_items_per_generation)),
+    _max_items_per_generation(max_items_per_generation),
+    _newest_generation(0)
+  {
+    FC_ASSERT(max_items_per_generation > 0 && min_items_per_generation > 0);
+    FC_ASSERT(false_positive_rate > 0 && false_positive_rate < 1);
+    static_assert(BTS_NET_INVENTORY_FILTER_GENERATIONS >= 2, "a rolling bloom filter needs at least two generations");
+
+    // every generation is checked, so each one gets its share of the false positive rate.  Generations of any
+    // size keep the same number of bits per item, so they all use the same number of hashes
+    const double generation_false_positive_rate = 1 - std::pow(1 - false_positive_rate, 1.0 / BTS_NET_INVENTORY_FILTER_GENERATIONS);
+    const double ln2 = std::log(2.0);
+    _bits_per_item = -std::log(generation_false_positive_rate) / (ln2 * ln2);
+    _hash_count = std::min<uint32_t>(32, std::max<uint32_t>(1, (uint32_t)std::lround(_bits_per_item * ln2)));
+
+    // the generations other than the newest one must cover the whole window between them
+    _generation_duration = fc::microseconds(window.count() / (BTS_NET_INVENTORY_FILTER_GENERATIONS - 1));
+
+    _generations.resize(BTS_NET_INVENTORY_FILTER_GENERATIONS);
+    clear();
+  }
+
+  void rolling_bloom_filter::get_hashes(const item_id& item, uint64_t& first_hash, uint64_t& second_hash) const
+  {
+    // item hashes are already uniformly distributed, so their bytes can serve as the hashes directly
+    static_assert(sizeof(item_hash_t) >= 2 * sizeof(uint64_t), "item hashes are too short to split into two hashes");
+    memcpy(&first_hash, item.item_hash.data(), sizeof(first_hash));
+    memcpy(&second_hash, item.item_hash.data() + sizeof(first_hash), sizeof(second_hash));
+    first_hash ^= item.item_type * UINT64_C(0x9e3779b97f4a7c15);
+    second_hash |= 1;
+  }
+
+  void rolling_bloom_filter::rotate(uint32_t next_capacity)
+  {
+    fc::time_point now = fc::time_point::now();
+    _generations[_newest_generation].end_time = now;
+    _newest_generation = (_newest_generation + 1) % _generations.size();
+    generation& newest = _generations[_newest_generation];
+    newest.capacity = next_capacity;
+    const uint32_t bit_count = std::max<uint32_t>(64, (uint32_t)std::ceil(next_capacity * _bits_per_item / 64) * 64);
+    newest.bits.assign(bit_count / 64, 0);
+    newest.bits.shrink_to_fit();
+    newest.item_count = 0;
+    newest.end_time = fc::time_point::maximum();
+    _newest_generation_start_time = now;
+  }
+
+  void rolling_bloom_filter::insert(const item_id& item)
+  {
+    const generation& current = _generations[_newest_generation];
+    if (current.item_count >= current.capacity)
+      // items are arriving faster than this generation expected; don't wait for the next one to find out too
+      rotate(_max_items_per_generation);
+    else if (fc::time_point::now() - _newest_generation_start_time >= _generation_duration)
+      rotate(std::max(_min_items_per_generation, std::min(_max_items_per_generation, current.item_count * 2)));
+
+    uint64_t first_hash, second_hash;
+    get_hashes(item, first_hash, second_hash);
+    generation& newest = _generations[_newest_generation];
+    const uint64_t bit_count = newest.bits.size() * 64;
+    for (uint32_t i = 0; i < _hash_count; ++i)
+    {
+      uint64_t bit = (first_hash + i * second_hash) % bit_count;
+      newest.bits[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+    ++newest.item_count;
+  }
+
+  bool rolling_bloom_filter::contains(const item_id& item) const
+  {
+    uint64_t first_hash, second_hash;
+    get_hashes(item, first_hash, second_hash);
+    fc::time_point oldest_time_to_keep = fc::time_point::now() - _window;
+    for (const generation& gen : _generations)
+    {
+      if (gen.item_count == 0 || gen.end_time < oldest_time_to_keep)
+        continue;
+      const uint64_t bit_count = gen.bits.size() * 64;
+      bool all_bits_set = true;
+      for (uint32_t i = 0; i < _hash_count && all_bits_set; ++i)
+      {
+        uint64_t bit = (first_hash + i * second_hash) % bit_count;
+        all_bits_set = (gen.bits[bit / 64] & (UINT64_C(1) << (bit % 64))) != 0;
+      }
+      if (all_bits_set)
+        return true;
+    }
+    return false;
+  }
+
+  void rolling_bloom_filter::clear()
+  {
+    for (generation& gen : _generations)
+    {
+      gen.bits.clear();
+      gen.bits.shrink_to_fit();
+      gen.capacity = 0;
+      gen.item_count = 0;
+      gen.end_time = fc::time_point::min();
+    }
+    // rotate() ends the generation before the newest one, which is empty and stays ignored
+    _newest_generation = _generations.size() - 1;
+    rotate(_min_items_per_generation);
+  }
+
+  size_t rolling_bloom_filter::memory_usage() const
+  {
+    size_t bytes = 0;
+    for (const generation& gen : _generations)
+      bytes += gen.bits.size() * sizeof(uint64_t);
+    return bytes;
+  }
+
+} } // end namespace bts::net
@@ -93,10 +93,24 @@ size_t stcp_socket::readsome( char* buffer, size_t len )
     return s;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
-size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size_t offset ) 
-{
-  return readsome(buf.get() + offset, len);
-}
+/**
+ *   Reads straight into buf and decrypts it there, so large reads
+ *   don't go through _read_buffer 4 KiB at a time.  len must be a
+ *   multiple of 16.
+ */
+size_t stcp_socket::readsome( const std::shared_ptr<char>& buf, size_t len, size_t offset )
+{ try {
+    assert( len > 0 && (len % 16) == 0 );
+
+    size_t s = _sock.readsome( buf, len, offset );
+    if( s % 16 )
+    {
+      _sock.read(buf, 16 - (s%16), offset + s);
+      s += 16-(s%16);
+    }
+    _recv_aes.decode( buf.get() + offset, s, buf.get() + offset );
+    return s;
+} FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
 bool stcp_socket::eof()const
 {
@@ -0,0 +1,104 @@
+#include <bts/rpc/binary_rpc.hpp>
+#include <bts/rpc/binary_rpc_client.hpp>
+
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/mutex.hpp>
+#include <fc/thread/scoped_lock.hpp>
+
+namespace bts { namespace rpc {
+
+  namespace detail
+  {
+    class binary_rpc_client_impl
+    {
+    public:
+      fc::tcp_socket_ptr                       _socket;
+      std::unique_ptr<binary_rpc_connection>   _connection;
+      uint64_t                                 _next_request_id = 1;
+      fc::mutex                                _call_mutex; // one call at a time, so responses arrive in request order
+
+      void connect_to(const fc::ip::endpoint& remote_endpoint);
+      std::vector<char> call(uint32_t method_id, const std::vector<char>& parameters);
+    };
+
+    void binary_rpc_client_impl::connect_to(const fc::ip::endpoint& remote_endpoint)
+    {
+      _socket = std::make_shared<fc::tcp_socket>();
+      try
+      {
+        _socket->connect_to(remote_endpoint);
+      }
+      catch ( const fc::exception& e )
+      {
+        elog( "fatal: error opening binary RPC socket to endpoint ${endpoint}: ${e}", ("endpoint", remote_endpoint)("e", e.to_detail_string() ) );
+        throw;
+      }
+
+      fc::buffered_istream_ptr buffered_istream = std::make_shared<fc::buffered_istream>(_socket);
+      fc::buffered_ostream_ptr buffered_ostream = std::make_shared<fc::buffered_ostream>(_socket);
+      buffered_ostream->write(binary_rpc_magic, sizeof(binary_rpc_magic));
+      _connection.reset(new binary_rpc_connection(std::move(buffered_istream), std::move(buffered_ostream)));
+    }
+
+    std::vector<char> binary_rpc_client_impl::call(uint32_t method_id, const std::vector<char>& parameters)
+    {
+      FC_ASSERT( _connection, "not connected" );
+      fc::scoped_lock<fc::mutex> lock(_call_mutex);
+
+      binary_rpc_request request;
+      request.id = _next_request_id++;
+      request.method_id = method_id;
+      request.parameters = parameters;
+      _connection->send(request);
+
+      binary_rpc_response response = _connection->receive<binary_rpc_response>();
+      FC_ASSERT( response.id == request.id, "binary rpc response out of order", ("expected",request.id)("received",response.id) );
+      if( response.error )
+        FC_THROW( "${message}", ("message",response.error->message)("detail",response.error->detail)("code",response.error->code) );
+      return std::move(response.result);
+    }
+
+  } // end namespace detail
+
+
+  binary_rpc_client::binary_rpc_client() :
+    my(new detail::binary_rpc_client_impl)
+  {
+  }
+
+  binary_rpc_client::~binary_rpc_client()
+  {
+    try
+    {
+      close();
+    }
+    catch ( const fc::exception& e )
+    {
+      wlog( "unhandled exception thrown in destructor.\n${e}", ("e", e.to_detail_string() ) );
+    }
+  }
+
+  void binary_rpc_client::connect_to(const fc::ip::endpoint& remote_endpoint)
+  {
+    my->connect_to(remote_endpoint);
+  }
+
+  void binary_rpc_client::close()
+  {
+    my->_connection.reset();
+    if( my->_socket )
+      my->_socket->close();
+  }
+
+  bool binary_rpc_client::login(const std::string& username, const std::string& password)
+  {
+    const std::vector<char> result = my->call(binary_rpc_login_method_id, fc::raw::pack(std::make_pair(username, password)));
+    return fc::raw::unpack<bool>(result);
+  }
+
+  std::vector<char> binary_rpc_client::invoke_binary_method(uint32_t method_id, const std::vector<char>& parameters)
+  {
+    return my->call(method_id, parameters);
+  }
+
+} } // bts::rpc
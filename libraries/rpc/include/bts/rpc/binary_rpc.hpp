@@ -0,0 +1,97 @@
+#pragma once
+
+#include <fc/exception/exception.hpp>
+#include <fc/io/buffered_iostream.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bts { namespace rpc {
+
+  /**
+   *  A client switches its connection to the json rpc port over to the binary protocol by sending these
+   *  bytes before anything else.  No json message starts with a zero byte, so the server can tell the
+   *  two apart from the first byte it reads.
+   */
+  static const char     binary_rpc_magic[] = { '\0', 'B', 'T', 'S', 'R', 'P', 'C', '1' };
+
+  /** method id reserved for logging in, the parameters are the packed user name and password */
+  static const uint32_t binary_rpc_login_method_id = 0;
+
+  /** messages larger than this are rejected, so that a bad length prefix can't make us allocate everything */
+  static const uint32_t binary_rpc_max_message_size = 256 * 1024 * 1024;
+
+  /** until a connection has logged in, the server accepts only requests up to this size */
+  static const uint32_t binary_rpc_max_unauthenticated_message_size = 64 * 1024;
+
+  struct binary_rpc_request
+  {
+     uint64_t                    id = 0;
+     /** as generated by bts_api_generator from the method name */
+     uint32_t                    method_id = 0;
+     /** every parameter of the method, fc::raw packed in order */
+     std::vector<char>           parameters;
+  };
+
+  struct binary_rpc_error
+  {
+     int64_t                     code = 0;
+     std::string                 message;
+     std::string                 detail;
+  };
+
+  struct binary_rpc_response
+  {
+     uint64_t                    id = 0;
+     /** the fc::raw packed result, empty for void methods and errors */
+     std::vector<char>           result;
+     fc::optional<binary_rpc_error> error;
+  };
+
+  /**
+   *  Sends and receives the messages of the binary rpc protocol, each framed as its fc::raw packed
+   *  size followed by the packed message.
+   */
+  class binary_rpc_connection
+  {
+     public:
+       binary_rpc_connection( fc::buffered_istream_ptr in, fc::buffered_ostream_ptr out )
+       :_in( std::move( in ) ),_out( std::move( out ) ){}
+
+       template<typename T>
+       void send( const T& message )
+       {
+          const std::vector<char> data = fc::raw::pack( message );
+          FC_ASSERT( data.size() <= binary_rpc_max_message_size, "binary rpc message too large", ("size",data.size()) );
+          const uint32_t size = data.size();
+          fc::raw::pack( *_out, size );
+          _out->write( data.data(), data.size() );
+          _out->flush();
+       }
+
+       template<typename T>
+       T receive( uint32_t max_size = binary_rpc_max_message_size )
+       {
+          uint32_t size = 0;
+          fc::raw::unpack( *_in, size );
+          FC_ASSERT( size <= max_size, "binary rpc message too large", ("size",size)("max_size",max_size) );
+          std::vector<char> data( size );
+          if( size > 0 )
+             _in->read( data.data(), data.size() );
+          return fc::raw::unpack<T>( data );
+       }
+
+     private:
+       fc::buffered_istream_ptr   _in;
+       fc::buffered_ostream_ptr   _out;
+  };
+
+} } // bts::rpc
+
+FC_REFLECT( bts::rpc::binary_rpc_request, (id)(method_id)(parameters) )
+FC_REFLECT( bts::rpc::binary_rpc_error, (code)(message)(detail) )
+FC_REFLECT( bts::rpc::binary_rpc_response, (id)(result)(error) )
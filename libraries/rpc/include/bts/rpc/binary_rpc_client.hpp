@@ -0,0 +1,32 @@
+#pragma once
+
+#include <bts/rpc_stubs/common_api_binary_rpc_client.hpp>
+
+#include <fc/network/ip.hpp>
+
+#include <memory>
+
+namespace bts { namespace rpc {
+  namespace detail { class binary_rpc_client_impl; }
+
+  /**
+  *  @class binary_rpc_client
+  *  @brief provides a C++ interface to a remote BTS client over the binary rpc protocol, which shares
+  *         the json rpc port but sends fc::raw packed parameters and results instead of JSON
+  */
+  class binary_rpc_client : public bts::rpc_stubs::common_api_binary_rpc_client
+  {
+     public:
+       binary_rpc_client();
+       virtual ~binary_rpc_client();
+
+       void connect_to(const fc::ip::endpoint& remote_endpoint);
+       void close();
+
+       bool login(const std::string& username, const std::string& password);
+       virtual std::vector<char> invoke_binary_method(uint32_t method_id, const std::vector<char>& parameters) override;
+     private:
+       std::unique_ptr<detail::binary_rpc_client_impl> my;
+  };
+  typedef std::shared_ptr<binary_rpc_client> binary_rpc_client_ptr;
+} } // bts::rpc
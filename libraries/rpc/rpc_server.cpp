@@ -1,6 +1,7 @@
 #define DEFAULT_LOGGER "rpc"
 
 #include <bts/wallet/exceptions.hpp>
+#include <bts/rpc/binary_rpc.hpp>
 #include <bts/rpc/exceptions.hpp>
 #include <bts/rpc/rpc_server.hpp>
 #include <bts/utilities/git_revision.hpp>
@@ -22,9 +23,11 @@
 #include <fc/thread/mutex.hpp>
 #include <fc/thread/scoped_lock.hpp>
 
+#include <cstring>
 #include <iomanip>
 #include <limits>
 #include <sstream>
+#include <unordered_map>
 
 #include <bts/rpc_stubs/common_api_rpc_server.hpp>
 
@@ -34,7 +37,7 @@ namespace bts { namespace rpc {
 
   namespace detail
   {
-    class rpc_server_impl : public bts::rpc_stubs::common_api_rpc_server
+    class rpc_server_impl : public bts::rpc_stubs::common_api_rpc_server, public bts::blockchain::chain_observer
     {
        public:
          rpc_server_config                                 _config;
@@ -47,6 +50,9 @@ namespace bts { namespace rpc {
          fc::thread*                                       _thread;
          http_callback_type                                _http_file_callback;
          std::unordered_set<fc::rpc::json_connection_ptr>  _open_json_connections;
+         std::unordered_set<fc::tcp_socket_ptr>            _open_binary_connections;
+         /** tasks deciding the protocol of a new connection, which run for the whole life of binary connections */
+         std::unordered_map<fc::tcp_socket_ptr, fc::future<void>> _starting_connections;
          fc::mutex                                         _rpc_mutex; // locked to prevent executing two rpc calls at once
 
          typedef std::map<std::string, bts::api::method_data> method_map_type;
@@ -58,6 +64,13 @@ namespace bts { namespace rpc {
          /** the set of connections that have successfully logged in */
          std::unordered_set<fc::rpc::json_connection*> _authenticated_connection_set;
 
+         /** JSON results of cached methods keyed by method name and JSON parameters, valid for _response_cache_head_block_id */
+         std::map<std::pair<std::string, std::string>, std::string> _response_cache;
+         block_id_type                                  _response_cache_head_block_id;
+         /** the result of a cached method that could not be cached because the head block moved while it ran */
+         std::string                                    _uncached_response;
+         bool                                           _observing_chain = false;
+
          rpc_server_impl(bts::client::client* client) :
            _client(client),
            _on_quit_promise(new fc::promise<void>("rpc_quit"))
@@ -70,8 +83,63 @@ namespace bts { namespace rpc {
          virtual void verify_wallet_is_open() const override;
          virtual void verify_wallet_is_unlocked() const override;
          virtual void verify_connected_to_network() const override;
+         virtual void verify_binary_connection_is_authenticated(bool connection_is_authenticated) const override;
          virtual void store_method_metadata(const bts::api::method_data& method_metadata);
 
+         // the cache is also checked against the head block on every lookup, these only release it sooner
+         virtual void state_changed( const pending_chain_state_ptr& state ) override { _response_cache.clear(); }
+         virtual void block_applied( const block_summary& summary ) override { _response_cache.clear(); }
+
+         bool is_cached_method( const bts::api::method_data& method_data )const
+         {
+            return _config.response_cache_size > 0
+                   && !(method_data.prerequisites & (bts::api::wallet_open | bts::api::wallet_unlocked))
+                   && _config.cached_methods.find( method_data.name ) != _config.cached_methods.end();
+         }
+
+         /**
+          *  Returns the JSON result, computing it first if the head block has changed since it was stored.  The
+          *  reference is only valid until the calling task yields.
+          */
+         const std::string& dispatch_cached_method( const bts::api::method_data& method_data, const fc::variants& arguments )
+         {
+            const block_id_type head_block_id = _client->get_chain()->get_head_block_id();
+            if( head_block_id != _response_cache_head_block_id )
+            {
+               _response_cache.clear();
+               _response_cache_head_block_id = head_block_id;
+            }
+
+            const auto key = std::make_pair( method_data.name, fc::json::to_string( arguments ) );
+            const auto itr = _response_cache.find( key );
+            if( itr != _response_cache.end() )
+               return itr->second;
+
+            std::string json = fc::json::to_string( dispatch_authenticated_method( method_data, arguments ) );
+
+            // the head block may have moved while the method was running
+            if( _client->get_chain()->get_head_block_id() != _response_cache_head_block_id )
+            {
+               _uncached_response = std::move( json );
+               return _uncached_response;
+            }
+            if( _response_cache.size() >= _config.response_cache_size )
+               _response_cache.clear();
+            return _response_cache[ key ] = std::move( json );
+         }
+
+         fc::http::reply::status_code write_http_rpc_reply( const fc::http::request& r, const fc::http::server::response& s,
+                                                            const std::string& method_name, fc::http::reply::status_code status,
+                                                            const std::string& reply )
+         {
+            s.set_status( status );
+            s.set_length( reply.size() );
+            s.write( reply.c_str(), reply.size() );
+            auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
+            fc_ilog( fc::logger::get("rpc"), "Result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
+            return status;
+         }
+
          std::string help(const std::string& command_name) const;
 
          std::string make_short_description(const bts::api::method_data& method_data, bool show_decription = true) const
@@ -300,14 +368,23 @@ namespace bts { namespace rpc {
                    auto call_itr = _alias_map.find( method_name );
                    if( call_itr != _alias_map.end() )
                    {
-                      fc::mutable_variant_object  result;
-                      result["id"]     =  rpc_call["id"];
+                      const bts::api::method_data& method_data = _method_map[call_itr->second];
+                      std::string reply;
                       try
                       {
-                         result["result"] = dispatch_authenticated_method(_method_map[call_itr->second], params);
-                         auto reply = fc::json::to_string( result );
+                         if( is_cached_method( method_data ) )
+                         {
+                            reply = "{\"id\":" + fc::json::to_string( rpc_call["id"] ) + ",\"result\":"
+                                    + dispatch_cached_method( method_data, params ) + "}";
+                         }
+                         else
+                         {
+                            fc::mutable_variant_object  result;
+                            result["id"]     =  rpc_call["id"];
+                            result["result"] = dispatch_authenticated_method( method_data, params );
+                            reply = fc::json::to_string( result );
+                         }
                          status = fc::http::reply::OK;
-                         s.set_status( status );
                       }
                       catch ( const fc::canceled_exception& )
                       {
@@ -316,16 +393,12 @@ namespace bts { namespace rpc {
                       catch ( const fc::exception& e )
                       {
                           status = fc::http::reply::InternalServerError;
-                          s.set_status( status );
+                          fc::mutable_variant_object  result;
+                          result["id"]     =  rpc_call["id"];
                           result["error"] = fc::mutable_variant_object("message",e.to_string())( "detail",e.to_detail_string() )("code",e.code());
+                          reply = fc::json::to_string( result );
                       }
-                      //ilog( "${e}", ("e",result) );
-                      auto reply = fc::json::to_string( result );
-                      s.set_length( reply.size() );
-                      s.write( reply.c_str(), reply.size() );
-                      auto reply_log = reply.size() > 253 ? reply.substr(0,253) + ".." :  reply;
-                      fc_ilog( fc::logger::get("rpc"), "Result ${path} ${method}: ${reply}", ("path",r.path)("method",method_name)("reply",reply_log));
-                      return status;
+                      return write_http_rpc_reply( r, s, method_name, status, reply );
                    }
                    else
                    {
@@ -393,9 +466,38 @@ namespace bts { namespace rpc {
                 continue;
               }
 
+              // waiting for the first byte would hold up the accept loop, so decide the protocol in a task of its own
+              _starting_connections[ sock ] = fc::async( [this,sock](){
+                    start_connection( sock );
+                    _starting_connections.erase( sock );
+                 }, "rpc_server start_connection" );
+           }
+         }
+
+         void start_connection( const fc::tcp_socket_ptr& sock )
+         {
               auto buf_istream = std::make_shared<fc::buffered_istream>( sock );
               auto buf_ostream = std::make_shared<fc::buffered_ostream>( sock );
 
+              try
+              {
+                if( buf_istream->peek() == binary_rpc_magic[0] )
+                {
+                  binary_connection_loop( sock, std::move(buf_istream), std::move(buf_ostream) );
+                  return;
+                }
+              }
+              catch ( const fc::canceled_exception& )
+              {
+                throw;
+              }
+              catch ( const fc::exception& e )
+              {
+                ilog( "rpc connection closed before sending a request: ${e}", ("e", e.to_string() ) );
+                sock->close();
+                return;
+              }
+
               auto json_con = std::make_shared<fc::rpc::json_connection>( std::move(buf_istream),
                                                                           std::move(buf_ostream) );
               register_methods( json_con );
@@ -408,7 +510,73 @@ namespace bts { namespace rpc {
                   if( e )
                     elog("Connection exited with error: ${error}", ("error", e->what()));
               });
-           }
+         }
+
+         /** serves the binary rpc protocol, see binary_rpc.hpp, until the client disconnects */
+         void binary_connection_loop( const fc::tcp_socket_ptr& sock, fc::buffered_istream_ptr buf_istream, fc::buffered_ostream_ptr buf_ostream )
+         {
+            _open_binary_connections.insert( sock );
+            try
+            {
+              char magic[sizeof(binary_rpc_magic)];
+              buf_istream->read( magic, sizeof(magic) );
+              FC_ASSERT( memcmp( magic, binary_rpc_magic, sizeof(magic) ) == 0, "unsupported binary rpc protocol" );
+
+              binary_rpc_connection connection( std::move(buf_istream), std::move(buf_ostream) );
+              bool authenticated = false;
+              while( true )
+              {
+                 const binary_rpc_request request = connection.receive<binary_rpc_request>(
+                       authenticated ? binary_rpc_max_message_size : binary_rpc_max_unauthenticated_message_size );
+                 binary_rpc_response response;
+                 response.id = request.id;
+                 try
+                 {
+                    if( request.method_id == binary_rpc_login_method_id )
+                    {
+                       const auto credentials = fc::raw::unpack<std::pair<std::string, std::string>>( request.parameters );
+                       FC_ASSERT( credentials.first == _config.rpc_user && credentials.second == _config.rpc_password );
+                       authenticated = true;
+                       response.result = fc::raw::pack( true );
+                    }
+                    else
+                    {
+                       fc::scoped_lock<fc::mutex> lock(_rpc_mutex);
+                       response.result = invoke_binary_method( authenticated, request.method_id, request.parameters );
+                    }
+                 }
+                 catch ( const fc::canceled_exception& )
+                 {
+                    throw;
+                 }
+                 catch ( const fc::exception& e )
+                 {
+                    binary_rpc_error error;
+                    error.code = e.code();
+                    error.message = e.to_string();
+                    error.detail = e.to_detail_string();
+                    response.result.clear();
+                    response.error = error;
+                 }
+                 connection.send( response );
+              }
+            }
+            catch ( const fc::canceled_exception& )
+            {
+              _open_binary_connections.erase( sock );
+              sock->close();
+              throw;
+            }
+            catch ( const fc::eof_exception& )
+            {
+              ilog( "binary rpc connection closed" );
+            }
+            catch ( const fc::exception& e )
+            {
+              elog( "Binary rpc connection exited with error: ${e}", ("e", e.to_detail_string() ) );
+            }
+            _open_binary_connections.erase( sock );
+            sock->close();
          }
 
          void register_methods( fc::rpc::json_connection_ptr con )
@@ -557,6 +725,11 @@ namespace bts { namespace rpc {
       if (!_client->is_connected())
         throw rpc_client_not_connected_exception(FC_LOG_MESSAGE(error, "The client must be connected to the network to execute this command"));
     }
+    void rpc_server_impl::verify_binary_connection_is_authenticated(bool connection_is_authenticated) const
+    {
+      if (!connection_is_authenticated)
+        FC_THROW("The RPC connection must be logged in before executing this command");
+    }
     void rpc_server_impl::store_method_metadata(const bts::api::method_data& method_metadata)
     {
       _self->register_method(method_metadata);
@@ -647,6 +820,8 @@ namespace bts { namespace rpc {
   {
     try
     {
+      if( my->_observing_chain )
+        my->_client->get_chain()->remove_observer( my.get() );
       shutdown_rpc_server();
       wait_till_rpc_server_shutdown();
       // just to be safe, destroy the  servers inside this try/catch block in case they throw
@@ -726,6 +901,12 @@ namespace bts { namespace rpc {
       }
 
       my->_httpd->on_request([m](const fc::http::request& r, const fc::http::server::response& s){ m->handle_request(r, s); });
+
+      if( !my->_observing_chain )
+      {
+        my->_client->get_chain()->add_observer( my.get() );
+        my->_observing_chain = true;
+      }
       return true;
     } FC_RETHROW_EXCEPTIONS(warn, "attempting to configure rpc server ${port}", ("port", cfg.rpc_endpoint)("config", cfg));
   }
@@ -789,6 +970,20 @@ namespace bts { namespace rpc {
       {
       }
     }
+    // each task removes itself from the map when it finishes
+    const auto starting_connections = my->_starting_connections;
+    for( const auto& connection : starting_connections )
+    {
+      try
+      {
+        if( connection.second.valid() && !connection.second.ready() )
+          connection.second.wait();
+      }
+      catch (const fc::exception&)
+      {
+      }
+    }
+    my->_starting_connections.clear();
   }
 
   void rpc_server::shutdown_rpc_server()
@@ -802,8 +997,16 @@ namespace bts { namespace rpc {
        my->_on_quit_promise->set_value();
     if (my->_tcp_serv)
       my->_tcp_serv->close();
+    for( const fc::tcp_socket_ptr& sock : my->_open_binary_connections )
+      sock->close();
     if( my->_accept_loop_complete.valid() && !my->_accept_loop_complete.ready())
       my->_accept_loop_complete.cancel(__FUNCTION__);
+    for( auto& connection : my->_starting_connections )
+    {
+      connection.first->close();
+      if( connection.second.valid() && !connection.second.ready() )
+        connection.second.cancel(__FUNCTION__);
+    }
   }
 
   std::string rpc_server::help(const std::string& command_name) const
@@ -0,0 +1,145 @@
+#include <bts/utilities/compression.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#ifdef BTS_HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+#include <cstring>
+
+namespace bts { namespace utilities {
+
+  bool compression_available()
+  {
+#ifdef BTS_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  std::vector<char> zlib_compress( const char* data, size_t size, int level )
+  { try {
+#ifdef BTS_HAVE_ZLIB
+    uLongf compressed_size = compressBound( size );
+    std::vector<char> compressed( compressed_size );
+    int result = compress2( (Bytef*)compressed.data(), &compressed_size, (const Bytef*)data, size, level );
+    FC_ASSERT( result == Z_OK, "zlib compression failed", ("result",result) );
+    compressed.resize( compressed_size );
+    return compressed;
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  } FC_CAPTURE_AND_RETHROW( (size)(level) ) }
+
+  std::vector<char> zlib_decompress( const char* data, size_t size, size_t uncompressed_size )
+  { try {
+#ifdef BTS_HAVE_ZLIB
+    std::vector<char> uncompressed( uncompressed_size );
+    uLongf actual_size = uncompressed_size;
+    int result = uncompress( (Bytef*)uncompressed.data(), &actual_size, (const Bytef*)data, size );
+    FC_ASSERT( result == Z_OK, "zlib decompression failed", ("result",result) );
+    FC_ASSERT( actual_size == uncompressed_size, "decompressed data has the wrong size", ("actual_size",actual_size) );
+    return uncompressed;
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  } FC_CAPTURE_AND_RETHROW( (size)(uncompressed_size) ) }
+
+  namespace detail
+  {
+#ifdef BTS_HAVE_ZLIB
+    struct deflate_stream_impl { z_stream stream; };
+    struct inflate_stream_impl { z_stream stream; };
+#else
+    struct deflate_stream_impl {};
+    struct inflate_stream_impl {};
+#endif
+  }
+
+  deflate_stream::deflate_stream( int level )
+  :my( new detail::deflate_stream_impl )
+  {
+#ifdef BTS_HAVE_ZLIB
+    memset( &my->stream, 0, sizeof(my->stream) );
+    int result = deflateInit( &my->stream, level );
+    FC_ASSERT( result == Z_OK, "unable to initialize zlib", ("result",result) );
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  }
+
+  deflate_stream::~deflate_stream()
+  {
+#ifdef BTS_HAVE_ZLIB
+    deflateEnd( &my->stream );
+#endif
+  }
+
+  std::vector<char> deflate_stream::compress( const char* data, size_t size )
+  { try {
+#ifdef BTS_HAVE_ZLIB
+    // the sync flush marker isn't covered by deflateBound, so leave some room for it
+    std::vector<char> compressed( deflateBound( &my->stream, size ) + 16 );
+    size_t compressed_size = 0;
+    my->stream.next_in = (Bytef*)data;
+    my->stream.avail_in = size;
+    do
+    {
+      if( compressed_size == compressed.size() )
+        compressed.resize( compressed.size() * 2 );
+      my->stream.next_out = (Bytef*)compressed.data() + compressed_size;
+      my->stream.avail_out = compressed.size() - compressed_size;
+      int result = deflate( &my->stream, Z_SYNC_FLUSH );
+      FC_ASSERT( result == Z_OK || result == Z_BUF_ERROR, "zlib compression failed", ("result",result) );
+      compressed_size = compressed.size() - my->stream.avail_out;
+    } while( my->stream.avail_out == 0 );
+    compressed.resize( compressed_size );
+    return compressed;
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  } FC_CAPTURE_AND_RETHROW( (size) ) }
+
+  inflate_stream::inflate_stream()
+  :my( new detail::inflate_stream_impl )
+  {
+#ifdef BTS_HAVE_ZLIB
+    memset( &my->stream, 0, sizeof(my->stream) );
+    int result = inflateInit( &my->stream );
+    FC_ASSERT( result == Z_OK, "unable to initialize zlib", ("result",result) );
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  }
+
+  inflate_stream::~inflate_stream()
+  {
+#ifdef BTS_HAVE_ZLIB
+    inflateEnd( &my->stream );
+#endif
+  }
+
+  std::vector<char> inflate_stream::decompress( const char* data, size_t size, size_t uncompressed_size )
+  { try {
+#ifdef BTS_HAVE_ZLIB
+    // one spare byte lets us detect a buffer that inflates to more than we were told
+    std::vector<char> uncompressed( uncompressed_size + 1 );
+    my->stream.next_in = (Bytef*)data;
+    my->stream.avail_in = size;
+    my->stream.next_out = (Bytef*)uncompressed.data();
+    my->stream.avail_out = uncompressed.size();
+    int result = inflate( &my->stream, Z_SYNC_FLUSH );
+    FC_ASSERT( result == Z_OK || result == Z_BUF_ERROR, "zlib decompression failed", ("result",result) );
+    size_t actual_size = uncompressed.size() - my->stream.avail_out;
+    FC_ASSERT( my->stream.avail_in == 0 && actual_size == uncompressed_size,
+               "decompressed data has the wrong size", ("actual_size",actual_size) );
+    uncompressed.resize( uncompressed_size );
+    return uncompressed;
+#else
+    FC_THROW_EXCEPTION( fc::assert_exception, "this build does not support compression" );
+#endif
+  } FC_CAPTURE_AND_RETHROW( (size)(uncompressed_size) ) }
+
+} } // end namespace bts::utilities
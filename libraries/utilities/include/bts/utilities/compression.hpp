@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace bts { namespace utilities {
+
+  /** @return true if this build was linked against zlib, false if the compression functions are unavailable */
+  bool compression_available();
+
+  /**
+   *  Deflates size bytes starting at data.
+   *
+   *  @param level zlib compression level, 1 (fastest) to 9 (smallest)
+   *  @throws fc::exception if compression is unavailable or fails
+   */
+  std::vector<char> zlib_compress( const char* data, size_t size, int level = 1 );
+
+  /**
+   *  Inflates a buffer produced by zlib_compress.  The caller must know the size of the uncompressed
+   *  data, which is also used as an upper bound so a hostile peer cannot make us allocate arbitrary
+   *  amounts of memory.
+   *
+   *  @throws fc::exception if the data is corrupt or does not inflate to exactly uncompressed_size bytes
+   */
+  std::vector<char> zlib_decompress( const char* data, size_t size, size_t uncompressed_size );
+
+  namespace detail { struct deflate_stream_impl; struct inflate_stream_impl; }
+
+  /**
+   *  Compresses a sequence of buffers as one continuous deflate stream, flushing after each buffer
+   *  so it can be decoded as soon as it arrives.  Because the compression window carries over from
+   *  one buffer to the next, data that repeats what was recently sent (as consecutive blocks tend to)
+   *  compresses far better than it would on its own.  The receiving side must feed every buffer,
+   *  in order, to a single inflate_stream.
+   */
+  class deflate_stream
+  {
+    public:
+      /** @throws fc::exception if compression is unavailable */
+      deflate_stream( int level = 1 );
+      ~deflate_stream();
+
+      std::vector<char> compress( const char* data, size_t size );
+    private:
+      std::unique_ptr<detail::deflate_stream_impl> my;
+  };
+
+  /** Decodes the buffers produced by a deflate_stream */
+  class inflate_stream
+  {
+    public:
+      /** @throws fc::exception if compression is unavailable */
+      inflate_stream();
+      ~inflate_stream();
+
+      /**
+       *  @throws fc::exception if the data is corrupt or does not inflate to exactly uncompressed_size bytes.
+       *  The stream can't be used after an exception.
+       */
+      std::vector<char> decompress( const char* data, size_t size, size_t uncompressed_size );
+    private:
+      std::unique_ptr<detail::inflate_stream_impl> my;
+  };
+
+} } // end namespace bts::utilities
@@ -0,0 +1,73 @@
+#include <bts/blockchain/chain_database.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+/**
+ * Offline counterpart to the blockchain_dump_state RPC: dumps the tables of a chain database
+ * that isn't in use by a running client, or loads a dump into an empty data directory.
+ */
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()
+      ( "help", "Display this help message and exit" )
+      ( "chain-dir", boost::program_options::value<std::string>(), "The client's chain database directory (usually <data-dir>/chain)" )
+      ( "genesis-config", boost::program_options::value<std::string>(), "The genesis file the chain database was created with, if not the built-in one" )
+      ( "dump", boost::program_options::value<std::string>(), "Dump every table into this directory" )
+      ( "format", boost::program_options::value<std::string>()->default_value( "binary" ), "Dump format: binary or jsonl" )
+      ( "import", boost::program_options::value<std::string>(), "Load the dump in this directory into an empty chain-dir" );
+
+   boost::program_options::variables_map option_variables;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), option_variables );
+      boost::program_options::notify( option_variables );
+   }
+   catch ( const boost::program_options::error& e )
+   {
+      std::cerr << "Error parsing command-line options: " << e.what() << "\n\n" << option_config << "\n";
+      return 1;
+   }
+
+   if( option_variables.count( "help" ) || !option_variables.count( "chain-dir" ) ||
+       option_variables.count( "dump" ) == option_variables.count( "import" ) )
+   {
+      std::cout << option_config << "\n";
+      return option_variables.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      const fc::path chain_dir = option_variables["chain-dir"].as<std::string>();
+      auto chain = std::make_shared<bts::blockchain::chain_database>();
+
+      if( option_variables.count( "import" ) )
+      {
+         chain->import_state( chain_dir, option_variables["import"].as<std::string>() );
+         std::cout << "Imported state into " << chain_dir.preferred_string() << "\n";
+      }
+      else
+      {
+         fc::optional<fc::path> genesis_file;
+         if( option_variables.count( "genesis-config" ) )
+            genesis_file = fc::path( option_variables["genesis-config"].as<std::string>() );
+         FC_ASSERT( fc::exists( chain_dir / "index" ), "No chain database found in ${dir}", ("dir",chain_dir) );
+
+         chain->open( chain_dir, genesis_file );
+         chain->dump_state( option_variables["dump"].as<std::string>(), option_variables["format"].as<std::string>() );
+         chain->close();
+         std::cout << "Dumped state from " << chain_dir.preferred_string() << "\n";
+      }
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -25,7 +25,7 @@ int main( int argc, char** argv )
                              ("prologue"    ,  boost::program_options::value<std::string>(), "Add the contents of this file to start of generated C++ source")
                              ("epilogue"    ,  boost::program_options::value<std::string>(), "Add the contents of this file to end   of generated C++ source")
                              ("json"        ,  boost::program_options::value<std::string>(), "The json file to convert to C++ source code")
-                             ("binary-out"  ,  boost::program_options::value<std::string>(), "The raw binary file to generate")
+                             ("binary-out"  ,  boost::program_options::value<std::string>(), "The raw binary file to generate, which can be passed to the client as a .dat genesis file")
                              ("source-out"  ,  boost::program_options::value<std::string>(), "The C++ source file to generate");
   boost::program_options::variables_map option_variables;
   try
@@ -57,7 +57,7 @@ int main( int argc, char** argv )
 
   if (option_variables.count("binary-out"))
   {
-    std::ofstream genesis_bin(option_variables["binary-out"].as<std::string>());
+    std::ofstream genesis_bin(option_variables["binary-out"].as<std::string>(), std::ios::out | std::ios::binary);
     fc::raw::pack(genesis_bin, genesis_config);
   }
 
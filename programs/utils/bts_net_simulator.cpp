@@ -0,0 +1,77 @@
+#include "network_simulator.hpp"
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+/**
+ * Runs a model of the p2p relay protocol over a simulated network and prints block and transaction
+ * propagation percentiles and the time a new node takes to sync.  This is useful for reasoning about
+ * protocol parameters (batching intervals, sync window sizes, connection counts), but it does not run
+ * node.cpp, so it says nothing about the performance of the network code itself.
+ */
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()
+      ( "help", "Display this help message and exit" )
+      ( "config", boost::program_options::value<std::string>(), "JSON file with simulation parameters; missing ones keep their defaults" )
+      ( "seed", boost::program_options::value<uint64_t>(), "Override the random seed" )
+      ( "nodes", boost::program_options::value<uint32_t>(), "Override the number of nodes" )
+      ( "print-default-config", "Print the default simulation parameters and exit" )
+      ( "output", boost::program_options::value<std::string>(), "Also write the results as json to this file" );
+
+   boost::program_options::variables_map option_variables;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), option_variables );
+      boost::program_options::notify( option_variables );
+   }
+   catch ( const boost::program_options::error& e )
+   {
+      std::cerr << "Error parsing command-line options: " << e.what() << "\n\n" << option_config << "\n";
+      return 1;
+   }
+
+   if( option_variables.count( "help" ) )
+   {
+      std::cout << option_config << "\n";
+      return 0;
+   }
+
+   try
+   {
+      bts::net::network_simulator_config config;
+      if( option_variables.count( "print-default-config" ) )
+      {
+         std::cout << fc::json::to_pretty_string( config ) << "\n";
+         return 0;
+      }
+      if( option_variables.count( "config" ) )
+         config = fc::json::from_file( fc::path( option_variables["config"].as<std::string>() ) ).as<bts::net::network_simulator_config>();
+      if( option_variables.count( "seed" ) )
+         config.seed = option_variables["seed"].as<uint64_t>();
+      if( option_variables.count( "nodes" ) )
+         config.node_count = option_variables["nodes"].as<uint32_t>();
+
+      const bts::net::network_simulator_results results = bts::net::network_simulator( config ).run();
+
+      fc::mutable_variant_object report;
+      report["config"] = config;
+      report["results"] = results;
+      std::cout << fc::json::to_pretty_string( report ) << "\n";
+      if( option_variables.count( "output" ) )
+         fc::json::save_to_file( fc::variant( report ), fc::path( option_variables["output"].as<std::string>() ) );
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
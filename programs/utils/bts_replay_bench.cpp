@@ -0,0 +1,251 @@
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/signature_cache.hpp>
+#include <bts/db/level_map.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/fstream.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/time.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+
+using namespace bts::blockchain;
+
+struct replay_result
+{
+   uint32_t                blocks = 0;
+   uint64_t                transactions = 0;
+   fc::microseconds        elapsed;
+};
+
+/** Reads the blocks of the main chain straight out of the raw_chain tables of a chain database */
+class chain_dir_block_source
+{
+   public:
+      chain_dir_block_source( const fc::path& chain_dir )
+      {
+         FC_ASSERT( fc::exists( chain_dir / "raw_chain" ), "No chain database found in ${dir}", ("dir",chain_dir) );
+         _block_num_to_id_db.open( chain_dir / "raw_chain/block_num_to_id_db", false );
+         _block_id_to_block_data_db.open( chain_dir / "raw_chain/block_id_to_block_data_db", false );
+      }
+
+      uint32_t last_block_num()const
+      {
+         uint32_t last_block_num = 0;
+         block_id_type last_block_id;
+         _block_num_to_id_db.last( last_block_num, last_block_id );
+         return last_block_num;
+      }
+
+      full_block fetch( uint32_t block_num )const
+      {
+         return _block_id_to_block_data_db.fetch( _block_num_to_id_db.fetch( block_num ) );
+      }
+
+   private:
+      bts::db::level_map<uint32_t,block_id_type>     _block_num_to_id_db;
+      bts::db::level_map<block_id_type,full_block>   _block_id_to_block_data_db;
+};
+
+/** Blocks exported with --export-blocks are stored one after another, fc::raw packed */
+std::vector<full_block> load_blocks_file( const fc::path& blocks_file )
+{
+   std::string contents;
+   fc::read_file_contents( blocks_file, contents );
+
+   std::vector<full_block> blocks;
+   fc::datastream<const char*> ds( contents.data(), contents.size() );
+   while( ds.remaining() > 0 )
+   {
+      full_block block;
+      fc::raw::unpack( ds, block );
+      blocks.push_back( std::move( block ) );
+   }
+   return blocks;
+}
+
+/**
+ * Pushes blocks [first_block_num, last_block_num] into chain, which must be at first_block_num - 1.
+ * Only the blocks from timed_block_num on are timed and counted.
+ */
+replay_result replay( const chain_database_ptr& chain,
+                      const std::function<full_block( uint32_t )>& get_block,
+                      uint32_t first_block_num, uint32_t timed_block_num, uint32_t last_block_num )
+{
+   replay_result result;
+   fc::time_point start = fc::time_point::now();
+   for( uint32_t block_num = first_block_num; block_num <= last_block_num; ++block_num )
+   {
+      if( block_num == timed_block_num )
+      {
+         chain->reset_metrics();
+         start = fc::time_point::now();
+      }
+
+      const full_block block = get_block( block_num );
+      chain->push_block( block );
+
+      if( block_num >= timed_block_num )
+      {
+         ++result.blocks;
+         result.transactions += block.user_transactions.size();
+      }
+   }
+   result.elapsed = fc::time_point::now() - start;
+   return result;
+}
+
+/**
+ * Measures how fast blocks are applied by replaying them from an existing chain database (or a file
+ * written by --export-blocks) into an empty one, so that throughput regressions can be caught before
+ * a release instead of being inferred from reindex logs.
+ */
+int main( int argc, char** argv )
+{
+   boost::program_options::options_description option_config( "Allowed options" );
+   option_config.add_options()
+      ( "help", "Display this help message and exit" )
+      ( "chain-dir", boost::program_options::value<std::string>(), "Replay the blocks of this chain database directory (usually <data-dir>/chain)" )
+      ( "blocks-file", boost::program_options::value<std::string>(), "Replay the blocks in this file, as written by --export-blocks" )
+      ( "export-blocks", boost::program_options::value<std::string>(), "Write the blocks of chain-dir in the selected range to this file and exit" )
+      ( "genesis-config", boost::program_options::value<std::string>(), "The genesis file the blocks were produced with, if not the built-in one" )
+      ( "start-block", boost::program_options::value<uint32_t>()->default_value( 1 ), "First block to time; earlier blocks are applied untimed" )
+      ( "end-block", boost::program_options::value<uint32_t>(), "Last block to replay (default: all of them)" )
+      ( "verify-signatures", boost::program_options::value<bool>()->default_value( true ), "Verify transaction signatures while replaying" )
+      ( "warm", "Replay the range once untimed first, so that the signature cache and the operating system's file cache are warm" )
+      ( "preload", "Read all of the blocks into memory before timing, so that reading them is not measured" )
+      ( "work-dir", boost::program_options::value<std::string>(), "Directory for the replayed chain database (default: a temporary directory)" )
+      ( "output", boost::program_options::value<std::string>(), "Also write the results as json to this file" );
+
+   boost::program_options::variables_map option_variables;
+   try
+   {
+      boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( option_config ).run(), option_variables );
+      boost::program_options::notify( option_variables );
+   }
+   catch ( const boost::program_options::error& e )
+   {
+      std::cerr << "Error parsing command-line options: " << e.what() << "\n\n" << option_config << "\n";
+      return 1;
+   }
+
+   if( option_variables.count( "help" ) || option_variables.count( "chain-dir" ) == option_variables.count( "blocks-file" ) ||
+       ( option_variables.count( "export-blocks" ) && !option_variables.count( "chain-dir" ) ) )
+   {
+      std::cout << option_config << "\n";
+      return option_variables.count( "help" ) ? 0 : 1;
+   }
+
+   try
+   {
+      const uint32_t start_block = std::max<uint32_t>( option_variables["start-block"].as<uint32_t>(), 1 );
+
+      std::vector<full_block> blocks;
+      std::shared_ptr<chain_dir_block_source> source;
+      uint32_t end_block = 0;
+      if( option_variables.count( "chain-dir" ) )
+      {
+         source = std::make_shared<chain_dir_block_source>( option_variables["chain-dir"].as<std::string>() );
+         end_block = source->last_block_num();
+      }
+      else
+      {
+         blocks = load_blocks_file( option_variables["blocks-file"].as<std::string>() );
+         end_block = blocks.size();
+      }
+      if( option_variables.count( "end-block" ) )
+         end_block = std::min( end_block, option_variables["end-block"].as<uint32_t>() );
+      FC_ASSERT( start_block <= end_block, "Nothing to replay", ("start_block",start_block)("end_block",end_block) );
+
+      if( option_variables.count( "export-blocks" ) )
+      {
+         fc::ofstream out( fc::path( option_variables["export-blocks"].as<std::string>() ) );
+         for( uint32_t block_num = 1; block_num <= end_block; ++block_num )
+            fc::raw::pack( out, source->fetch( block_num ) );
+         out.close();
+         std::cout << "Exported " << end_block << " blocks\n";
+         return 0;
+      }
+
+      if( source && option_variables.count( "preload" ) )
+      {
+         blocks.reserve( end_block );
+         for( uint32_t block_num = 1; block_num <= end_block; ++block_num )
+            blocks.push_back( source->fetch( block_num ) );
+         source.reset();
+      }
+
+      std::function<full_block( uint32_t )> get_block;
+      if( source )
+         get_block = [&]( uint32_t block_num ) { return source->fetch( block_num ); };
+      else
+         get_block = [&]( uint32_t block_num ) { return blocks.at( block_num - 1 ); };
+
+      fc::optional<fc::path> genesis_file;
+      if( option_variables.count( "genesis-config" ) )
+         genesis_file = fc::path( option_variables["genesis-config"].as<std::string>() );
+      const bool verify_signatures = option_variables["verify-signatures"].as<bool>();
+
+      fc::temp_directory temp_dir;
+      const fc::path work_dir = option_variables.count( "work-dir" ) ? fc::path( option_variables["work-dir"].as<std::string>() )
+                                                                     : temp_dir.path();
+
+      auto open_chain = [&]( const fc::path& dir ) -> chain_database_ptr
+      {
+         FC_ASSERT( !fc::exists( dir / "index" ), "The work directory ${dir} already contains a chain database", ("dir",dir) );
+         auto chain = std::make_shared<chain_database>();
+         chain->open( dir, genesis_file );
+         chain->skip_signature_verification( !verify_signatures );
+         return chain;
+      };
+
+      if( option_variables.count( "warm" ) )
+      {
+         std::cout << "Warming up with blocks 1 to " << end_block << "...\n";
+         auto chain = open_chain( work_dir / "warmup" );
+         replay( chain, get_block, 1, start_block, end_block );
+         chain->close();
+         fc::remove_all( work_dir / "warmup" );
+      }
+      else
+      {
+         signature_cache::clear();
+      }
+
+      auto chain = open_chain( work_dir / "chain" );
+      chain->enable_metrics( true );
+      std::cout << "Replaying blocks " << start_block << " to " << end_block << "...\n";
+      const replay_result result = replay( chain, get_block, 1, start_block, end_block );
+      const fc::variant_object metrics = chain->get_metrics();
+      chain->close();
+
+      const double seconds = double( result.elapsed.count() ) / 1000000;
+      fc::mutable_variant_object report;
+      report["start_block"] = start_block;
+      report["end_block"] = end_block;
+      report["verify_signatures"] = verify_signatures;
+      report["warm"] = option_variables.count( "warm" ) > 0;
+      report["blocks"] = result.blocks;
+      report["transactions"] = result.transactions;
+      report["seconds"] = seconds;
+      report["blocks_per_second"] = seconds > 0 ? result.blocks / seconds : 0;
+      report["transactions_per_second"] = seconds > 0 ? result.transactions / seconds : 0;
+      report["extend_chain_phases"] = metrics["extend_chain_phases"];
+      report["operations"] = metrics["operations"];
+      report["signature_cache"] = metrics["signature_cache"];
+
+      std::cout << fc::json::to_pretty_string( report ) << "\n";
+      if( option_variables.count( "output" ) )
+         fc::json::save_to_file( fc::variant( report ), fc::path( option_variables["output"].as<std::string>() ) );
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
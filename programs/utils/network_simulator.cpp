@@ -0,0 +1,528 @@
+#include "network_simulator.hpp"
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace bts { namespace net {
+
+    namespace detail {
+      /** rough sizes of the real messages, including the 8 byte message header */
+      static const uint32_t simulated_message_header_size = 8;
+      static const uint32_t simulated_item_hash_size = 20;
+
+      /** same order as peer_connection::message_priority */
+      enum simulated_message_priority
+      {
+        simulated_control_priority,
+        simulated_block_priority,
+        simulated_block_inventory_priority,
+        simulated_sync_priority,
+        simulated_transaction_priority,
+        simulated_message_priority_count
+      };
+
+      enum class simulated_message_type
+      {
+        inventory,
+        fetch_items,
+        item,
+        fetch_blockchain_item_ids,
+        blockchain_item_ids,
+        fetch_sync_blocks,
+        sync_block
+      };
+
+      struct simulated_message
+      {
+        simulated_message_type    type;
+        uint32_t                  from;
+        uint32_t                  to;
+        std::vector<uint32_t>     items;
+        uint32_t                  size;
+        simulated_message_priority priority;
+      };
+
+      struct simulated_item
+      {
+        bool     is_block;
+        uint32_t origin;
+        uint64_t created_time;
+      };
+
+      struct simulated_fetch
+      {
+        uint32_t              peer;
+        std::vector<uint32_t> peers_tried;
+      };
+
+      struct simulated_node
+      {
+        std::vector<uint32_t>                      peers;
+        std::unordered_map<uint32_t, uint32_t>     peer_index;         // node -> index into peers
+        std::vector<uint64_t>                      peer_latency;       // microseconds, one way
+        std::vector<uint64_t>                      last_delivery_time; // keeps each link in order, like tcp
+        std::vector<std::unordered_set<uint32_t> > known_inventory;    // items each peer has or was told about
+
+        std::unordered_map<uint32_t, uint64_t>     received_time;      // items we have
+        std::unordered_map<uint32_t, simulated_fetch> items_being_fetched;
+        std::unordered_map<uint32_t, std::vector<uint32_t> > advertisers; // peers that advertised an item we're fetching
+
+        std::vector<uint32_t>                      new_inventory;
+        bool                                       advertise_scheduled = false;
+
+        std::array<std::deque<simulated_message>, simulated_message_priority_count> send_queues;
+        bool                                       transmitting = false;
+
+        // sync state, only used by the joining node
+        uint32_t                                   next_sync_block_to_request = 0;
+        uint32_t                                   next_sync_block_to_apply = 0;
+        std::unordered_set<uint32_t>               sync_blocks_received;
+        std::unordered_set<uint32_t>               peers_with_sync_request;
+        uint64_t                                   sync_busy_until = 0;
+        bool                                       have_sync_item_ids = false;
+      };
+
+      struct simulated_event
+      {
+        uint64_t              time;
+        uint64_t              sequence;
+        std::function<void()> action;
+        bool operator>(const simulated_event& other) const
+        {
+          return time != other.time ? time > other.time : sequence > other.sequence;
+        }
+      };
+
+      class network_simulator_impl
+      {
+        public:
+          network_simulator_config                 _config;
+          uint64_t                                 _random_state;
+          uint64_t                                 _now = 0;
+          uint64_t                                 _event_sequence = 0;
+          std::priority_queue<simulated_event, std::vector<simulated_event>, std::greater<simulated_event> > _events;
+
+          std::vector<simulated_node>              _nodes;
+          std::vector<simulated_item>              _items;
+          network_simulator_results                _results;
+
+          uint32_t                                 _sync_node = 0;
+          uint64_t                                 _sync_start_time = 0;
+          uint64_t                                 _sync_finish_time = 0;
+
+          network_simulator_impl(const network_simulator_config& config) :
+            _config(config),
+            _random_state(config.seed)
+          {
+            FC_ASSERT(config.node_count >= 2, "need at least two nodes");
+            FC_ASSERT(config.min_latency_ms <= config.max_latency_ms);
+            FC_ASSERT(config.loss_rate >= 0 && config.loss_rate < 1);
+          }
+
+          // splitmix64, so results don't depend on the standard library's distributions
+          uint64_t random()
+          {
+            uint64_t z = (_random_state += UINT64_C(0x9e3779b97f4a7c15));
+            z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+            z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+            return z ^ (z >> 31);
+          }
+          double random_fraction() { return (random() >> 11) * (1.0 / (UINT64_C(1) << 53)); }
+          uint32_t random_index(uint32_t count) { return random() % count; }
+
+          static uint64_t to_microseconds(double ms) { return (uint64_t)(ms * 1000); }
+
+          void schedule(uint64_t time, std::function<void()> action)
+          {
+            _events.push(simulated_event{std::max(time, _now), _event_sequence++, std::move(action)});
+          }
+
+          void run_events()
+          {
+            while (!_events.empty())
+            {
+              simulated_event event = _events.top();
+              _events.pop();
+              _now = event.time;
+              event.action();
+            }
+          }
+
+          void connect(uint32_t first, uint32_t second)
+          {
+            if (first == second || _nodes[first].peer_index.count(second))
+              return;
+            uint64_t latency = to_microseconds(_config.min_latency_ms +
+                                            random_fraction() * (_config.max_latency_ms - _config.min_latency_ms));
+            for (uint32_t node : {first, second})
+            {
+              simulated_node& this_node = _nodes[node];
+              uint32_t peer = node == first ? second : first;
+              this_node.peer_index[peer] = this_node.peers.size();
+              this_node.peers.push_back(peer);
+              this_node.peer_latency.push_back(latency);
+              this_node.last_delivery_time.push_back(0);
+              this_node.known_inventory.emplace_back();
+            }
+          }
+
+          void build_topology()
+          {
+            _nodes.resize(_config.node_count);
+            for (uint32_t node = 0; node < _config.node_count; ++node)
+            {
+              // the first connection goes to an earlier node, so the network is always connected
+              if (node > 0)
+                connect(node, random_index(node));
+              for (uint32_t attempt = 0; attempt < _config.connections_per_node * 4 &&
+                                         _nodes[node].peers.size() < _config.connections_per_node; ++attempt)
+                connect(node, random_index(_config.node_count));
+            }
+          }
+
+          void send(simulated_message&& message)
+          {
+            const uint32_t from = message.from;
+            simulated_node& sender = _nodes[from];
+            sender.send_queues[message.priority].push_back(std::move(message));
+            if (!sender.transmitting)
+              transmit_next(from);
+          }
+
+          /** a node's messages go out one at a time through its upload bandwidth, highest priority first */
+          void transmit_next(uint32_t node)
+          {
+            simulated_node& sender = _nodes[node];
+            auto queue = std::find_if(sender.send_queues.begin(), sender.send_queues.end(),
+                                      [](const std::deque<simulated_message>& q) { return !q.empty(); });
+            if (queue == sender.send_queues.end())
+            {
+              sender.transmitting = false;
+              return;
+            }
+            sender.transmitting = true;
+            simulated_message message = std::move(queue->front());
+            queue->pop_front();
+
+            ++_results.messages_sent;
+            _results.bytes_sent += message.size;
+            uint64_t transmission_time = _config.upload_bytes_per_second ?
+                                         (uint64_t)message.size * 1000000 / _config.upload_bytes_per_second : 0;
+            uint64_t finished = _now + transmission_time;
+
+            uint32_t peer = sender.peer_index.at(message.to);
+            uint64_t delivery_time = finished + sender.peer_latency[peer];
+            if (_config.loss_rate > 0 && random_fraction() < _config.loss_rate)
+            {
+              ++_results.retransmissions;
+              delivery_time += to_microseconds(_config.retransmission_delay_ms);
+            }
+            delivery_time = std::max(delivery_time, sender.last_delivery_time[peer]);
+            sender.last_delivery_time[peer] = delivery_time;
+
+            auto shared_message = std::make_shared<simulated_message>(std::move(message));
+            schedule(delivery_time, [this, shared_message]() { deliver(*shared_message); });
+            schedule(finished, [this, node]() { transmit_next(node); });
+          }
+
+          void deliver(const simulated_message& message)
+          {
+            switch (message.type)
+            {
+            case simulated_message_type::inventory:
+              on_inventory(message);
+              break;
+            case simulated_message_type::fetch_items:
+              on_fetch_items(message);
+              break;
+            case simulated_message_type::item:
+              on_item(message.to, message.from, message.items.front());
+              break;
+            case simulated_message_type::fetch_blockchain_item_ids:
+              send(simulated_message{simulated_message_type::blockchain_item_ids, message.to, message.from, {},
+                                     simulated_message_header_size + _config.sync_block_count * simulated_item_hash_size,
+                                     simulated_sync_priority});
+              break;
+            case simulated_message_type::blockchain_item_ids:
+              on_blockchain_item_ids(message.to, message.from);
+              break;
+            case simulated_message_type::fetch_sync_blocks:
+              for (uint32_t block : message.items)
+                send(simulated_message{simulated_message_type::sync_block, message.to, message.from, {block},
+                                       simulated_message_header_size + _config.block_size, simulated_sync_priority});
+              break;
+            case simulated_message_type::sync_block:
+              on_sync_block(message.to, message.from, message.items.front());
+              break;
+            }
+          }
+
+          uint32_t item_message_size(uint32_t item) const
+          {
+            return simulated_message_header_size + (_items[item].is_block ? _config.block_size : _config.transaction_size);
+          }
+
+          void create_item(bool is_block)
+          {
+            uint32_t origin = random_index(_config.node_count);
+            uint32_t item = _items.size();
+            _items.push_back(simulated_item{is_block, origin, _now});
+            _nodes[origin].received_time[item] = _now;
+            on_validated(origin, item);
+          }
+
+          void on_item(uint32_t node, uint32_t from, uint32_t item)
+          {
+            simulated_node& this_node = _nodes[node];
+            this_node.known_inventory[this_node.peer_index.at(from)].insert(item);
+            this_node.items_being_fetched.erase(item);
+            this_node.advertisers.erase(item);
+            if (!this_node.received_time.insert(std::make_pair(item, _now)).second)
+              return;
+            uint64_t validation_time = to_microseconds(_items[item].is_block ? _config.block_validation_ms : _config.transaction_validation_ms);
+            schedule(_now + validation_time, [this, node, item]() { on_validated(node, item); });
+          }
+
+          void on_validated(uint32_t node, uint32_t item)
+          {
+            simulated_node& this_node = _nodes[node];
+            this_node.new_inventory.push_back(item);
+            if (_items[item].is_block)
+              advertise_inventory(node);
+            else if (!this_node.advertise_scheduled)
+            {
+              this_node.advertise_scheduled = true;
+              schedule(_now + to_microseconds(_config.inventory_batch_interval_ms), [this, node]() { advertise_inventory(node); });
+            }
+          }
+
+          void advertise_inventory(uint32_t node)
+          {
+            simulated_node& this_node = _nodes[node];
+            this_node.advertise_scheduled = false;
+            for (uint32_t peer = 0; peer < this_node.peers.size(); ++peer)
+            {
+              std::vector<uint32_t> blocks, transactions;
+              for (uint32_t item : this_node.new_inventory)
+                if (this_node.known_inventory[peer].insert(item).second)
+                  (_items[item].is_block ? blocks : transactions).push_back(item);
+              if (!blocks.empty())
+                send(simulated_message{simulated_message_type::inventory, node, this_node.peers[peer], blocks,
+                                       simulated_message_header_size + 8 + (uint32_t)blocks.size() * simulated_item_hash_size,
+                                       simulated_block_inventory_priority});
+              if (!transactions.empty())
+                send(simulated_message{simulated_message_type::inventory, node, this_node.peers[peer], transactions,
+                                       simulated_message_header_size + 8 + (uint32_t)transactions.size() * simulated_item_hash_size,
+                                       simulated_transaction_priority});
+            }
+            this_node.new_inventory.clear();
+          }
+
+          void fetch_item(uint32_t node, uint32_t item, uint32_t peer)
+          {
+            simulated_node& this_node = _nodes[node];
+            simulated_fetch& fetch = this_node.items_being_fetched[item];
+            fetch.peer = peer;
+            fetch.peers_tried.push_back(peer);
+            send(simulated_message{simulated_message_type::fetch_items, node, peer, {item},
+                                   simulated_message_header_size + 8 + simulated_item_hash_size, simulated_control_priority});
+            schedule(_now + to_microseconds(_config.fetch_timeout_ms), [this, node, item, peer]() { on_fetch_timeout(node, item, peer); });
+          }
+
+          void on_inventory(const simulated_message& message)
+          {
+            simulated_node& this_node = _nodes[message.to];
+            uint32_t peer = this_node.peer_index.at(message.from);
+            for (uint32_t item : message.items)
+            {
+              this_node.known_inventory[peer].insert(item);
+              if (this_node.received_time.count(item))
+                continue;
+              if (this_node.items_being_fetched.count(item))
+                this_node.advertisers[item].push_back(message.from);
+              else
+                fetch_item(message.to, item, message.from);
+            }
+          }
+
+          void on_fetch_timeout(uint32_t node, uint32_t item, uint32_t peer)
+          {
+            simulated_node& this_node = _nodes[node];
+            auto fetch = this_node.items_being_fetched.find(item);
+            if (fetch == this_node.items_being_fetched.end() || fetch->second.peer != peer)
+              return;
+            for (uint32_t advertiser : this_node.advertisers[item])
+              if (std::find(fetch->second.peers_tried.begin(), fetch->second.peers_tried.end(), advertiser) == fetch->second.peers_tried.end())
+              {
+                fetch_item(node, item, advertiser);
+                return;
+              }
+            this_node.items_being_fetched.erase(fetch);
+            this_node.advertisers.erase(item);
+          }
+
+          void on_fetch_items(const simulated_message& message)
+          {
+            for (uint32_t item : message.items)
+              if (_nodes[message.to].received_time.count(item))
+                send(simulated_message{simulated_message_type::item, message.to, message.from, {item}, item_message_size(item),
+                                       _items[item].is_block ? simulated_block_priority : simulated_transaction_priority});
+          }
+
+          void start_sync()
+          {
+            _sync_node = _nodes.size();
+            _nodes.emplace_back();
+            for (uint32_t attempt = 0; attempt < _config.connections_per_node * 4 &&
+                                       _nodes[_sync_node].peers.size() < _config.connections_per_node; ++attempt)
+              connect(_sync_node, random_index(_config.node_count));
+            _sync_start_time = _now;
+            for (uint32_t peer : _nodes[_sync_node].peers)
+              send(simulated_message{simulated_message_type::fetch_blockchain_item_ids, _sync_node, peer, {},
+                                     simulated_message_header_size + 8 + simulated_item_hash_size, simulated_sync_priority});
+          }
+
+          void on_blockchain_item_ids(uint32_t node, uint32_t from)
+          {
+            simulated_node& this_node = _nodes[node];
+            if (!this_node.have_sync_item_ids)
+            {
+              this_node.have_sync_item_ids = true;
+              for (uint32_t peer : this_node.peers)
+                request_sync_window(node, peer);
+            }
+          }
+
+          /** each peer has at most one window of blocks requested from it at a time */
+          void request_sync_window(uint32_t node, uint32_t peer)
+          {
+            simulated_node& this_node = _nodes[node];
+            if (this_node.next_sync_block_to_request >= _config.sync_block_count || this_node.peers_with_sync_request.count(peer))
+              return;
+            std::vector<uint32_t> window;
+            while (window.size() < BTS_NET_SYNC_WINDOW_SIZE && this_node.next_sync_block_to_request < _config.sync_block_count)
+              window.push_back(this_node.next_sync_block_to_request++);
+            this_node.peers_with_sync_request.insert(peer);
+            send(simulated_message{simulated_message_type::fetch_sync_blocks, node, peer, window,
+                                   simulated_message_header_size + 8 + (uint32_t)window.size() * simulated_item_hash_size,
+                                   simulated_sync_priority});
+          }
+
+          void on_sync_block(uint32_t node, uint32_t from, uint32_t block)
+          {
+            simulated_node& this_node = _nodes[node];
+            this_node.sync_blocks_received.insert(block);
+            // blocks are applied in order, one at a time
+            while (this_node.sync_blocks_received.count(this_node.next_sync_block_to_apply))
+            {
+              this_node.sync_blocks_received.erase(this_node.next_sync_block_to_apply++);
+              this_node.sync_busy_until = std::max(this_node.sync_busy_until, _now) + to_microseconds(_config.block_validation_ms);
+            }
+            if (this_node.next_sync_block_to_apply == _config.sync_block_count)
+              _sync_finish_time = this_node.sync_busy_until;
+            if (block % BTS_NET_SYNC_WINDOW_SIZE == BTS_NET_SYNC_WINDOW_SIZE - 1 || block == _config.sync_block_count - 1)
+            {
+              this_node.peers_with_sync_request.erase(from);
+              request_sync_window(node, from);
+            }
+          }
+
+          propagation_statistics compute_statistics(bool blocks) const
+          {
+            propagation_statistics statistics;
+            std::vector<uint64_t> delays;
+            uint64_t pairs = 0;
+            for (uint32_t item = 0; item < _items.size(); ++item)
+            {
+              if (_items[item].is_block != blocks)
+                continue;
+              ++statistics.items;
+              for (uint32_t node = 0; node < _config.node_count; ++node)
+              {
+                if (node == _items[item].origin)
+                  continue;
+                ++pairs;
+                auto received = _nodes[node].received_time.find(item);
+                if (received != _nodes[node].received_time.end())
+                  delays.push_back(received->second - _items[item].created_time);
+              }
+            }
+            if (delays.empty())
+              return statistics;
+            std::sort(delays.begin(), delays.end());
+            auto percentile = [&](double fraction) {
+              return delays[std::min<size_t>(delays.size() - 1, (size_t)(fraction * delays.size()))] / 1000.0;
+            };
+            statistics.coverage = (double)delays.size() / pairs;
+            statistics.p50_ms = percentile(0.5);
+            statistics.p90_ms = percentile(0.9);
+            statistics.p99_ms = percentile(0.99);
+            statistics.max_ms = delays.back() / 1000.0;
+            return statistics;
+          }
+
+          network_simulator_results run()
+          {
+            build_topology();
+
+            const uint64_t duration = to_microseconds(_config.duration_ms);
+            if (_config.block_interval_ms)
+              for (uint64_t time = to_microseconds(_config.block_interval_ms); time <= duration; time += to_microseconds(_config.block_interval_ms))
+                schedule(time, [this]() { create_item(true); });
+            if (_config.transactions_per_second > 0)
+            {
+              // poisson arrivals
+              double time = 0;
+              while (true)
+              {
+                time += -std::log(1 - random_fraction()) / _config.transactions_per_second * 1000000;
+                if (time > duration)
+                  break;
+                schedule((uint64_t)time, [this]() { create_item(false); });
+              }
+            }
+            run_events();
+            ilog("simulated ${items} items over ${nodes} nodes, ${messages} messages",
+                 ("items", _items.size())("nodes", _config.node_count)("messages", _results.messages_sent));
+
+            _results.block_propagation = compute_statistics(true);
+            _results.transaction_propagation = compute_statistics(false);
+
+            if (_config.sync_block_count)
+            {
+              start_sync();
+              run_events();
+              FC_ASSERT(_nodes[_sync_node].next_sync_block_to_apply == _config.sync_block_count, "the joining node didn't finish syncing");
+              _results.sync_time_ms = (_sync_finish_time - _sync_start_time) / 1000.0;
+            }
+            _results.simulated_time_ms = _now / 1000.0;
+            return _results;
+          }
+      };
+    } // namespace detail
+
+    network_simulator::network_simulator(const network_simulator_config& config) :
+      my(new detail::network_simulator_impl(config))
+    {
+    }
+
+    network_simulator::~network_simulator()
+    {
+    }
+
+    network_simulator_results network_simulator::run()
+    {
+      return my->run();
+    }
+
+} } // end namespace bts::net
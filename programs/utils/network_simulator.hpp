@@ -0,0 +1,109 @@
+#pragma once
+
+#include <bts/blockchain/config.hpp>
+#include <bts/net/config.hpp>
+
+#include <fc/reflect/reflect.hpp>
+
+#include <memory>
+
+namespace bts { namespace net {
+    namespace detail { class network_simulator_impl; }
+
+    struct network_simulator_config
+    {
+      /** seeds every random choice, so the same config always gives the same results */
+      uint64_t seed = 1;
+
+      uint32_t node_count = 200;
+      /** outbound connections each node makes to randomly chosen nodes */
+      uint32_t connections_per_node = BTS_NET_DEFAULT_DESIRED_CONNECTIONS;
+
+      /** one-way latency of each link, chosen uniformly from this range */
+      uint32_t min_latency_ms = 20;
+      uint32_t max_latency_ms = 200;
+      /** upload bandwidth of each node, shared by all of its links; 0 for unlimited */
+      uint32_t upload_bytes_per_second = 1024 * 1024;
+      /** chance that a message needs a tcp retransmission, which costs an extra retransmission_delay_ms */
+      double   loss_rate = 0.0;
+      uint32_t retransmission_delay_ms = 200;
+
+      /** how long a node takes to validate an item before it advertises it */
+      uint32_t block_validation_ms = 50;
+      uint32_t transaction_validation_ms = 1;
+      uint32_t inventory_batch_interval_ms = BTS_NET_INVENTORY_BATCH_INTERVAL_MS;
+      /** a request that hasn't been answered in this long is sent to another peer that advertised the item */
+      uint32_t fetch_timeout_ms = 5000;
+
+      uint32_t block_size = 10 * 1024;
+      uint32_t transaction_size = 300;
+      uint32_t block_interval_ms = BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC * 1000;
+      double   transactions_per_second = 10;
+      /** how long blocks and transactions are produced for */
+      uint32_t duration_ms = 60 * 1000;
+
+      /** if nonzero, a new node joins once the run is over and syncs this many blocks from its peers */
+      uint32_t sync_block_count = 1000;
+    };
+
+    struct propagation_statistics
+    {
+      uint64_t items = 0;
+      /** fraction of (item, node) pairs where the node received the item */
+      double   coverage = 0;
+      /** delays from an item's creation to its arrival at a node, in milliseconds */
+      double   p50_ms = 0;
+      double   p90_ms = 0;
+      double   p99_ms = 0;
+      double   max_ms = 0;
+    };
+
+    struct network_simulator_results
+    {
+      propagation_statistics block_propagation;
+      propagation_statistics transaction_propagation;
+      /** time the joining node took to fetch and validate sync_block_count blocks, 0 if there was no sync */
+      double   sync_time_ms = 0;
+      uint64_t messages_sent = 0;
+      uint64_t bytes_sent = 0;
+      uint64_t retransmissions = 0;
+      /** simulated time at which the last event ran */
+      double   simulated_time_ms = 0;
+    };
+
+    /**
+     * @brief Deterministic discrete-event model of block and transaction relay between many nodes
+     *
+     * This is a separate, simplified model of the protocol, not a harness around node_impl; it shares no code
+     * with node.cpp or peer_connection.cpp and must be kept in line with them by hand.  Each simulated node
+     * advertises new items to the peers that don't know them (batching transactions for
+     * inventory_batch_interval_ms), fetches advertised items it doesn't have from the first peer that
+     * advertised them, and validates items before advertising them in turn.  Messages to a peer are sent in
+     * the same priority order peer_connection uses, over links with their own latency, sharing the node's
+     * upload bandwidth.  Syncing fetches BTS_NET_SYNC_WINDOW_SIZE blocks at a time from each peer.
+     *
+     * Time is simulated, so hundreds of nodes and hours of traffic run in seconds, and a given config always
+     * produces the same results.  Use it to compare protocol parameters, not to measure the network code.
+     */
+    class network_simulator
+    {
+        std::unique_ptr<detail::network_simulator_impl> my;
+
+      public:
+        network_simulator(const network_simulator_config& config);
+        ~network_simulator();
+
+        network_simulator_results run();
+    };
+
+} } // end namespace bts::net
+
+FC_REFLECT( bts::net::network_simulator_config,
+            (seed)(node_count)(connections_per_node)(min_latency_ms)(max_latency_ms)(upload_bytes_per_second)
+            (loss_rate)(retransmission_delay_ms)(block_validation_ms)(transaction_validation_ms)
+            (inventory_batch_interval_ms)(fetch_timeout_ms)(block_size)(transaction_size)(block_interval_ms)
+            (transactions_per_second)(duration_ms)(sync_block_count) )
+FC_REFLECT( bts::net::propagation_statistics, (items)(coverage)(p50_ms)(p90_ms)(p99_ms)(max_ms) )
+FC_REFLECT( bts::net::network_simulator_results,
+            (block_propagation)(transaction_propagation)(sync_time_ms)(messages_sent)(bytes_sent)(retransmissions)
+            (simulated_time_ms) )
@@ -0,0 +1,176 @@
+#define BOOST_TEST_MODULE DatabaseTests
+#include <boost/test/unit_test.hpp>
+
+#include <bts/db/cached_level_map.hpp>
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/db/shared_level_database.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace bts::db;
+
+/** A shared database holding one plain and one cached table, the way chain_database's unified index does */
+struct shared_database_fixture
+{
+   shared_database_fixture()
+   {
+      shared_db.register_table( "plain", plain.key_comparator() );
+      shared_db.register_table( "cached", cached.key_comparator() );
+      shared_db.open( dir.path() / "shared", level_options() );
+      plain.open( shared_db, "plain" );
+      cached.open( shared_db, "cached" );
+   }
+
+   ~shared_database_fixture()
+   {
+      cached.close();
+      plain.close();
+      shared_db.close();
+   }
+
+   fc::temp_directory                   dir;
+   level_map<uint32_t, std::string>     plain;
+   cached_level_map<uint32_t, uint64_t> cached;
+   shared_level_database                shared_db;
+};
+
+BOOST_FIXTURE_TEST_CASE( scoped_batch_commits_every_table_together, shared_database_fixture )
+{ try {
+   {
+      shared_level_database::scoped_batch batch( &shared_db );
+      plain.store( 1, "one" );
+      cached.store( 1, 100 );
+
+      // queued writes do not reach the database before the commit
+      BOOST_CHECK( !plain.fetch_optional( 1 ).valid() );
+      batch.commit();
+   }
+   BOOST_CHECK_EQUAL( plain.fetch( 1 ), "one" );
+   BOOST_CHECK_EQUAL( cached.fetch( 1 ), 100u );
+   BOOST_CHECK( shared_db.active_batch() == nullptr );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+BOOST_FIXTURE_TEST_CASE( scoped_batch_discards_writes_when_not_committed, shared_database_fixture )
+{ try {
+   plain.store( 1, "one" );
+   cached.store( 1, 100 );
+
+   try
+   {
+      shared_level_database::scoped_batch batch( &shared_db );
+      plain.store( 1, "changed" );
+      plain.store( 2, "two" );
+      plain.remove( 1 );
+      cached.store( 1, 200 );
+      cached.store( 2, 300 );
+      FC_THROW( "failure in the middle of a batch" );
+   }
+   catch ( const fc::exception& )
+   {
+   }
+
+   BOOST_CHECK( shared_db.active_batch() == nullptr );
+   BOOST_CHECK_EQUAL( plain.fetch( 1 ), "one" );
+   BOOST_CHECK( !plain.fetch_optional( 2 ).valid() );
+
+   // the cached table applied its writes in memory, so it must have been reloaded from disk
+   BOOST_CHECK_EQUAL( cached.fetch( 1 ), 100u );
+   BOOST_CHECK( !cached.fetch_optional( 2 ).valid() );
+   BOOST_CHECK_EQUAL( cached.size(), 1u );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+BOOST_FIXTURE_TEST_CASE( tables_of_a_shared_database_stay_separate, shared_database_fixture )
+{ try {
+   plain.store( 7, "seven" );
+   plain.store( 3, "three" );
+   cached.store( 5, 500 );
+
+   uint32_t key = 0;
+   std::string value;
+   BOOST_REQUIRE( plain.last( key, value ) );
+   BOOST_CHECK_EQUAL( key, 7u );
+
+   uint32_t count = 0;
+   for( auto itr = plain.begin(); itr.valid(); ++itr )
+      ++count;
+   BOOST_CHECK_EQUAL( count, 2u );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+/** Collects the bytes memcmp_key writes */
+struct key_buffer
+{
+   void write( const char* data, size_t size ) { bytes.append( data, size ); }
+   std::string bytes;
+};
+
+template<typename T>
+std::string encode_key( const T& key )
+{
+   key_buffer buffer;
+   memcmp_key<T>::encode( buffer, key );
+   return buffer.bytes;
+}
+
+/** checks that keys, given in ascending order, encode to ascending byte strings that decode back to them */
+template<typename T>
+void check_encoding_order( const std::vector<T>& keys )
+{
+   for( size_t i = 0; i < keys.size(); ++i )
+   {
+      const std::string encoded = encode_key( keys[i] );
+      fc::datastream<const char*> stream( encoded.data(), encoded.size() );
+      T decoded;
+      memcmp_key<T>::decode( stream, decoded );
+      BOOST_CHECK( decoded == keys[i] );
+      BOOST_CHECK_EQUAL( stream.remaining(), 0u );
+
+      if( i > 0 )
+      {
+         const std::string previous = encode_key( keys[i - 1] );
+         BOOST_CHECK_MESSAGE( std::lexicographical_compare( previous.begin(), previous.end(), encoded.begin(), encoded.end(),
+                                                            []( char a, char b ) { return uint8_t( a ) < uint8_t( b ); } ),
+                              "key " << i - 1 << " does not encode below key " << i );
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE( key_encoding_preserves_order )
+{ try {
+   check_encoding_order<uint32_t>( { 0, 1, 255, 256, 65536, std::numeric_limits<uint32_t>::max() } );
+   check_encoding_order<int64_t>( { std::numeric_limits<int64_t>::min(), -65536, -256, -1, 0, 1, 255, 256,
+                                    std::numeric_limits<int64_t>::max() } );
+   check_encoding_order<std::string>( { "", std::string( "\0", 1 ), std::string( "\0\0", 2 ), std::string( "\x01" ),
+                                        "a", std::string( "a\0", 2 ), std::string( "a\0b", 3 ), "aa", "b", "\xff" } );
+   check_encoding_order<std::pair<std::string, int32_t>>( { { "", 5 }, { "a", -1 }, { "a", 0 }, { "ab", -100 }, { "b", -100 } } );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+BOOST_AUTO_TEST_CASE( level_map_iterates_encoded_keys_in_key_order )
+{ try {
+   fc::temp_directory dir;
+   level_map<std::pair<std::string, int64_t>, uint32_t> map;
+   map.open( dir.path() / "map" );
+
+   std::vector<std::pair<std::string, int64_t>> keys = { { "b", -1 }, { "a", 7 }, { "", 0 }, { "a", -7 }, { "ab", 0 }, { "a", 0 } };
+   for( uint32_t i = 0; i < keys.size(); ++i )
+      map.store( keys[i], i );
+   std::sort( keys.begin(), keys.end() );
+
+   std::vector<std::pair<std::string, int64_t>> iterated;
+   for( auto itr = map.begin(); itr.valid(); ++itr )
+      iterated.push_back( itr.key() );
+   BOOST_CHECK( iterated == keys );
+
+   // lower_bound seeks on the encoded key, so it must land where std::lower_bound would
+   auto itr = map.lower_bound( std::make_pair( std::string( "a" ), int64_t( -1 ) ) );
+   BOOST_REQUIRE( itr.valid() );
+   BOOST_CHECK( itr.key() == std::make_pair( std::string( "a" ), int64_t( 0 ) ) );
+   map.close();
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
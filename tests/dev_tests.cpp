@@ -1,6 +1,8 @@
 #define BOOST_TEST_MODULE BlockchainTests2cc
 #include <boost/test/unit_test.hpp>
 #include "dev_fixture.hpp"
+#include <bts/rpc/rpc_server.hpp>
+#include <fc/crypto/base64.hpp>
 
 
 BOOST_FIXTURE_TEST_CASE( basic_commands, chain_fixture )
@@ -738,3 +740,123 @@ BOOST_FIXTURE_TEST_CASE( fork_testing, chain_fixture )
    exec( clientb, "info" );
    exec( clienta, "info" );
 }
+
+BOOST_FIXTURE_TEST_CASE( snapshot_round_trip, chain_fixture )
+{ try {
+   produce_block(clientb);
+   produce_block(clienta);
+   exec(clienta, "wallet_account_create testaccount");
+   exec(clienta, "wallet_account_register testaccount delegate1");
+   produce_block(clientb);
+
+   auto source = clienta->get_chain();
+   fc::temp_directory snapshot_dir;
+   const fc::sha256 digest = source->export_snapshot( snapshot_dir.path() / "snapshot.bin" );
+
+   fc::temp_directory imported_dir;
+   const fc::path imported_chain_dir = imported_dir.path() / "chain";
+   const snapshot_header header = std::make_shared<chain_database>()->import_snapshot( imported_chain_dir,
+                                                                                       snapshot_dir.path() / "snapshot.bin", true );
+   BOOST_CHECK_EQUAL( header.block_num, source->get_head_block_num() );
+   BOOST_CHECK( header.block_id == source->get_head_block_id() );
+
+   const auto snapshot_base = chain_database::get_snapshot_base( imported_chain_dir );
+   BOOST_REQUIRE( snapshot_base.valid() );
+   BOOST_CHECK_EQUAL( snapshot_base->block_num, header.block_num );
+
+   {
+      auto imported = std::make_shared<chain_database>();
+      imported->open( imported_chain_dir, clienta_dir.path() / "genesis.json" );
+      BOOST_CHECK_EQUAL( imported->get_head_block_num(), source->get_head_block_num() );
+      BOOST_CHECK( imported->get_head_block_id() == source->get_head_block_id() );
+      BOOST_CHECK( imported->chain_id() == source->chain_id() );
+      BOOST_REQUIRE( imported->get_account_record( "testaccount" ).valid() );
+      BOOST_CHECK( imported->get_account_record( "testaccount" )->id == source->get_account_record( "testaccount" )->id );
+
+      // the imported state must export to exactly the same snapshot
+      BOOST_CHECK( imported->export_snapshot( snapshot_dir.path() / "reexported.bin" ) == digest );
+      imported->close();
+   }
+
+   // there are no blocks before the snapshot to rebuild the index from
+   fc::remove_all( imported_chain_dir / "index" );
+   auto reindexed = std::make_shared<chain_database>();
+   BOOST_CHECK_THROW( reindexed->open( imported_chain_dir, clienta_dir.path() / "genesis.json" ), snapshot_index_rebuild );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( snapshot_bootstrap_with_unified_index, chain_fixture )
+{ try {
+   produce_block(clientb);
+   produce_block(clienta);
+
+   auto source = clienta->get_chain();
+   fc::temp_directory snapshot_dir;
+   source->export_snapshot( snapshot_dir.path() / "snapshot.bin" );
+
+   // the client imports with the same storage options it opens the database with
+   fc::temp_directory imported_dir;
+   const fc::path imported_chain_dir = imported_dir.path() / "chain";
+   {
+      auto importing = std::make_shared<chain_database>();
+      importing->set_unified_index_storage( true );
+      importing->import_snapshot( imported_chain_dir, snapshot_dir.path() / "snapshot.bin", true );
+   }
+   BOOST_CHECK( fc::exists( imported_chain_dir / "index/unified_db" ) );
+
+   // opening must not try to rebuild the index, which a snapshot-based chain can't do, and must survive a reopen
+   for( int i = 0; i < 2; ++i )
+   {
+      auto imported = std::make_shared<chain_database>();
+      imported->set_unified_index_storage( true );
+      imported->open( imported_chain_dir, clienta_dir.path() / "genesis.json" );
+      BOOST_CHECK_EQUAL( imported->get_head_block_num(), source->get_head_block_num() );
+      BOOST_CHECK( imported->get_head_block_id() == source->get_head_block_id() );
+      imported->close();
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_FIXTURE_TEST_CASE( rpc_response_cache, chain_fixture )
+{ try {
+   rpc_server_config rpc_config;
+   rpc_config.enable = true;
+   rpc_config.rpc_user = "user";
+   rpc_config.rpc_password = "password";
+   rpc_config.httpd_endpoint = fc::ip::endpoint::from_string( "127.0.0.1:0" );
+   rpc_config.cached_methods = { "blockchain_get_block_count", "blockchain_get_block" };
+   auto rpc = clienta->get_rpc_server();
+   BOOST_REQUIRE( rpc->configure_http( rpc_config ) );
+   const fc::ip::endpoint endpoint = *rpc->get_httpd_endpoint();
+
+   auto call = [&]( const string& body ) -> std::pair<int, string>
+   {
+      fc::http::connection connection;
+      connection.connect_to( endpoint );
+      fc::http::headers headers;
+      headers.push_back( fc::http::header( "Authorization", "Basic " + fc::base64_encode( "user:password" ) ) );
+      const fc::http::reply reply = connection.request( "POST", "http://" + string( endpoint ) + "/rpc", body, headers );
+      return std::make_pair( int( reply.status ), string( reply.body.begin(), reply.body.end() ) );
+   };
+   const string get_block_count = R"({"id":1,"method":"blockchain_get_block_count","params":[]})";
+
+   produce_block(clientb);
+   const auto first = call( get_block_count );
+   BOOST_CHECK_EQUAL( first.first, int( fc::http::reply::OK ) );
+   BOOST_CHECK_EQUAL( first.second, R"({"id":1,"result":)" + fc::to_string( clienta->get_chain()->get_head_block_num() ) + "}" );
+   BOOST_CHECK_EQUAL( call( get_block_count ).second, first.second );
+
+   // a new head block invalidates every cached response
+   produce_block(clienta);
+   const auto second = call( get_block_count );
+   BOOST_CHECK_EQUAL( second.second, R"({"id":1,"result":)" + fc::to_string( clienta->get_chain()->get_head_block_num() ) + "}" );
+   BOOST_CHECK( second.second != first.second );
+
+   // the id of each request is echoed even when the result comes from the cache
+   BOOST_CHECK_EQUAL( call( R"({"id":"x","method":"blockchain_get_block_count","params":[]})" ).second,
+                      R"({"id":"x","result":)" + fc::to_string( clienta->get_chain()->get_head_block_num() ) + "}" );
+
+   // errors are never cached, and are reported like those of any other method
+   const auto error = call( R"({"id":2,"method":"blockchain_get_block","params":["not a block"]})" );
+   BOOST_CHECK_EQUAL( error.first, int( fc::http::reply::InternalServerError ) );
+   BOOST_CHECK( error.second.find( "\"error\"" ) != string::npos );
+   BOOST_CHECK( error.second.find( "\"id\":2" ) != string::npos );
+} FC_LOG_AND_RETHROW() }
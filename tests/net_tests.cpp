@@ -0,0 +1,216 @@
+#define BOOST_TEST_MODULE NetworkTests
+#include <boost/test/unit_test.hpp>
+
+#include <bts/net/core_messages.hpp>
+#include <bts/net/message_oriented_connection.hpp>
+#include <bts/net/peer_connection.hpp>
+#include <bts/net/rolling_bloom_filter.hpp>
+
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace bts::net;
+
+/** Records what arrives on one end of a connection */
+struct recording_delegate : public peer_connection_delegate
+{
+   void on_message( peer_connection* originating_peer, const message& received_message ) override
+   {
+      std::string description = fc::variant( core_message_type_enum( received_message.msg_type ) ).as_string();
+      if( received_message.msg_type == core_message_type_enum::item_ids_inventory_message_type )
+         description += received_message.as<item_ids_inventory_message>().item_type == block_message_type ? " (blocks)" : " (transactions)";
+      received.push_back( description );
+   }
+   void on_connection_closed( peer_connection* originating_peer ) override {}
+
+   std::vector<std::string> received;
+};
+
+/** Two peer_connections talking to each other over a loopback socket */
+struct connected_peers_fixture
+{
+   connected_peers_fixture()
+   {
+      server.listen( 0 );
+      sender = peer_connection::make_shared( &sender_delegate );
+      receiver = peer_connection::make_shared( &receiver_delegate );
+      fc::future<void> accept_done = fc::async( [&]{
+         server.accept( receiver->get_socket() );
+         receiver->accept_connection();
+      } );
+      sender->connect_to( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), server.get_port() ) );
+      accept_done.wait();
+   }
+
+   ~connected_peers_fixture()
+   {
+      sender->destroy_connection();
+      receiver->destroy_connection();
+   }
+
+   void wait_for_messages( size_t count )
+   {
+      for( int i = 0; i < 500 && receiver_delegate.received.size() < count; ++i )
+         fc::usleep( fc::milliseconds( 10 ) );
+   }
+
+   fc::tcp_server      server;
+   recording_delegate  sender_delegate;
+   recording_delegate  receiver_delegate;
+   peer_connection_ptr sender;
+   peer_connection_ptr receiver;
+};
+
+BOOST_FIXTURE_TEST_CASE( queued_messages_are_sent_in_priority_order, connected_peers_fixture )
+{ try {
+   // the send task doesn't start until this task yields, so all of these are queued before any is sent
+   sender->send_message( message( address_request_message() ) );
+   sender->send_message( message( item_ids_inventory_message( trx_message_type, { item_hash_t() } ) ) );
+   sender->send_message( message( fetch_blockchain_item_ids_message( block_message_type, {} ) ) );
+   sender->send_message( message( item_ids_inventory_message( block_message_type, { item_hash_t() } ) ) );
+   sender->send_message( message( current_time_request_message( fc::time_point::now() ) ) );
+   sender->send_message( message( item_ids_inventory_message( block_message_type, { item_hash_t() } ) ) );
+
+   wait_for_messages( 6 );
+   const std::vector<std::string> expected = {
+      "current_time_request_message_type",
+      "item_ids_inventory_message_type (blocks)",
+      "item_ids_inventory_message_type (blocks)",
+      "fetch_blockchain_item_ids_message_type",
+      "item_ids_inventory_message_type (transactions)",
+      "address_request_message_type"
+   };
+   BOOST_CHECK_EQUAL_COLLECTIONS( receiver_delegate.received.begin(), receiver_delegate.received.end(),
+                                  expected.begin(), expected.end() );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+static item_id make_item_id( uint32_t n )
+{
+   return item_id( trx_message_type, fc::ripemd160::hash( (const char*)&n, sizeof(n) ) );
+}
+
+BOOST_AUTO_TEST_CASE( rolling_bloom_filter_false_positive_rate )
+{ try {
+   const double false_positive_rate = 0.01;
+   rolling_bloom_filter filter( fc::minutes( 2 ), 4000, false_positive_rate );
+   const uint32_t item_count = 4000;
+   for( uint32_t i = 0; i < item_count; ++i )
+      filter.insert( make_item_id( i ) );
+
+   // a burst fills the small first generation, after which the next one is sized for the maximum
+   for( uint32_t i = 0; i < item_count; ++i )
+      BOOST_REQUIRE( filter.contains( make_item_id( i ) ) );
+
+   const uint32_t probe_count = 100000;
+   uint32_t false_positives = 0;
+   for( uint32_t i = item_count; i < item_count + probe_count; ++i )
+      if( filter.contains( make_item_id( i ) ) )
+         ++false_positives;
+   BOOST_CHECK_LT( false_positives, 2 * false_positive_rate * probe_count );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+BOOST_AUTO_TEST_CASE( rolling_bloom_filter_sizes_generations_by_rate )
+{ try {
+   rolling_bloom_filter quiet_filter;
+   rolling_bloom_filter busy_filter;
+   const size_t initial_usage = busy_filter.memory_usage();
+   for( uint32_t i = 0; i < 10000; ++i )
+      busy_filter.insert( make_item_id( i ) );
+   quiet_filter.insert( make_item_id( 0 ) );
+
+   BOOST_CHECK_EQUAL( quiet_filter.memory_usage(), initial_usage );
+   BOOST_CHECK_GT( busy_filter.memory_usage(), 4 * initial_usage );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+BOOST_AUTO_TEST_CASE( rolling_bloom_filter_forgets_items_after_the_window )
+{ try {
+   // four generations over a 300ms window: each one covers 100ms
+   rolling_bloom_filter filter( fc::milliseconds( 300 ) );
+   const item_id old_item = make_item_id( 1 );
+   const item_id new_item = make_item_id( 2 );
+
+   filter.insert( old_item );
+   fc::usleep( fc::milliseconds( 150 ) );
+   filter.insert( new_item ); // starts a new generation
+   BOOST_CHECK( filter.contains( old_item ) );
+   BOOST_CHECK( filter.contains( new_item ) );
+
+   fc::usleep( fc::milliseconds( 400 ) );
+   BOOST_CHECK( !filter.contains( old_item ) );
+   // the newest generation is kept until something newer replaces it
+   BOOST_CHECK( filter.contains( new_item ) );
+
+   filter.clear();
+   BOOST_CHECK( !filter.contains( new_item ) );
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }
+
+/** Collects the messages arriving on a message_oriented_connection */
+struct message_collector : public message_oriented_connection_delegate
+{
+   void on_message( message_oriented_connection* originating_connection, const message& received_message ) override
+   {
+      received.push_back( received_message );
+   }
+   void on_connection_closed( message_oriented_connection* originating_connection ) override {}
+
+   std::vector<message> received;
+};
+
+static message make_test_message( uint32_t msg_type, size_t size )
+{
+   message test_message;
+   test_message.msg_type = msg_type;
+   test_message.size = (uint32_t)size;
+   test_message.data.resize( size );
+   for( size_t i = 0; i < size; ++i )
+      test_message.data[i] = char( ( i * 131 + msg_type ) & 0xff );
+   return test_message;
+}
+
+BOOST_AUTO_TEST_CASE( chunked_reads_deliver_every_message_intact )
+{ try {
+   fc::tcp_server server;
+   server.listen( 0 );
+   message_collector sender_delegate;
+   message_collector receiver_delegate;
+   message_oriented_connection sender( &sender_delegate );
+   message_oriented_connection receiver( &receiver_delegate );
+   fc::future<void> accept_done = fc::async( [&]{
+      server.accept( receiver.get_socket() );
+      receiver.accept();
+   } );
+   sender.connect_to( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), server.get_port() ) );
+   accept_done.wait();
+
+   // many small messages share each read, and the large ones span several reads or outgrow the buffer
+   std::vector<message> sent;
+   for( size_t size : { size_t( 1 ), size_t( 15 ), size_t( 16 ), size_t( 17 ) } )
+      sent.push_back( make_test_message( uint32_t( sent.size() ), size ) );
+   for( uint32_t i = 0; i < 1000; ++i )
+      sent.push_back( make_test_message( uint32_t( sent.size() ), 40 + i % 64 ) );
+   for( size_t size : { size_t( BTS_NET_RECEIVE_BUFFER_SIZE - 8 ), size_t( BTS_NET_RECEIVE_BUFFER_SIZE + 1 ),
+                        size_t( 3 * BTS_NET_RECEIVE_BUFFER_SIZE ), size_t( MAX_MESSAGE_SIZE - 16 ), size_t( 100 ) } )
+      sent.push_back( make_test_message( uint32_t( sent.size() ), size ) );
+
+   for( const message& message_to_send : sent )
+      sender.send_message( message_to_send );
+   for( int i = 0; i < 500 && receiver_delegate.received.size() < sent.size(); ++i )
+      fc::usleep( fc::milliseconds( 10 ) );
+
+   BOOST_REQUIRE_EQUAL( receiver_delegate.received.size(), sent.size() );
+   for( size_t i = 0; i < sent.size(); ++i )
+   {
+      BOOST_CHECK_EQUAL( receiver_delegate.received[i].msg_type, sent[i].msg_type );
+      BOOST_CHECK_EQUAL( receiver_delegate.received[i].size, sent[i].size );
+      BOOST_CHECK( receiver_delegate.received[i].data == sent[i].data );
+   }
+
+   sender.destroy_connection();
+   receiver.destroy_connection();
+} catch ( const fc::exception& e ) { elog( "${e}", ("e",e.to_detail_string()) ); throw; } }